@@ -0,0 +1,44 @@
+/*
+* This source file is part of the osgOcean library
+* 
+* Copyright (C) 2009 Kim Bale
+* Copyright (C) 2009 The University of Hull, UK
+* 
+* This program is free software; you can redistribute it and/or modify it under
+* the terms of the GNU Lesser General Public License as published by the Free Software
+* Foundation; either version 3 of the License, or (at your option) any later
+* version.
+
+* This program is distributed in the hope that it will be useful, but WITHOUT
+* ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+* FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+* http://www.gnu.org/copyleft/lesser.txt.
+*/
+
+// ------------------------------------------------------------------------------
+// -- THIS FILE HAS BEEN CREATED AS PART OF THE BUILD PROCESS -- DO NOT MODIFY --
+// ------------------------------------------------------------------------------
+
+static const char osgOcean_heightmap_world_vert[] =
+	"// osgOcean uniforms\n"
+	"// -------------------\n"
+	"uniform float osgOcean_WaterHeight;\n"
+	"// ------------------\n"
+	"\n"
+	"varying vec4 vWorldVertex;\n"
+	"\n"
+	"void main(void)\n"
+	"{\n"
+	"	// The tile cameras look straight down and their view matrix is a\n"
+	"	// horizontal translation, so the eye space height is the world height.\n"
+	"	vWorldVertex = gl_ModelViewMatrix * gl_Vertex;\n"
+	"	vWorldVertex.xyzw /= vWorldVertex.w;\n"
+	"\n"
+	"	gl_Position = gl_ModelViewProjectionMatrix * gl_Vertex;\n"
+	"\n"
+	"	// Keep everything inside the depth range, the depth written is the\n"
+	"	// water depth computed in the fragment shader.\n"
+	"	gl_Position.z = 0.0;\n"
+	"\n"
+	"	return;\n"
+	"}\n";
@@ -0,0 +1,42 @@
+/*
+* This source file is part of the osgOcean library
+* 
+* Copyright (C) 2009 Kim Bale
+* Copyright (C) 2009 The University of Hull, UK
+* 
+* This program is free software; you can redistribute it and/or modify it under
+* the terms of the GNU Lesser General Public License as published by the Free Software
+* Foundation; either version 3 of the License, or (at your option) any later
+* version.
+
+* This program is distributed in the hope that it will be useful, but WITHOUT
+* ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+* FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+* http://www.gnu.org/copyleft/lesser.txt.
+*/
+
+// ------------------------------------------------------------------------------
+// -- THIS FILE HAS BEEN CREATED AS PART OF THE BUILD PROCESS -- DO NOT MODIFY --
+// ------------------------------------------------------------------------------
+
+static const char osgOcean_kawase_down_frag[] =
+	"#extension GL_ARB_texture_rectangle : enable\n"
+	"\n"
+	"uniform sampler2DRect osgOcean_KawaseTexture;\n"
+	"\n"
+	"// Dual filter downsample. Texture coordinates are in source texels, at the\n"
+	"// corner of the 2x2 block under the fragment, so each tap is a bilinear \n"
+	"// average of four texels.\n"
+	"void main( void )\n"
+	"{\n"
+	"	vec2 st = gl_TexCoord[0].st;\n"
+	"\n"
+	"	vec3 color = texture2DRect(osgOcean_KawaseTexture, st).rgb * 4.0;\n"
+	"\n"
+	"	color += texture2DRect(osgOcean_KawaseTexture, st + vec2(-1.0, 1.0)).rgb;\n"
+	"	color += texture2DRect(osgOcean_KawaseTexture, st + vec2( 1.0, 1.0)).rgb;\n"
+	"	color += texture2DRect(osgOcean_KawaseTexture, st + vec2( 1.0,-1.0)).rgb;\n"
+	"	color += texture2DRect(osgOcean_KawaseTexture, st + vec2(-1.0,-1.0)).rgb;\n"
+	"\n"
+	"	gl_FragColor = vec4(color / 8.0, 1.0);\n"
+	"}\n";
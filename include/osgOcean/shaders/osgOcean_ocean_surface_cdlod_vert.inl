@@ -0,0 +1,246 @@
+/*
+* This source file is part of the osgOcean library
+* 
+* Copyright (C) 2009 Kim Bale
+* Copyright (C) 2009 The University of Hull, UK
+* 
+* This program is free software; you can redistribute it and/or modify it under
+* the terms of the GNU Lesser General Public License as published by the Free Software
+* Foundation; either version 3 of the License, or (at your option) any later
+* version.
+
+* This program is distributed in the hope that it will be useful, but WITHOUT
+* ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+* FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+* http://www.gnu.org/copyleft/lesser.txt.
+*/
+
+// ------------------------------------------------------------------------------
+// -- THIS FILE HAS BEEN CREATED AS PART OF THE BUILD PROCESS -- DO NOT MODIFY --
+// ------------------------------------------------------------------------------
+
+static const char osgOcean_ocean_surface_cdlod_vert[] =
+	"#extension GL_EXT_texture_array : enable\n"
+	"\n"
+	"uniform mat4 osg_ViewMatrixInverse;\n"
+	"uniform float osg_FrameTime;\n"
+	"\n"
+	"uniform vec3 osgOcean_Eye;\n"
+	"\n"
+	"uniform vec3 osgOcean_NoiseCoords0;\n"
+	"uniform vec3 osgOcean_NoiseCoords1;\n"
+	"\n"
+	"uniform vec4 osgOcean_WaveTop;\n"
+	"uniform vec4 osgOcean_WaveBot;\n"
+	"\n"
+	"uniform float osgOcean_FoamScale;\n"
+	"\n"
+	"// Used to blend the waves into a sinus curve near the shore\n"
+	"uniform sampler2D osgOcean_Heightmap;\n"
+	"uniform bool osgOcean_EnableHeightmap;\n"
+	"uniform vec2 osgOcean_HeightmapUVScale;\n"
+	"uniform bool osgOcean_EnableWorldHeightmap;\n"
+	"uniform bool osgOcean_EnableRefractionHeightmap;\n"
+	"uniform sampler2D osgOcean_RefractionDepthMap;\n"
+	"uniform vec2 osgOcean_RefractionUVScale;\n"
+	"uniform mat4 osgOcean_RefractionViewProjection;\n"
+	"uniform mat4 osgOcean_RefractionInverseTransformation;\n"
+	"uniform float osgOcean_WorldHeightmapSize;\n"
+	"uniform vec2 osgOcean_WorldHeightmapCentre;\n"
+	"\n"
+	"uniform bool osgOcean_EnableUnderwaterScattering;\n"
+	"uniform float osgOcean_WaterHeight;\n"
+	"uniform vec3 osgOcean_UnderwaterAttenuation;\n"
+	"uniform vec4 osgOcean_UnderwaterDiffuse;\n"
+	"\n"
+	"// One layer per frame: xyz = x,y displacement and height\n"
+	"uniform sampler2DArray osgOcean_DisplacementMap;\n"
+	"uniform sampler2DArray osgOcean_DisplacementNormalMap;\n"
+	"// x: 1/tile resolution, y: half a texel\n"
+	"uniform vec2 osgOcean_DisplacementCoords;\n"
+	"uniform float osgOcean_DisplacementFrame;\n"
+	"\n"
+	"// Local position of the heightfield tile origin\n"
+	"uniform vec2 osgOcean_TileOrigin;\n"
+	"// x: patch cells along a node edge, y: LOD range of level 0, z: fraction of a\n"
+	"// range at which morphing starts, w: coarsest level\n"
+	"uniform vec4 osgOcean_CDLODParams;\n"
+	"// Eye the nodes were selected from\n"
+	"uniform vec3 osgOcean_CDLODEye;\n"
+	"\n"
+	"// Per instance: node corner x,y, node size and level\n"
+	"attribute vec4 osgOcean_NodeParams;\n"
+	"\n"
+	"varying vec4 vVertex;\n"
+	"varying vec4 vWorldVertex;\n"
+	"varying vec3 vNormal;\n"
+	"varying vec3 vViewerDir;\n"
+	"varying vec3 vLightDir;\n"
+	"\n"
+	"varying vec3 vExtinction;\n"
+	"varying vec3 vInScattering;\n"
+	"\n"
+	"varying vec3 vWorldViewDir;\n"
+	"varying vec3 vWorldNormal;\n"
+	"\n"
+	"varying float height;\n"
+	"\n"
+	"mat3 get3x3Matrix( mat4 m )\n"
+	"{\n"
+	"    mat3 result;\n"
+	"\n"
+	"    result[0][0] = m[0][0];\n"
+	"    result[0][1] = m[0][1];\n"
+	"    result[0][2] = m[0][2];\n"
+	"\n"
+	"    result[1][0] = m[1][0];\n"
+	"    result[1][1] = m[1][1];\n"
+	"    result[1][2] = m[1][2];\n"
+	"\n"
+	"    result[2][0] = m[2][0];\n"
+	"    result[2][1] = m[2][1];\n"
+	"    result[2][2] = m[2][2];\n"
+	"\n"
+	"    return result;\n"
+	"}\n"
+	"\n"
+	"void computeScattering( in vec3 eye, in vec3 worldVertex, out vec3 extinction, out vec3 inScattering )\n"
+	"{\n"
+	"	float viewDist = length(eye-worldVertex);\n"
+	"	\n"
+	"	float depth = max(osgOcean_WaterHeight-worldVertex.z, 0.0);\n"
+	"	\n"
+	"	extinction = exp(-osgOcean_UnderwaterAttenuation*viewDist*2.0);\n"
+	"\n"
+	"	// Need to compute accurate kd constant.\n"
+	"	// const vec3 kd = vec3(0.001, 0.001, 0.001);\n"
+	"	inScattering = osgOcean_UnderwaterDiffuse.rgb * (1.0-extinction*exp(-depth*vec3(0.001)));\n"
+	"}\n"
+	"\n"
+	"// Places a patch vertex in the node, sliding odd vertices onto the grid of\n"
+	"// the next coarser level as the vertex nears the end of its level's range.\n"
+	"// A node's edge is fully morphed by the time it meets a coarser neighbour,\n"
+	"// so no cracks appear and levels blend without popping.\n"
+	"vec2 morphVertex( in vec2 gridPos )\n"
+	"{\n"
+	"    float cellSize = osgOcean_NodeParams.z / osgOcean_CDLODParams.x;\n"
+	"    vec2 flatPos = osgOcean_NodeParams.xy + gridPos * cellSize;\n"
+	"\n"
+	"    if( osgOcean_NodeParams.w >= osgOcean_CDLODParams.w )\n"
+	"        return flatPos;\n"
+	"\n"
+	"    float range = osgOcean_CDLODParams.y * exp2( osgOcean_NodeParams.w );\n"
+	"    float morphStart = range * osgOcean_CDLODParams.z;\n"
+	"    float dist = distance( vec3( flatPos, 0.0 ), osgOcean_CDLODEye );\n"
+	"    float morph = clamp( (dist - morphStart) / (range - morphStart), 0.0, 1.0 );\n"
+	"\n"
+	"    return flatPos - mod( gridPos, 2.0 ) * cellSize * morph;\n"
+	"}\n"
+	"\n"
+	"// Water depth from the cached top-down heightmap, which repeats every \n"
+	"// osgOcean_WorldHeightmapSize metres. Deep water outside the cached area.\n"
+	"float worldHeightmapDepth( vec2 worldCoords )\n"
+	"{\n"
+	"    vec2 offset = abs( worldCoords - osgOcean_WorldHeightmapCentre );\n"
+	"    if( max(offset.x, offset.y) > osgOcean_WorldHeightmapSize * 0.5 )\n"
+	"        return 1.0;\n"
+	"\n"
+	"    return texture2D( osgOcean_Heightmap, worldCoords / osgOcean_WorldHeightmapSize ).x;\n"
+	"}\n"
+	"\n"
+	"// Water depth along the view ray from the refraction pass's depth, used \n"
+	"// in place of a separate height map pass. Scaled as the height map (500m).\n"
+	"float refractionHeightmapDepth( vec4 worldVertex )\n"
+	"{\n"
+	"    vec4 refractionPos = osgOcean_RefractionViewProjection * worldVertex;\n"
+	"    vec2 screenCoords = clamp( refractionPos.xy / refractionPos.w * 0.5 + 0.5, 0.0, 1.0 );\n"
+	"    float depth = texture2D( osgOcean_RefractionDepthMap, screenCoords * osgOcean_RefractionUVScale ).x;\n"
+	"\n"
+	"    vec4 floorVertex = osgOcean_RefractionInverseTransformation * vec4( vec3(screenCoords, depth) * 2.0 - 1.0, 1.0 );\n"
+	"    return clamp( (osgOcean_WaterHeight - floorVertex.z / floorVertex.w) / 500.0, 0.0, 1.0 );\n"
+	"}\n"
+	"\n"
+	"// -------------------------------\n"
+	"//          Main Program\n"
+	"// -------------------------------\n"
+	"\n"
+	"void main( void )\n"
+	"{\n"
+	"    // Place the patch vertex in its node on the water plane\n"
+	"    vec4 inputVertex = vec4( morphVertex( gl_Vertex.xy ), 0.0, 1.0 );\n"
+	"\n"
+	"    // Then displace it with the current frame of the periodic heightfield\n"
+	"    vec3 frameCoords = vec3( vec2( inputVertex.x - osgOcean_TileOrigin.x, osgOcean_TileOrigin.y - inputVertex.y ) \n"
+	"                             * osgOcean_DisplacementCoords.x + osgOcean_DisplacementCoords.y,\n"
+	"                             osgOcean_DisplacementFrame );\n"
+	"\n"
+	"    inputVertex.xyz += texture2DArrayLod( osgOcean_DisplacementMap, frameCoords, 0.0 ).xyz;\n"
+	"    vec3 inputNormal = texture2DArrayLod( osgOcean_DisplacementNormalMap, frameCoords, 0.0 ).xyz;\n"
+	"\n"
+	"    gl_Position = gl_ModelViewProjectionMatrix * inputVertex;\n"
+	"\n"
+	"    // Blend the wave into a sinus curve near the shore\n"
+	"    // note that this requires a vertex shader texture lookup\n"
+	"    // vertex has to be transformed a second time with the new z-value\n"
+	"    if (osgOcean_EnableHeightmap)\n"
+	"    {\n"
+	"        vec2 screenCoords = gl_Position.xy / gl_Position.w;\n"
+	"        \n"
+	"        float waterDepth;\n"
+	"        if (osgOcean_EnableWorldHeightmap)\n"
+	"            waterDepth = worldHeightmapDepth( (osg_ViewMatrixInverse * gl_ModelViewMatrix * inputVertex).xy );\n"
+	"        else if (osgOcean_EnableRefractionHeightmap)\n"
+	"            waterDepth = refractionHeightmapDepth( osg_ViewMatrixInverse * gl_ModelViewMatrix * inputVertex );\n"
+	"        else\n"
+	"            waterDepth = texture2D(osgOcean_Heightmap, clamp(screenCoords * 0.5 + 0.5, 0.0, 1.0) * osgOcean_HeightmapUVScale).x;\n"
+	"\n"
+	"        height = pow(clamp(1.0 - waterDepth, 0.0, 1.0), 32.0);\n"
+	"\n"
+	"        inputVertex = vec4(inputVertex.x, \n"
+	"                           inputVertex.y, \n"
+	"                           mix(inputVertex.z, sin(osg_FrameTime), height),\n"
+	"                           inputVertex.w);\n"
+	"\n"
+	"        gl_Position = gl_ModelViewProjectionMatrix * inputVertex;\n"
+	"    }\n"
+	"\n"
+	"    // -----------------------------------------------------------\n"
+	"\n"
+	"    // In object space\n"
+	"    vVertex = inputVertex;\n"
+	"    vLightDir = normalize( vec3( gl_ModelViewMatrixInverse * ( gl_LightSource[osgOcean_LightID].position ) ) );\n"
+	"    vViewerDir = gl_ModelViewMatrixInverse[3].xyz - inputVertex.xyz;\n"
+	"    vNormal = normalize(inputNormal);\n"
+	"\n"
+	"    vec4 waveColorDiff = osgOcean_WaveTop-osgOcean_WaveBot;\n"
+	"\n"
+	"    gl_FrontColor = waveColorDiff *\n"
+	"        clamp((inputVertex.z + osgOcean_Eye.z) * 0.1111111 + vNormal.z - 0.4666667, 0.0, 1.0) + osgOcean_WaveBot;\n"
+	"\n"
+	"    // -------------------------------------------------------------\n"
+	"\n"
+	"    mat4 modelMatrix = osg_ViewMatrixInverse * gl_ModelViewMatrix;\n"
+	"    mat3 modelMatrix3x3 = get3x3Matrix( modelMatrix );\n"
+	"\n"
+	"    // world space\n"
+	"    vWorldVertex = modelMatrix * inputVertex;\n"
+	"    vWorldNormal = modelMatrix3x3 * inputNormal;\n"
+	"    vWorldViewDir = vWorldVertex.xyz - osgOcean_Eye.xyz;\n"
+	"\n"
+	"    // ------------- Texture Coords ---------------------------------\n"
+	"\n"
+	"    // Normal Map Coords\n"
+	"    gl_TexCoord[0].xy = ( inputVertex.xy * osgOcean_NoiseCoords0.z + osgOcean_NoiseCoords0.xy );\n"
+	"    gl_TexCoord[0].zw = ( inputVertex.xy * osgOcean_NoiseCoords1.z + osgOcean_NoiseCoords1.xy );\n"
+	"    gl_TexCoord[0].y = -gl_TexCoord[0].y;\n"
+	"    gl_TexCoord[0].w = -gl_TexCoord[0].w;\n"
+	"\n"
+	"    // Foam coords\n"
+	"    gl_TexCoord[1].st = inputVertex.xy * osgOcean_FoamScale;\n"
+	"\n"
+	"    // Fog coords\n"
+	"    gl_FogFragCoord = gl_Position.z;\n"
+	"\n"
+	"    if (osgOcean_EnableUnderwaterScattering)\n"
+	"        computeScattering( osgOcean_Eye, vWorldVertex.xyz, vExtinction, vInScattering);\n"
+	"}\n";
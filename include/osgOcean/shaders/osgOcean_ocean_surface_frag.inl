@@ -21,6 +21,7 @@
 
 static const char osgOcean_ocean_surface_frag[] =
 	"uniform bool osgOcean_EnableReflections;\n"
+	"uniform bool osgOcean_EnableScreenSpaceReflections;\n"
 	"uniform bool osgOcean_EnableRefractions;\n"
 	"uniform bool osgOcean_EnableHeightmap;\n"
 	"uniform bool osgOcean_EnableCrestFoam;\n"
@@ -42,6 +43,8 @@ static const char osgOcean_ocean_surface_frag[] =
 	"uniform sampler2D   osgOcean_FoamMap;\n"
 	"uniform sampler2D   osgOcean_NoiseMap;\n"
 	"uniform sampler2D   osgOcean_Heightmap;\n"
+	"uniform sampler2D   osgOcean_SceneColorMap;\n"
+	"uniform sampler2D   osgOcean_SceneDepthMap;\n"
 	"\n"
 	"uniform float osgOcean_UnderwaterFogDensity;\n"
 	"uniform float osgOcean_AboveWaterFogDensity;\n"
@@ -54,8 +57,26 @@ static const char osgOcean_ocean_surface_frag[] =
 	"\n"
 	"uniform mat4 osgOcean_RefractionInverseTransformation;\n"
 	"\n"
+	"// View and projection the RTT textures were last rendered with\n"
+	"uniform mat4 osgOcean_ReflectionViewProjection;\n"
+	"uniform mat4 osgOcean_RefractionViewProjection;\n"
+	"\n"
 	"uniform vec2 osgOcean_ViewportDimensions;\n"
 	"\n"
+	"// Fraction of each RTT texture covered by its pass viewport\n"
+	"uniform vec2 osgOcean_ReflectionUVScale;\n"
+	"uniform vec2 osgOcean_RefractionUVScale;\n"
+	"uniform vec2 osgOcean_HeightmapUVScale;\n"
+	"\n"
+	"// Largest coordinate inside each pass viewport, half a texel in from its edge\n"
+	"uniform vec2 osgOcean_ReflectionUVLimit;\n"
+	"uniform vec2 osgOcean_RefractionUVLimit;\n"
+	"uniform vec2 osgOcean_HeightmapUVLimit;\n"
+	"uniform bool osgOcean_EnableWorldHeightmap;\n"
+	"uniform bool osgOcean_EnableRefractionHeightmap;\n"
+	"uniform float osgOcean_WorldHeightmapSize;\n"
+	"uniform vec2 osgOcean_WorldHeightmapCentre;\n"
+	"\n"
 	"uniform float osgOcean_WaterHeight;\n"
 	"uniform float osgOcean_FoamCapBottom;\n"
 	"uniform float osgOcean_FoamCapTop;\n"
@@ -80,7 +101,7 @@ static const char osgOcean_ocean_surface_frag[] =
 	"\n"
 	"const vec4 BlueEnvColor = vec4(0.75, 0.85, 1.0, 1.0);\n"
 	"\n"
-	"vec4 distortGen( vec4 v, vec3 N )\n"
+	"vec4 distortGen( vec4 v, vec3 N, mat4 modelViewProjection )\n"
 	"{\n"
 	"    // transposed\n"
 	"    const mat4 mr =\n"
@@ -89,7 +110,7 @@ static const char osgOcean_ocean_surface_frag[] =
 	"              0.0, 0.0, 0.5, 0.0,\n"
 	"              0.5, 0.5, 0.5, 1.0 );\n"
 	"\n"
-	"    mat4 texgen_matrix = mr * gl_ProjectionMatrix * gl_ModelViewMatrix;\n"
+	"    mat4 texgen_matrix = mr * modelViewProjection;\n"
 	"\n"
 	"    //float disp = 8.0;\n"
 	"    float disp = 4.0;\n"
@@ -103,6 +124,84 @@ static const char osgOcean_ocean_surface_frag[] =
 	"    return texgen_matrix * tempPos;\n"
 	"}\n"
 	"\n"
+	"vec4 distortGen( vec4 v, vec3 N )\n"
+	"{\n"
+	"    return distortGen( v, N, gl_ProjectionMatrix * gl_ModelViewMatrix );\n"
+	"}\n"
+	"\n"
+	"// texture2DProj() restricted to the part of the texture written by a\n"
+	"// dynamically scaled RTT pass. The limit keeps linear filtering from \n"
+	"// blending in the stale texels beyond the pass viewport.\n"
+	"vec4 texture2DProjScaled( sampler2D map, vec4 coord, vec2 uvScale, vec2 uvLimit )\n"
+	"{\n"
+	"    return texture2D( map, min( clamp(coord.xy / coord.w, 0.0, 1.0) * uvScale, uvLimit ) );\n"
+	"}\n"
+	"\n"
+	"// Marches the reflected ray in eye space against the copied scene depth.\n"
+	"// Returns the scene colour where the ray hits, with alpha fading out towards\n"
+	"// the screen edges and the end of the ray. Alpha is 0 on a miss.\n"
+	"vec4 screenSpaceReflection( vec3 eyePos, vec3 eyeNormal )\n"
+	"{\n"
+	"    const int   steps       = 24;\n"
+	"    const int   refinements = 4;\n"
+	"    const float maxDistance = 300.0;\n"
+	"\n"
+	"    vec3 R = normalize( reflect( normalize(eyePos), eyeNormal ) );\n"
+	"\n"
+	"    // Rays heading back towards the eye leave the depth buffer at once.\n"
+	"    if( R.z > 0.0 )\n"
+	"        return vec4(0.0);\n"
+	"\n"
+	"    // Start with short steps and lengthen them so nearby reflections are accurate.\n"
+	"    float stepLength = maxDistance / float(steps * steps);\n"
+	"    vec3 previous = eyePos;\n"
+	"\n"
+	"    for( int i = 1; i <= steps; ++i )\n"
+	"    {\n"
+	"        vec3 current = eyePos + R * stepLength * float(i * i);\n"
+	"\n"
+	"        vec4 clip = gl_ProjectionMatrix * vec4(current, 1.0);\n"
+	"        vec2 uv = clip.xy / clip.w * 0.5 + 0.5;\n"
+	"\n"
+	"        if( uv.x < 0.0 || uv.x > 1.0 || uv.y < 0.0 || uv.y > 1.0 )\n"
+	"            break;\n"
+	"\n"
+	"        float depth = texture2D( osgOcean_SceneDepthMap, uv ).x;\n"
+	"        vec4 scene = gl_ProjectionMatrixInverse * vec4( vec3(uv, depth) * 2.0 - 1.0, 1.0 );\n"
+	"\n"
+	"        if( depth < 1.0 && scene.z / scene.w > current.z )\n"
+	"        {\n"
+	"            // Binary search between the last two steps for the crossing.\n"
+	"            for( int j = 0; j < refinements; ++j )\n"
+	"            {\n"
+	"                vec3 middle = (previous + current) * 0.5;\n"
+	"                clip = gl_ProjectionMatrix * vec4(middle, 1.0);\n"
+	"                uv = clip.xy / clip.w * 0.5 + 0.5;\n"
+	"                depth = texture2D( osgOcean_SceneDepthMap, uv ).x;\n"
+	"                scene = gl_ProjectionMatrixInverse * vec4( vec3(uv, depth) * 2.0 - 1.0, 1.0 );\n"
+	"\n"
+	"                if( scene.z / scene.w > middle.z )\n"
+	"                    current = middle;\n"
+	"                else\n"
+	"                    previous = middle;\n"
+	"            }\n"
+	"\n"
+	"            // Reject hits behind thin objects.\n"
+	"            if( scene.z / scene.w - current.z > length(current - previous) * 4.0 + 1.0 )\n"
+	"                return vec4(0.0);\n"
+	"\n"
+	"            vec2 edge = min( uv, 1.0 - uv );\n"
+	"            float fade = clamp( min(edge.x, edge.y) * 10.0, 0.0, 1.0 ) * (1.0 - float(i) / float(steps));\n"
+	"\n"
+	"            return vec4( texture2D( osgOcean_SceneColorMap, uv ).rgb, fade );\n"
+	"        }\n"
+	"\n"
+	"        previous = current;\n"
+	"    }\n"
+	"\n"
+	"    return vec4(0.0);\n"
+	"}\n"
+	"\n"
 	"vec3 reorientate( vec3 v )\n"
 	"{\n"
 	"    float y = v.y;\n"
@@ -177,6 +276,29 @@ static const char osgOcean_ocean_surface_frag[] =
 	"    return exp2(density * fogCoord * fogCoord );\n"
 	"}\n"
 	"\n"
+	"// Water depth from the cached top-down heightmap, which repeats every \n"
+	"// osgOcean_WorldHeightmapSize metres. Deep water outside the cached area.\n"
+	"float worldHeightmapDepth( vec2 worldCoords )\n"
+	"{\n"
+	"    vec2 offset = abs( worldCoords - osgOcean_WorldHeightmapCentre );\n"
+	"    if( max(offset.x, offset.y) > osgOcean_WorldHeightmapSize * 0.5 )\n"
+	"        return 1.0;\n"
+	"\n"
+	"    return texture2D( osgOcean_Heightmap, worldCoords / osgOcean_WorldHeightmapSize ).x;\n"
+	"}\n"
+	"\n"
+	"// Water depth along the view ray from the refraction pass's depth, used \n"
+	"// in place of a separate height map pass. Scaled as the height map (500m).\n"
+	"float refractionHeightmapDepth( vec4 worldVertex )\n"
+	"{\n"
+	"    vec4 refractionPos = osgOcean_RefractionViewProjection * worldVertex;\n"
+	"    vec2 screenCoords = clamp( refractionPos.xy / refractionPos.w * 0.5 + 0.5, 0.0, 1.0 );\n"
+	"    float depth = texture2D( osgOcean_RefractionDepthMap, screenCoords * osgOcean_RefractionUVScale ).x;\n"
+	"\n"
+	"    vec4 floorVertex = osgOcean_RefractionInverseTransformation * vec4( vec3(screenCoords, depth) * 2.0 - 1.0, 1.0 );\n"
+	"    return clamp( (osgOcean_WaterHeight - floorVertex.z / floorVertex.w) / 500.0, 0.0, 1.0 );\n"
+	"}\n"
+	"\n"
 	"// -------------------------------\n"
 	"//          Main Program\n"
 	"// -------------------------------\n"
@@ -212,8 +334,24 @@ static const char osgOcean_ocean_surface_frag[] =
 	"\n"
 	"        vec4 distortedVertex = distortGen(vVertex, N);\n"
 	"\n"
+	"        // Reflections and refractions may have been rendered in an earlier\n"
+	"        // frame, project through the view they were rendered with.\n"
+	"        vec4 reflectionVertex = distortGen(vVertex, N, osgOcean_ReflectionViewProjection * worldObjectMatrix);\n"
+	"        vec4 refractionVertex = distortGen(vVertex, N, osgOcean_RefractionViewProjection * worldObjectMatrix);\n"
+	"        vec4 refractionPos    = distortGen(vVertex, vec3(0.0), osgOcean_RefractionViewProjection * worldObjectMatrix);\n"
+	"\n"
+	"        // A framebuffer copy also holds the objects in front of the water.\n"
+	"        // Where the distorted coordinate lands on one, refract nothing.\n"
+	"        vec2 refractionCoords = clamp( refractionVertex.xy / refractionVertex.w, 0.0, 1.0 );\n"
+	"        float refractionDepth = texture2DProjScaled(osgOcean_RefractionDepthMap, refractionVertex, osgOcean_RefractionUVScale, osgOcean_RefractionUVLimit).x;\n"
+	"        vec4 sampleWorld = osgOcean_RefractionInverseTransformation * vec4( vec3(refractionCoords, refractionDepth) * 2.0 - 1.0, 1.0 );\n"
+	"        vec3 eyePosition = osg_ViewMatrixInverse[3].xyz;\n"
+	"\n"
+	"        if( distance(eyePosition, sampleWorld.xyz / sampleWorld.w) < distance(eyePosition, vWorldVertex.xyz) )\n"
+	"            refractionVertex = refractionPos;\n"
+	"\n"
 	"        // Calculate the position in world space of the pixel on the ocean floor\n"
-	"        vec4 refraction_ndc = vec4(gl_FragCoord.xy / osgOcean_ViewportDimensions, texture2DProj(osgOcean_RefractionDepthMap, distortedVertex).x, 1.0);\n"
+	"        vec4 refraction_ndc = vec4(refractionPos.xy / refractionPos.w, texture2DProjScaled(osgOcean_RefractionDepthMap, refractionVertex, osgOcean_RefractionUVScale, osgOcean_RefractionUVLimit).x, 1.0);\n"
 	"        vec4 refraction_screen = refraction_ndc * 2.0 - 1.0;\n"
 	"        vec4 refraction_world = osgOcean_RefractionInverseTransformation * refraction_screen;\n"
 	"        refraction_world = refraction_world / refraction_world.w;\n"
@@ -227,19 +365,31 @@ static const char osgOcean_ocean_surface_frag[] =
 	"\n"
 	"        if(osgOcean_EnableReflections)\n"
 	"        {\n"
-	"            env_color = texture2DProj( osgOcean_ReflectionMap, distortedVertex );\n"
+	"            env_color = texture2DProjScaled( osgOcean_ReflectionMap, reflectionVertex, osgOcean_ReflectionUVScale, osgOcean_ReflectionUVLimit );\n"
+	"        }\n"
+	"        else if(osgOcean_EnableScreenSpaceReflections)\n"
+	"        {\n"
+	"            vec3 reflected = reflect( normalize(vWorldViewDir), normalize(vWorldNormal + noiseNormal) );\n"
+	"            reflected.z = abs( reflected.z );\n"
+	"            env_color = textureCube( osgOcean_EnvironmentMap, reorientate( reflected ) );\n"
 	"        }\n"
 	"        else\n"
 	"        {\n"
 	"            env_color = BlueEnvColor * gl_LightSource[osgOcean_LightID].diffuse * vec4(vec3(1.25), 1.0);\n"
 	"        }\n"
 	"\n"
+	"        if(osgOcean_EnableScreenSpaceReflections)\n"
+	"        {\n"
+	"            vec4 ssr_color = screenSpaceReflection( vec3(gl_ModelViewMatrix * vVertex), normalize(gl_NormalMatrix * N) );\n"
+	"            env_color.rgb = mix( env_color.rgb, ssr_color.rgb, ssr_color.a );\n"
+	"        }\n"
+	"\n"
 	"        // Determine refraction color\n"
 	"        vec4 refraction_color = vec4( gl_Color.rgb, 1.0 );\n"
 	"        // Only use refraction for under the ocean surface.\n"
 	"        if(osgOcean_EnableRefractions)\n"
 	"        {\n"
-	"            vec4 refractionmap_color = texture2DProj(osgOcean_RefractionMap, distortedVertex );\n"
+	"            vec4 refractionmap_color = texture2DProjScaled(osgOcean_RefractionMap, refractionVertex, osgOcean_RefractionUVScale, osgOcean_RefractionUVLimit );\n"
 	"\n"
 	"            if(osgOcean_EnableUnderwaterScattering)\n"
 	"            {\n"
@@ -271,7 +421,12 @@ static const char osgOcean_ocean_surface_frag[] =
 	"        if (osgOcean_EnableHeightmap)\n"
 	"        {\n"
 	"            // The vertical distance between the ocean surface and ocean floor, this uses the projected heightmap\n"
-	"            waterHeight = (texture2DProj(osgOcean_Heightmap, distortedVertex).x) * 500.0;\n"
+	"            if (osgOcean_EnableWorldHeightmap)\n"
+	"                waterHeight = worldHeightmapDepth(vWorldVertex.xy) * 500.0;\n"
+	"            else if (osgOcean_EnableRefractionHeightmap)\n"
+	"                waterHeight = refractionHeightmapDepth(vWorldVertex) * 500.0;\n"
+	"            else\n"
+	"                waterHeight = (texture2DProjScaled(osgOcean_Heightmap, distortedVertex, osgOcean_HeightmapUVScale, osgOcean_HeightmapUVLimit).x) * 500.0;\n"
 	"        }\n"
 	"\n"
 	"        if(osgOcean_EnableCrestFoam)\n"
@@ -336,7 +491,7 @@ static const char osgOcean_ocean_surface_frag[] =
 	"            // if alpha is 1.0 then it's a sky pixel\n"
 	"            if(refractColor.a == 1.0 )\n"
 	"            {\n"
-	"                vec4 env_color = texture2DProj( osgOcean_RefractionMap, distortGen(vVertex, N) );\n"
+	"                vec4 env_color = texture2DProjScaled( osgOcean_RefractionMap, distortGen(vVertex, N, osgOcean_RefractionViewProjection * worldObjectMatrix), osgOcean_RefractionUVScale, osgOcean_RefractionUVLimit );\n"
 	"                refractColor.rgb = mix( refractColor.rgb, env_color.rgb, env_color.a );\n"
 	"            }\n"
 	"        }\n"
@@ -20,6 +20,10 @@
 // ------------------------------------------------------------------------------
 
 static const char osgOcean_ocean_surface_vbo_vert[] =
+	"#ifdef OSGOCEAN_VERTEX_TEXTURES\n"
+	"#extension GL_EXT_texture_array : enable\n"
+	"#endif\n"
+	"\n"
 	"uniform mat4 osg_ViewMatrixInverse;\n"
 	"uniform float osg_FrameTime;\n"
 	"\n"
@@ -36,12 +40,38 @@ static const char osgOcean_ocean_surface_vbo_vert[] =
 	"// Used to blend the waves into a sinus curve near the shore\n"
 	"uniform sampler2D osgOcean_Heightmap;\n"
 	"uniform bool osgOcean_EnableHeightmap;\n"
+	"uniform vec2 osgOcean_HeightmapUVScale;\n"
+	"uniform bool osgOcean_EnableWorldHeightmap;\n"
+	"uniform bool osgOcean_EnableRefractionHeightmap;\n"
+	"uniform sampler2D osgOcean_RefractionDepthMap;\n"
+	"uniform vec2 osgOcean_RefractionUVScale;\n"
+	"uniform mat4 osgOcean_RefractionViewProjection;\n"
+	"uniform mat4 osgOcean_RefractionInverseTransformation;\n"
+	"uniform float osgOcean_WorldHeightmapSize;\n"
+	"uniform vec2 osgOcean_WorldHeightmapCentre;\n"
 	"\n"
 	"uniform bool osgOcean_EnableUnderwaterScattering;\n"
 	"uniform float osgOcean_WaterHeight;\n"
 	"uniform vec3 osgOcean_UnderwaterAttenuation;\n"
 	"uniform vec4 osgOcean_UnderwaterDiffuse;\n"
 	"\n"
+	"#ifdef OSGOCEAN_VERTEX_TEXTURES\n"
+	"// One layer per frame: xyz = x,y displacement and height\n"
+	"uniform sampler2DArray osgOcean_DisplacementMap;\n"
+	"uniform sampler2DArray osgOcean_DisplacementNormalMap;\n"
+	"// x: 1/tile resolution, y: half a texel\n"
+	"uniform vec2 osgOcean_DisplacementCoords;\n"
+	"uniform float osgOcean_DisplacementFrame;\n"
+	"#endif\n"
+	"\n"
+	"#ifdef OSGOCEAN_INSTANCED_TILES\n"
+	"// x: grid cells along a tile edge, y: grid spacing (m)\n"
+	"uniform vec2 osgOcean_TileGrid;\n"
+	"// Per instance: tile position, and grid step of the left, right, top and bottom edges\n"
+	"attribute vec4 osgOcean_TileOffset;\n"
+	"attribute vec4 osgOcean_TileStitch;\n"
+	"#endif\n"
+	"\n"
 	"varying vec4 vVertex;\n"
 	"varying vec4 vWorldVertex;\n"
 	"varying vec3 vNormal;\n"
@@ -88,6 +118,51 @@ static const char osgOcean_ocean_surface_vbo_vert[] =
 	"	inScattering = osgOcean_UnderwaterDiffuse.rgb * (1.0-extinction*exp(-depth*vec3(0.001)));\n"
 	"}\n"
 	"\n"
+	"#ifdef OSGOCEAN_INSTANCED_TILES\n"
+	"// Moves edge vertices onto the grid of the coarser neighbouring tile\n"
+	"// so that both tiles share the same edge and no cracks appear.\n"
+	"vec4 stitchVertex( in vec4 vertex )\n"
+	"{\n"
+	"    vec2 cell = vec2(vertex.x, -vertex.y) / osgOcean_TileGrid.y;\n"
+	"    float lastCell = osgOcean_TileGrid.x - 0.5;\n"
+	"\n"
+	"    if( cell.x < 0.5 )\n"
+	"        cell.y = floor( cell.y / osgOcean_TileStitch.x + 0.001 ) * osgOcean_TileStitch.x;\n"
+	"    else if( cell.x > lastCell )\n"
+	"        cell.y = floor( cell.y / osgOcean_TileStitch.y + 0.001 ) * osgOcean_TileStitch.y;\n"
+	"\n"
+	"    if( cell.y < 0.5 )\n"
+	"        cell.x = floor( cell.x / osgOcean_TileStitch.z + 0.001 ) * osgOcean_TileStitch.z;\n"
+	"    else if( cell.y > lastCell )\n"
+	"        cell.x = floor( cell.x / osgOcean_TileStitch.w + 0.001 ) * osgOcean_TileStitch.w;\n"
+	"\n"
+	"    return vec4( cell.x * osgOcean_TileGrid.y, -cell.y * osgOcean_TileGrid.y, vertex.z, vertex.w );\n"
+	"}\n"
+	"#endif\n"
+	"\n"
+	"// Water depth from the cached top-down heightmap, which repeats every \n"
+	"// osgOcean_WorldHeightmapSize metres. Deep water outside the cached area.\n"
+	"float worldHeightmapDepth( vec2 worldCoords )\n"
+	"{\n"
+	"    vec2 offset = abs( worldCoords - osgOcean_WorldHeightmapCentre );\n"
+	"    if( max(offset.x, offset.y) > osgOcean_WorldHeightmapSize * 0.5 )\n"
+	"        return 1.0;\n"
+	"\n"
+	"    return texture2D( osgOcean_Heightmap, worldCoords / osgOcean_WorldHeightmapSize ).x;\n"
+	"}\n"
+	"\n"
+	"// Water depth along the view ray from the refraction pass's depth, used \n"
+	"// in place of a separate height map pass. Scaled as the height map (500m).\n"
+	"float refractionHeightmapDepth( vec4 worldVertex )\n"
+	"{\n"
+	"    vec4 refractionPos = osgOcean_RefractionViewProjection * worldVertex;\n"
+	"    vec2 screenCoords = clamp( refractionPos.xy / refractionPos.w * 0.5 + 0.5, 0.0, 1.0 );\n"
+	"    float depth = texture2D( osgOcean_RefractionDepthMap, screenCoords * osgOcean_RefractionUVScale ).x;\n"
+	"\n"
+	"    vec4 floorVertex = osgOcean_RefractionInverseTransformation * vec4( vec3(screenCoords, depth) * 2.0 - 1.0, 1.0 );\n"
+	"    return clamp( (osgOcean_WaterHeight - floorVertex.z / floorVertex.w) / 500.0, 0.0, 1.0 );\n"
+	"}\n"
+	"\n"
 	"// -------------------------------\n"
 	"//          Main Program\n"
 	"// -------------------------------\n"
@@ -95,8 +170,27 @@ static const char osgOcean_ocean_surface_vbo_vert[] =
 	"void main( void )\n"
 	"{\n"
 	"    // Transform the vertex\n"
+	"#ifdef OSGOCEAN_INSTANCED_TILES\n"
+	"    vec4 inputVertex = stitchVertex( gl_Vertex );\n"
+	"#else\n"
 	"    vec4 inputVertex = gl_Vertex;\n"
+	"#endif\n"
+	"    vec3 inputNormal = gl_Normal;\n"
+	"\n"
+	"#ifdef OSGOCEAN_VERTEX_TEXTURES\n"
+	"    // The grid is flat, displace it with the current frame\n"
+	"    vec3 frameCoords = vec3( vec2(inputVertex.x, -inputVertex.y) * osgOcean_DisplacementCoords.x + osgOcean_DisplacementCoords.y,\n"
+	"                             osgOcean_DisplacementFrame );\n"
+	"\n"
+	"    inputVertex.xyz += texture2DArrayLod( osgOcean_DisplacementMap, frameCoords, 0.0 ).xyz;\n"
+	"    inputNormal = texture2DArrayLod( osgOcean_DisplacementNormalMap, frameCoords, 0.0 ).xyz;\n"
+	"#endif\n"
+	"\n"
+	"#ifdef OSGOCEAN_INSTANCED_TILES\n"
+	"    inputVertex.xyz += osgOcean_TileOffset.xyz;\n"
+	"#else\n"
 	"    inputVertex.xyz += gl_Color.xyz;\n"
+	"#endif\n"
 	"\n"
 	"    gl_Position = gl_ModelViewProjectionMatrix * inputVertex;\n"
 	"\n"
@@ -107,7 +201,15 @@ static const char osgOcean_ocean_surface_vbo_vert[] =
 	"    {\n"
 	"        vec2 screenCoords = gl_Position.xy / gl_Position.w;\n"
 	"        \n"
-	"        height = pow(clamp(1.0 - texture2D(osgOcean_Heightmap, clamp(screenCoords * 0.5 + 0.5, 0.0, 1.0)).x, 0.0, 1.0), 32.0);\n"
+	"        float waterDepth;\n"
+	"        if (osgOcean_EnableWorldHeightmap)\n"
+	"            waterDepth = worldHeightmapDepth( (osg_ViewMatrixInverse * gl_ModelViewMatrix * inputVertex).xy );\n"
+	"        else if (osgOcean_EnableRefractionHeightmap)\n"
+	"            waterDepth = refractionHeightmapDepth( osg_ViewMatrixInverse * gl_ModelViewMatrix * inputVertex );\n"
+	"        else\n"
+	"            waterDepth = texture2D(osgOcean_Heightmap, clamp(screenCoords * 0.5 + 0.5, 0.0, 1.0) * osgOcean_HeightmapUVScale).x;\n"
+	"\n"
+	"        height = pow(clamp(1.0 - waterDepth, 0.0, 1.0), 32.0);\n"
 	"\n"
 	"        inputVertex = vec4(inputVertex.x, \n"
 	"                           inputVertex.y, \n"
@@ -123,7 +225,7 @@ static const char osgOcean_ocean_surface_vbo_vert[] =
 	"    vVertex = inputVertex;\n"
 	"    vLightDir = normalize( vec3( gl_ModelViewMatrixInverse * ( gl_LightSource[osgOcean_LightID].position ) ) );\n"
 	"    vViewerDir = gl_ModelViewMatrixInverse[3].xyz - inputVertex.xyz;\n"
-	"    vNormal = normalize(gl_Normal);\n"
+	"    vNormal = normalize(inputNormal);\n"
 	"\n"
 	"    vec4 waveColorDiff = osgOcean_WaveTop-osgOcean_WaveBot;\n"
 	"\n"
@@ -137,7 +239,7 @@ static const char osgOcean_ocean_surface_vbo_vert[] =
 	"\n"
 	"    // world space\n"
 	"    vWorldVertex = modelMatrix * inputVertex;\n"
-	"    vWorldNormal = modelMatrix3x3 * gl_Normal;\n"
+	"    vWorldNormal = modelMatrix3x3 * inputNormal;\n"
 	"    vWorldViewDir = vWorldVertex.xyz - osgOcean_Eye.xyz;\n"
 	"\n"
 	"    // ------------- Texture Coords ---------------------------------\n"
@@ -37,6 +37,15 @@ static const char osgOcean_ocean_surface_vert[] =
 	"// Used to blend the waves into a sinus curve near the shore\n"
 	"uniform sampler2D osgOcean_Heightmap;\n"
 	"uniform bool osgOcean_EnableHeightmap;\n"
+	"uniform vec2 osgOcean_HeightmapUVScale;\n"
+	"uniform bool osgOcean_EnableWorldHeightmap;\n"
+	"uniform bool osgOcean_EnableRefractionHeightmap;\n"
+	"uniform sampler2D osgOcean_RefractionDepthMap;\n"
+	"uniform vec2 osgOcean_RefractionUVScale;\n"
+	"uniform mat4 osgOcean_RefractionViewProjection;\n"
+	"uniform mat4 osgOcean_RefractionInverseTransformation;\n"
+	"uniform float osgOcean_WorldHeightmapSize;\n"
+	"uniform vec2 osgOcean_WorldHeightmapCentre;\n"
 	"\n"
 	"uniform bool osgOcean_EnableUnderwaterScattering;\n"
 	"uniform float osgOcean_WaterHeight;\n"
@@ -89,6 +98,29 @@ static const char osgOcean_ocean_surface_vert[] =
 	"	inScattering = osgOcean_UnderwaterDiffuse.rgb * (1.0-extinction*exp(-depth*vec3(0.001)));\n"
 	"}\n"
 	"\n"
+	"// Water depth from the cached top-down heightmap, which repeats every \n"
+	"// osgOcean_WorldHeightmapSize metres. Deep water outside the cached area.\n"
+	"float worldHeightmapDepth( vec2 worldCoords )\n"
+	"{\n"
+	"    vec2 offset = abs( worldCoords - osgOcean_WorldHeightmapCentre );\n"
+	"    if( max(offset.x, offset.y) > osgOcean_WorldHeightmapSize * 0.5 )\n"
+	"        return 1.0;\n"
+	"\n"
+	"    return texture2D( osgOcean_Heightmap, worldCoords / osgOcean_WorldHeightmapSize ).x;\n"
+	"}\n"
+	"\n"
+	"// Water depth along the view ray from the refraction pass's depth, used \n"
+	"// in place of a separate height map pass. Scaled as the height map (500m).\n"
+	"float refractionHeightmapDepth( vec4 worldVertex )\n"
+	"{\n"
+	"    vec4 refractionPos = osgOcean_RefractionViewProjection * worldVertex;\n"
+	"    vec2 screenCoords = clamp( refractionPos.xy / refractionPos.w * 0.5 + 0.5, 0.0, 1.0 );\n"
+	"    float depth = texture2D( osgOcean_RefractionDepthMap, screenCoords * osgOcean_RefractionUVScale ).x;\n"
+	"\n"
+	"    vec4 floorVertex = osgOcean_RefractionInverseTransformation * vec4( vec3(screenCoords, depth) * 2.0 - 1.0, 1.0 );\n"
+	"    return clamp( (osgOcean_WaterHeight - floorVertex.z / floorVertex.w) / 500.0, 0.0, 1.0 );\n"
+	"}\n"
+	"\n"
 	"// -------------------------------\n"
 	"//          Main Program\n"
 	"// -------------------------------\n"
@@ -106,7 +138,15 @@ static const char osgOcean_ocean_surface_vert[] =
 	"    {\n"
 	"        vec2 screenCoords = gl_Position.xy / gl_Position.w;\n"
 	"        \n"
-	"        height = pow(clamp(1.0 - texture2D(osgOcean_Heightmap, clamp(screenCoords * 0.5 + 0.5, 0.0, 1.0)).x, 0.0, 1.0), 32.0);\n"
+	"        float waterDepth;\n"
+	"        if (osgOcean_EnableWorldHeightmap)\n"
+	"            waterDepth = worldHeightmapDepth( (osg_ViewMatrixInverse * gl_ModelViewMatrix * inputVertex).xy );\n"
+	"        else if (osgOcean_EnableRefractionHeightmap)\n"
+	"            waterDepth = refractionHeightmapDepth( osg_ViewMatrixInverse * gl_ModelViewMatrix * inputVertex );\n"
+	"        else\n"
+	"            waterDepth = texture2D(osgOcean_Heightmap, clamp(screenCoords * 0.5 + 0.5, 0.0, 1.0) * osgOcean_HeightmapUVScale).x;\n"
+	"\n"
+	"        height = pow(clamp(1.0 - waterDepth, 0.0, 1.0), 32.0);\n"
 	"\n"
 	"        inputVertex = vec4(gl_Vertex.x, \n"
 	"                           gl_Vertex.y, \n"
@@ -0,0 +1,69 @@
+/*
+* This source file is part of the osgOcean library
+* 
+* Copyright (C) 2009 Kim Bale
+* Copyright (C) 2009 The University of Hull, UK
+* 
+* This program is free software; you can redistribute it and/or modify it under
+* the terms of the GNU Lesser General Public License as published by the Free Software
+* Foundation; either version 3 of the License, or (at your option) any later
+* version.
+
+* This program is distributed in the hope that it will be useful, but WITHOUT
+* ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+* FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+* http://www.gnu.org/copyleft/lesser.txt.
+*/
+
+// ------------------------------------------------------------------------------
+// -- THIS FILE HAS BEEN CREATED AS PART OF THE BUILD PROCESS -- DO NOT MODIFY --
+// ------------------------------------------------------------------------------
+
+static const char osgOcean_streak_mrt_frag[] =
+	"#extension GL_ARB_texture_rectangle : enable\n"
+	"\n"
+	"#define NUM_SAMPLES 4\n"
+	"\n"
+	"uniform sampler2DRect osgOcean_Buffer;\n"
+	"uniform float       osgOcean_Attenuation;\n"
+	"\n"
+	"// Both iterations of osgOcean_streak.frag for one direction. The second \n"
+	"// iteration's samples of the first one are evaluated inline instead of \n"
+	"// being read back from an intermediate buffer.\n"
+	"vec3 streak( vec2 direction )\n"
+	"{\n"
+	"	vec2 pxSize = vec2(0.5);\n"
+	"\n"
+	"	float b1 = float(NUM_SAMPLES);\n"
+	"	float b2 = b1 * b1;\n"
+	"\n"
+	"	vec3 cOut = vec3(0.0);\n"
+	"\n"
+	"	for (int s = 0; s < NUM_SAMPLES; s++)\n"
+	"	{\n"
+	"		float sf = float(s);\n"
+	"		float weight = clamp(pow(osgOcean_Attenuation, b2 * sf), 0.0, 1.0);\n"
+	"		vec2 sampleCoord = gl_TexCoord[0].st + (direction * b2 * vec2(sf) * pxSize);\n"
+	"\n"
+	"		vec3 pass1 = vec3(0.0);\n"
+	"\n"
+	"		for (int t = 0; t < NUM_SAMPLES; t++)\n"
+	"		{\n"
+	"			float tf = float(t);\n"
+	"			float weight1 = clamp(pow(osgOcean_Attenuation, b1 * tf), 0.0, 1.0);\n"
+	"			pass1 += weight1 * texture2DRect(osgOcean_Buffer, sampleCoord + (direction * b1 * vec2(tf) * pxSize)).rgb;\n"
+	"		}\n"
+	"\n"
+	"		cOut += weight * clamp(pass1, 0.0, 1.0);\n"
+	"	}\n"
+	"\n"
+	"	return clamp(cOut, 0.0, 1.0);\n"
+	"}\n"
+	"\n"
+	"void main(void)\n"
+	"{\n"
+	"	gl_FragData[0] = vec4(streak(vec2( 0.5, 0.5)), 1.0);\n"
+	"	gl_FragData[1] = vec4(streak(vec2(-0.5,-0.5)), 1.0);\n"
+	"	gl_FragData[2] = vec4(streak(vec2( 0.5,-0.5)), 1.0);\n"
+	"	gl_FragData[3] = vec4(streak(vec2(-0.5, 0.5)), 1.0);\n"
+	"}\n";
@@ -0,0 +1,22 @@
+// osgOcean uniforms
+// -------------------
+uniform float osgOcean_WaterHeight;
+// ------------------
+
+varying vec4 vWorldVertex;
+
+void main(void)
+{
+	// The tile cameras look straight down and their view matrix is a
+	// horizontal translation, so the eye space height is the world height.
+	vWorldVertex = gl_ModelViewMatrix * gl_Vertex;
+	vWorldVertex.xyzw /= vWorldVertex.w;
+
+	gl_Position = gl_ModelViewProjectionMatrix * gl_Vertex;
+
+	// Keep everything inside the depth range, the depth written is the
+	// water depth computed in the fragment shader.
+	gl_Position.z = 0.0;
+
+	return;
+}
@@ -0,0 +1,20 @@
+#extension GL_ARB_texture_rectangle : enable
+
+uniform sampler2DRect osgOcean_KawaseTexture;
+
+// Dual filter downsample. Texture coordinates are in source texels, at the
+// corner of the 2x2 block under the fragment, so each tap is a bilinear 
+// average of four texels.
+void main( void )
+{
+	vec2 st = gl_TexCoord[0].st;
+
+	vec3 color = texture2DRect(osgOcean_KawaseTexture, st).rgb * 4.0;
+
+	color += texture2DRect(osgOcean_KawaseTexture, st + vec2(-1.0, 1.0)).rgb;
+	color += texture2DRect(osgOcean_KawaseTexture, st + vec2( 1.0, 1.0)).rgb;
+	color += texture2DRect(osgOcean_KawaseTexture, st + vec2( 1.0,-1.0)).rgb;
+	color += texture2DRect(osgOcean_KawaseTexture, st + vec2(-1.0,-1.0)).rgb;
+
+	gl_FragColor = vec4(color / 8.0, 1.0);
+}
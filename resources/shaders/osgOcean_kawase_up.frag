@@ -0,0 +1,22 @@
+#extension GL_ARB_texture_rectangle : enable
+
+uniform sampler2DRect osgOcean_KawaseTexture;
+
+// Dual filter upsample. Texture coordinates are in source texels, which 
+// are twice the size of the destination's.
+void main( void )
+{
+	vec2 st = gl_TexCoord[0].st;
+
+	vec3 color = texture2DRect(osgOcean_KawaseTexture, st + vec2(-1.0, 0.0)).rgb;
+	color += texture2DRect(osgOcean_KawaseTexture, st + vec2( 1.0, 0.0)).rgb;
+	color += texture2DRect(osgOcean_KawaseTexture, st + vec2( 0.0, 1.0)).rgb;
+	color += texture2DRect(osgOcean_KawaseTexture, st + vec2( 0.0,-1.0)).rgb;
+
+	color += texture2DRect(osgOcean_KawaseTexture, st + vec2(-0.5, 0.5)).rgb * 2.0;
+	color += texture2DRect(osgOcean_KawaseTexture, st + vec2( 0.5, 0.5)).rgb * 2.0;
+	color += texture2DRect(osgOcean_KawaseTexture, st + vec2( 0.5,-0.5)).rgb * 2.0;
+	color += texture2DRect(osgOcean_KawaseTexture, st + vec2(-0.5,-0.5)).rgb * 2.0;
+
+	gl_FragColor = vec4(color / 12.0, 1.0);
+}
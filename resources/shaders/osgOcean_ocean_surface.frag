@@ -1,4 +1,5 @@
 uniform bool osgOcean_EnableReflections;
+uniform bool osgOcean_EnableScreenSpaceReflections;
 uniform bool osgOcean_EnableRefractions;
 uniform bool osgOcean_EnableHeightmap;
 uniform bool osgOcean_EnableCrestFoam;
@@ -20,6 +21,8 @@ uniform sampler2D   osgOcean_RefractionDepthMap;
 uniform sampler2D   osgOcean_FoamMap;
 uniform sampler2D   osgOcean_NoiseMap;
 uniform sampler2D   osgOcean_Heightmap;
+uniform sampler2D   osgOcean_SceneColorMap;
+uniform sampler2D   osgOcean_SceneDepthMap;
 
 uniform float osgOcean_UnderwaterFogDensity;
 uniform float osgOcean_AboveWaterFogDensity;
@@ -32,8 +35,26 @@ uniform mat4 osg_ViewMatrixInverse;
 
 uniform mat4 osgOcean_RefractionInverseTransformation;
 
+// View and projection the RTT textures were last rendered with
+uniform mat4 osgOcean_ReflectionViewProjection;
+uniform mat4 osgOcean_RefractionViewProjection;
+
 uniform vec2 osgOcean_ViewportDimensions;
 
+// Fraction of each RTT texture covered by its pass viewport
+uniform vec2 osgOcean_ReflectionUVScale;
+uniform vec2 osgOcean_RefractionUVScale;
+uniform vec2 osgOcean_HeightmapUVScale;
+
+// Largest coordinate inside each pass viewport, half a texel in from its edge
+uniform vec2 osgOcean_ReflectionUVLimit;
+uniform vec2 osgOcean_RefractionUVLimit;
+uniform vec2 osgOcean_HeightmapUVLimit;
+uniform bool osgOcean_EnableWorldHeightmap;
+uniform bool osgOcean_EnableRefractionHeightmap;
+uniform float osgOcean_WorldHeightmapSize;
+uniform vec2 osgOcean_WorldHeightmapCentre;
+
 uniform float osgOcean_WaterHeight;
 uniform float osgOcean_FoamCapBottom;
 uniform float osgOcean_FoamCapTop;
@@ -58,7 +79,7 @@ const float shininess = 2000.0;
 
 const vec4 BlueEnvColor = vec4(0.75, 0.85, 1.0, 1.0);
 
-vec4 distortGen( vec4 v, vec3 N )
+vec4 distortGen( vec4 v, vec3 N, mat4 modelViewProjection )
 {
     // transposed
     const mat4 mr =
@@ -67,7 +88,7 @@ vec4 distortGen( vec4 v, vec3 N )
               0.0, 0.0, 0.5, 0.0,
               0.5, 0.5, 0.5, 1.0 );
 
-    mat4 texgen_matrix = mr * gl_ProjectionMatrix * gl_ModelViewMatrix;
+    mat4 texgen_matrix = mr * modelViewProjection;
 
     //float disp = 8.0;
     float disp = 4.0;
@@ -81,6 +102,84 @@ vec4 distortGen( vec4 v, vec3 N )
     return texgen_matrix * tempPos;
 }
 
+vec4 distortGen( vec4 v, vec3 N )
+{
+    return distortGen( v, N, gl_ProjectionMatrix * gl_ModelViewMatrix );
+}
+
+// texture2DProj() restricted to the part of the texture written by a
+// dynamically scaled RTT pass. The limit keeps linear filtering from 
+// blending in the stale texels beyond the pass viewport.
+vec4 texture2DProjScaled( sampler2D map, vec4 coord, vec2 uvScale, vec2 uvLimit )
+{
+    return texture2D( map, min( clamp(coord.xy / coord.w, 0.0, 1.0) * uvScale, uvLimit ) );
+}
+
+// Marches the reflected ray in eye space against the copied scene depth.
+// Returns the scene colour where the ray hits, with alpha fading out towards
+// the screen edges and the end of the ray. Alpha is 0 on a miss.
+vec4 screenSpaceReflection( vec3 eyePos, vec3 eyeNormal )
+{
+    const int   steps       = 24;
+    const int   refinements = 4;
+    const float maxDistance = 300.0;
+
+    vec3 R = normalize( reflect( normalize(eyePos), eyeNormal ) );
+
+    // Rays heading back towards the eye leave the depth buffer at once.
+    if( R.z > 0.0 )
+        return vec4(0.0);
+
+    // Start with short steps and lengthen them so nearby reflections are accurate.
+    float stepLength = maxDistance / float(steps * steps);
+    vec3 previous = eyePos;
+
+    for( int i = 1; i <= steps; ++i )
+    {
+        vec3 current = eyePos + R * stepLength * float(i * i);
+
+        vec4 clip = gl_ProjectionMatrix * vec4(current, 1.0);
+        vec2 uv = clip.xy / clip.w * 0.5 + 0.5;
+
+        if( uv.x < 0.0 || uv.x > 1.0 || uv.y < 0.0 || uv.y > 1.0 )
+            break;
+
+        float depth = texture2D( osgOcean_SceneDepthMap, uv ).x;
+        vec4 scene = gl_ProjectionMatrixInverse * vec4( vec3(uv, depth) * 2.0 - 1.0, 1.0 );
+
+        if( depth < 1.0 && scene.z / scene.w > current.z )
+        {
+            // Binary search between the last two steps for the crossing.
+            for( int j = 0; j < refinements; ++j )
+            {
+                vec3 middle = (previous + current) * 0.5;
+                clip = gl_ProjectionMatrix * vec4(middle, 1.0);
+                uv = clip.xy / clip.w * 0.5 + 0.5;
+                depth = texture2D( osgOcean_SceneDepthMap, uv ).x;
+                scene = gl_ProjectionMatrixInverse * vec4( vec3(uv, depth) * 2.0 - 1.0, 1.0 );
+
+                if( scene.z / scene.w > middle.z )
+                    current = middle;
+                else
+                    previous = middle;
+            }
+
+            // Reject hits behind thin objects.
+            if( scene.z / scene.w - current.z > length(current - previous) * 4.0 + 1.0 )
+                return vec4(0.0);
+
+            vec2 edge = min( uv, 1.0 - uv );
+            float fade = clamp( min(edge.x, edge.y) * 10.0, 0.0, 1.0 ) * (1.0 - float(i) / float(steps));
+
+            return vec4( texture2D( osgOcean_SceneColorMap, uv ).rgb, fade );
+        }
+
+        previous = current;
+    }
+
+    return vec4(0.0);
+}
+
 vec3 reorientate( vec3 v )
 {
     float y = v.y;
@@ -155,6 +254,29 @@ float computeFogFactor( float density, float fogCoord )
     return exp2(density * fogCoord * fogCoord );
 }
 
+// Water depth from the cached top-down heightmap, which repeats every 
+// osgOcean_WorldHeightmapSize metres. Deep water outside the cached area.
+float worldHeightmapDepth( vec2 worldCoords )
+{
+    vec2 offset = abs( worldCoords - osgOcean_WorldHeightmapCentre );
+    if( max(offset.x, offset.y) > osgOcean_WorldHeightmapSize * 0.5 )
+        return 1.0;
+
+    return texture2D( osgOcean_Heightmap, worldCoords / osgOcean_WorldHeightmapSize ).x;
+}
+
+// Water depth along the view ray from the refraction pass's depth, used 
+// in place of a separate height map pass. Scaled as the height map (500m).
+float refractionHeightmapDepth( vec4 worldVertex )
+{
+    vec4 refractionPos = osgOcean_RefractionViewProjection * worldVertex;
+    vec2 screenCoords = clamp( refractionPos.xy / refractionPos.w * 0.5 + 0.5, 0.0, 1.0 );
+    float depth = texture2D( osgOcean_RefractionDepthMap, screenCoords * osgOcean_RefractionUVScale ).x;
+
+    vec4 floorVertex = osgOcean_RefractionInverseTransformation * vec4( vec3(screenCoords, depth) * 2.0 - 1.0, 1.0 );
+    return clamp( (osgOcean_WaterHeight - floorVertex.z / floorVertex.w) / 500.0, 0.0, 1.0 );
+}
+
 // -------------------------------
 //          Main Program
 // -------------------------------
@@ -190,8 +312,24 @@ void main( void )
 
         vec4 distortedVertex = distortGen(vVertex, N);
 
+        // Reflections and refractions may have been rendered in an earlier
+        // frame, project through the view they were rendered with.
+        vec4 reflectionVertex = distortGen(vVertex, N, osgOcean_ReflectionViewProjection * worldObjectMatrix);
+        vec4 refractionVertex = distortGen(vVertex, N, osgOcean_RefractionViewProjection * worldObjectMatrix);
+        vec4 refractionPos    = distortGen(vVertex, vec3(0.0), osgOcean_RefractionViewProjection * worldObjectMatrix);
+
+        // A framebuffer copy also holds the objects in front of the water.
+        // Where the distorted coordinate lands on one, refract nothing.
+        vec2 refractionCoords = clamp( refractionVertex.xy / refractionVertex.w, 0.0, 1.0 );
+        float refractionDepth = texture2DProjScaled(osgOcean_RefractionDepthMap, refractionVertex, osgOcean_RefractionUVScale, osgOcean_RefractionUVLimit).x;
+        vec4 sampleWorld = osgOcean_RefractionInverseTransformation * vec4( vec3(refractionCoords, refractionDepth) * 2.0 - 1.0, 1.0 );
+        vec3 eyePosition = osg_ViewMatrixInverse[3].xyz;
+
+        if( distance(eyePosition, sampleWorld.xyz / sampleWorld.w) < distance(eyePosition, vWorldVertex.xyz) )
+            refractionVertex = refractionPos;
+
         // Calculate the position in world space of the pixel on the ocean floor
-        vec4 refraction_ndc = vec4(gl_FragCoord.xy / osgOcean_ViewportDimensions, texture2DProj(osgOcean_RefractionDepthMap, distortedVertex).x, 1.0);
+        vec4 refraction_ndc = vec4(refractionPos.xy / refractionPos.w, texture2DProjScaled(osgOcean_RefractionDepthMap, refractionVertex, osgOcean_RefractionUVScale, osgOcean_RefractionUVLimit).x, 1.0);
         vec4 refraction_screen = refraction_ndc * 2.0 - 1.0;
         vec4 refraction_world = osgOcean_RefractionInverseTransformation * refraction_screen;
         refraction_world = refraction_world / refraction_world.w;
@@ -205,19 +343,31 @@ void main( void )
 
         if(osgOcean_EnableReflections)
         {
-            env_color = texture2DProj( osgOcean_ReflectionMap, distortedVertex );
+            env_color = texture2DProjScaled( osgOcean_ReflectionMap, reflectionVertex, osgOcean_ReflectionUVScale, osgOcean_ReflectionUVLimit );
+        }
+        else if(osgOcean_EnableScreenSpaceReflections)
+        {
+            vec3 reflected = reflect( normalize(vWorldViewDir), normalize(vWorldNormal + noiseNormal) );
+            reflected.z = abs( reflected.z );
+            env_color = textureCube( osgOcean_EnvironmentMap, reorientate( reflected ) );
         }
         else
         {
             env_color = BlueEnvColor * gl_LightSource[osgOcean_LightID].diffuse * vec4(vec3(1.25), 1.0);
         }
 
+        if(osgOcean_EnableScreenSpaceReflections)
+        {
+            vec4 ssr_color = screenSpaceReflection( vec3(gl_ModelViewMatrix * vVertex), normalize(gl_NormalMatrix * N) );
+            env_color.rgb = mix( env_color.rgb, ssr_color.rgb, ssr_color.a );
+        }
+
         // Determine refraction color
         vec4 refraction_color = vec4( gl_Color.rgb, 1.0 );
         // Only use refraction for under the ocean surface.
         if(osgOcean_EnableRefractions)
         {
-            vec4 refractionmap_color = texture2DProj(osgOcean_RefractionMap, distortedVertex );
+            vec4 refractionmap_color = texture2DProjScaled(osgOcean_RefractionMap, refractionVertex, osgOcean_RefractionUVScale, osgOcean_RefractionUVLimit );
 
             if(osgOcean_EnableUnderwaterScattering)
             {
@@ -249,7 +399,12 @@ void main( void )
         if (osgOcean_EnableHeightmap)
         {
             // The vertical distance between the ocean surface and ocean floor, this uses the projected heightmap
-            waterHeight = (texture2DProj(osgOcean_Heightmap, distortedVertex).x) * 500.0;
+            if (osgOcean_EnableWorldHeightmap)
+                waterHeight = worldHeightmapDepth(vWorldVertex.xy) * 500.0;
+            else if (osgOcean_EnableRefractionHeightmap)
+                waterHeight = refractionHeightmapDepth(vWorldVertex) * 500.0;
+            else
+                waterHeight = (texture2DProjScaled(osgOcean_Heightmap, distortedVertex, osgOcean_HeightmapUVScale, osgOcean_HeightmapUVLimit).x) * 500.0;
         }
 
         if(osgOcean_EnableCrestFoam)
@@ -314,7 +469,7 @@ void main( void )
             // if alpha is 1.0 then it's a sky pixel
             if(refractColor.a == 1.0 )
             {
-                vec4 env_color = texture2DProj( osgOcean_RefractionMap, distortGen(vVertex, N) );
+                vec4 env_color = texture2DProjScaled( osgOcean_RefractionMap, distortGen(vVertex, N, osgOcean_RefractionViewProjection * worldObjectMatrix), osgOcean_RefractionUVScale, osgOcean_RefractionUVLimit );
                 refractColor.rgb = mix( refractColor.rgb, env_color.rgb, env_color.a );
             }
         }
@@ -15,6 +15,15 @@ uniform float osgOcean_FrameTime;
 // Used to blend the waves into a sinus curve near the shore
 uniform sampler2D osgOcean_Heightmap;
 uniform bool osgOcean_EnableHeightmap;
+uniform vec2 osgOcean_HeightmapUVScale;
+uniform bool osgOcean_EnableWorldHeightmap;
+uniform bool osgOcean_EnableRefractionHeightmap;
+uniform sampler2D osgOcean_RefractionDepthMap;
+uniform vec2 osgOcean_RefractionUVScale;
+uniform mat4 osgOcean_RefractionViewProjection;
+uniform mat4 osgOcean_RefractionInverseTransformation;
+uniform float osgOcean_WorldHeightmapSize;
+uniform vec2 osgOcean_WorldHeightmapCentre;
 
 uniform bool osgOcean_EnableUnderwaterScattering;
 uniform float osgOcean_WaterHeight;
@@ -67,6 +76,29 @@ void computeScattering( in vec3 eye, in vec3 worldVertex, out vec3 extinction, o
 	inScattering = osgOcean_UnderwaterDiffuse.rgb * (1.0-extinction*exp(-depth*vec3(0.001)));
 }
 
+// Water depth from the cached top-down heightmap, which repeats every 
+// osgOcean_WorldHeightmapSize metres. Deep water outside the cached area.
+float worldHeightmapDepth( vec2 worldCoords )
+{
+    vec2 offset = abs( worldCoords - osgOcean_WorldHeightmapCentre );
+    if( max(offset.x, offset.y) > osgOcean_WorldHeightmapSize * 0.5 )
+        return 1.0;
+
+    return texture2D( osgOcean_Heightmap, worldCoords / osgOcean_WorldHeightmapSize ).x;
+}
+
+// Water depth along the view ray from the refraction pass's depth, used 
+// in place of a separate height map pass. Scaled as the height map (500m).
+float refractionHeightmapDepth( vec4 worldVertex )
+{
+    vec4 refractionPos = osgOcean_RefractionViewProjection * worldVertex;
+    vec2 screenCoords = clamp( refractionPos.xy / refractionPos.w * 0.5 + 0.5, 0.0, 1.0 );
+    float depth = texture2D( osgOcean_RefractionDepthMap, screenCoords * osgOcean_RefractionUVScale ).x;
+
+    vec4 floorVertex = osgOcean_RefractionInverseTransformation * vec4( vec3(screenCoords, depth) * 2.0 - 1.0, 1.0 );
+    return clamp( (osgOcean_WaterHeight - floorVertex.z / floorVertex.w) / 500.0, 0.0, 1.0 );
+}
+
 // -------------------------------
 //          Main Program
 // -------------------------------
@@ -84,7 +116,15 @@ void main( void )
     {
         vec2 screenCoords = gl_Position.xy / gl_Position.w;
         
-        height = pow(clamp(1.0 - texture2D(osgOcean_Heightmap, clamp(screenCoords * 0.5 + 0.5, 0.0, 1.0)).x, 0.0, 1.0), 32.0);
+        float waterDepth;
+        if (osgOcean_EnableWorldHeightmap)
+            waterDepth = worldHeightmapDepth( (osg_ViewMatrixInverse * gl_ModelViewMatrix * inputVertex).xy );
+        else if (osgOcean_EnableRefractionHeightmap)
+            waterDepth = refractionHeightmapDepth( osg_ViewMatrixInverse * gl_ModelViewMatrix * inputVertex );
+        else
+            waterDepth = texture2D(osgOcean_Heightmap, clamp(screenCoords * 0.5 + 0.5, 0.0, 1.0) * osgOcean_HeightmapUVScale).x;
+
+        height = pow(clamp(1.0 - waterDepth, 0.0, 1.0), 32.0);
 
         inputVertex = vec4(gl_Vertex.x, 
                            gl_Vertex.y, 
@@ -0,0 +1,224 @@
+#extension GL_EXT_texture_array : enable
+
+uniform mat4 osg_ViewMatrixInverse;
+uniform float osg_FrameTime;
+
+uniform vec3 osgOcean_Eye;
+
+uniform vec3 osgOcean_NoiseCoords0;
+uniform vec3 osgOcean_NoiseCoords1;
+
+uniform vec4 osgOcean_WaveTop;
+uniform vec4 osgOcean_WaveBot;
+
+uniform float osgOcean_FoamScale;
+
+// Used to blend the waves into a sinus curve near the shore
+uniform sampler2D osgOcean_Heightmap;
+uniform bool osgOcean_EnableHeightmap;
+uniform vec2 osgOcean_HeightmapUVScale;
+uniform bool osgOcean_EnableWorldHeightmap;
+uniform bool osgOcean_EnableRefractionHeightmap;
+uniform sampler2D osgOcean_RefractionDepthMap;
+uniform vec2 osgOcean_RefractionUVScale;
+uniform mat4 osgOcean_RefractionViewProjection;
+uniform mat4 osgOcean_RefractionInverseTransformation;
+uniform float osgOcean_WorldHeightmapSize;
+uniform vec2 osgOcean_WorldHeightmapCentre;
+
+uniform bool osgOcean_EnableUnderwaterScattering;
+uniform float osgOcean_WaterHeight;
+uniform vec3 osgOcean_UnderwaterAttenuation;
+uniform vec4 osgOcean_UnderwaterDiffuse;
+
+// One layer per frame: xyz = x,y displacement and height
+uniform sampler2DArray osgOcean_DisplacementMap;
+uniform sampler2DArray osgOcean_DisplacementNormalMap;
+// x: 1/tile resolution, y: half a texel
+uniform vec2 osgOcean_DisplacementCoords;
+uniform float osgOcean_DisplacementFrame;
+
+// Local position of the heightfield tile origin
+uniform vec2 osgOcean_TileOrigin;
+// x: patch cells along a node edge, y: LOD range of level 0, z: fraction of a
+// range at which morphing starts, w: coarsest level
+uniform vec4 osgOcean_CDLODParams;
+// Eye the nodes were selected from
+uniform vec3 osgOcean_CDLODEye;
+
+// Per instance: node corner x,y, node size and level
+attribute vec4 osgOcean_NodeParams;
+
+varying vec4 vVertex;
+varying vec4 vWorldVertex;
+varying vec3 vNormal;
+varying vec3 vViewerDir;
+varying vec3 vLightDir;
+
+varying vec3 vExtinction;
+varying vec3 vInScattering;
+
+varying vec3 vWorldViewDir;
+varying vec3 vWorldNormal;
+
+varying float height;
+
+mat3 get3x3Matrix( mat4 m )
+{
+    mat3 result;
+
+    result[0][0] = m[0][0];
+    result[0][1] = m[0][1];
+    result[0][2] = m[0][2];
+
+    result[1][0] = m[1][0];
+    result[1][1] = m[1][1];
+    result[1][2] = m[1][2];
+
+    result[2][0] = m[2][0];
+    result[2][1] = m[2][1];
+    result[2][2] = m[2][2];
+
+    return result;
+}
+
+void computeScattering( in vec3 eye, in vec3 worldVertex, out vec3 extinction, out vec3 inScattering )
+{
+	float viewDist = length(eye-worldVertex);
+	
+	float depth = max(osgOcean_WaterHeight-worldVertex.z, 0.0);
+	
+	extinction = exp(-osgOcean_UnderwaterAttenuation*viewDist*2.0);
+
+	// Need to compute accurate kd constant.
+	// const vec3 kd = vec3(0.001, 0.001, 0.001);
+	inScattering = osgOcean_UnderwaterDiffuse.rgb * (1.0-extinction*exp(-depth*vec3(0.001)));
+}
+
+// Places a patch vertex in the node, sliding odd vertices onto the grid of
+// the next coarser level as the vertex nears the end of its level's range.
+// A node's edge is fully morphed by the time it meets a coarser neighbour,
+// so no cracks appear and levels blend without popping.
+vec2 morphVertex( in vec2 gridPos )
+{
+    float cellSize = osgOcean_NodeParams.z / osgOcean_CDLODParams.x;
+    vec2 flatPos = osgOcean_NodeParams.xy + gridPos * cellSize;
+
+    if( osgOcean_NodeParams.w >= osgOcean_CDLODParams.w )
+        return flatPos;
+
+    float range = osgOcean_CDLODParams.y * exp2( osgOcean_NodeParams.w );
+    float morphStart = range * osgOcean_CDLODParams.z;
+    float dist = distance( vec3( flatPos, 0.0 ), osgOcean_CDLODEye );
+    float morph = clamp( (dist - morphStart) / (range - morphStart), 0.0, 1.0 );
+
+    return flatPos - mod( gridPos, 2.0 ) * cellSize * morph;
+}
+
+// Water depth from the cached top-down heightmap, which repeats every 
+// osgOcean_WorldHeightmapSize metres. Deep water outside the cached area.
+float worldHeightmapDepth( vec2 worldCoords )
+{
+    vec2 offset = abs( worldCoords - osgOcean_WorldHeightmapCentre );
+    if( max(offset.x, offset.y) > osgOcean_WorldHeightmapSize * 0.5 )
+        return 1.0;
+
+    return texture2D( osgOcean_Heightmap, worldCoords / osgOcean_WorldHeightmapSize ).x;
+}
+
+// Water depth along the view ray from the refraction pass's depth, used 
+// in place of a separate height map pass. Scaled as the height map (500m).
+float refractionHeightmapDepth( vec4 worldVertex )
+{
+    vec4 refractionPos = osgOcean_RefractionViewProjection * worldVertex;
+    vec2 screenCoords = clamp( refractionPos.xy / refractionPos.w * 0.5 + 0.5, 0.0, 1.0 );
+    float depth = texture2D( osgOcean_RefractionDepthMap, screenCoords * osgOcean_RefractionUVScale ).x;
+
+    vec4 floorVertex = osgOcean_RefractionInverseTransformation * vec4( vec3(screenCoords, depth) * 2.0 - 1.0, 1.0 );
+    return clamp( (osgOcean_WaterHeight - floorVertex.z / floorVertex.w) / 500.0, 0.0, 1.0 );
+}
+
+// -------------------------------
+//          Main Program
+// -------------------------------
+
+void main( void )
+{
+    // Place the patch vertex in its node on the water plane
+    vec4 inputVertex = vec4( morphVertex( gl_Vertex.xy ), 0.0, 1.0 );
+
+    // Then displace it with the current frame of the periodic heightfield
+    vec3 frameCoords = vec3( vec2( inputVertex.x - osgOcean_TileOrigin.x, osgOcean_TileOrigin.y - inputVertex.y ) 
+                             * osgOcean_DisplacementCoords.x + osgOcean_DisplacementCoords.y,
+                             osgOcean_DisplacementFrame );
+
+    inputVertex.xyz += texture2DArrayLod( osgOcean_DisplacementMap, frameCoords, 0.0 ).xyz;
+    vec3 inputNormal = texture2DArrayLod( osgOcean_DisplacementNormalMap, frameCoords, 0.0 ).xyz;
+
+    gl_Position = gl_ModelViewProjectionMatrix * inputVertex;
+
+    // Blend the wave into a sinus curve near the shore
+    // note that this requires a vertex shader texture lookup
+    // vertex has to be transformed a second time with the new z-value
+    if (osgOcean_EnableHeightmap)
+    {
+        vec2 screenCoords = gl_Position.xy / gl_Position.w;
+        
+        float waterDepth;
+        if (osgOcean_EnableWorldHeightmap)
+            waterDepth = worldHeightmapDepth( (osg_ViewMatrixInverse * gl_ModelViewMatrix * inputVertex).xy );
+        else if (osgOcean_EnableRefractionHeightmap)
+            waterDepth = refractionHeightmapDepth( osg_ViewMatrixInverse * gl_ModelViewMatrix * inputVertex );
+        else
+            waterDepth = texture2D(osgOcean_Heightmap, clamp(screenCoords * 0.5 + 0.5, 0.0, 1.0) * osgOcean_HeightmapUVScale).x;
+
+        height = pow(clamp(1.0 - waterDepth, 0.0, 1.0), 32.0);
+
+        inputVertex = vec4(inputVertex.x, 
+                           inputVertex.y, 
+                           mix(inputVertex.z, sin(osg_FrameTime), height),
+                           inputVertex.w);
+
+        gl_Position = gl_ModelViewProjectionMatrix * inputVertex;
+    }
+
+    // -----------------------------------------------------------
+
+    // In object space
+    vVertex = inputVertex;
+    vLightDir = normalize( vec3( gl_ModelViewMatrixInverse * ( gl_LightSource[osgOcean_LightID].position ) ) );
+    vViewerDir = gl_ModelViewMatrixInverse[3].xyz - inputVertex.xyz;
+    vNormal = normalize(inputNormal);
+
+    vec4 waveColorDiff = osgOcean_WaveTop-osgOcean_WaveBot;
+
+    gl_FrontColor = waveColorDiff *
+        clamp((inputVertex.z + osgOcean_Eye.z) * 0.1111111 + vNormal.z - 0.4666667, 0.0, 1.0) + osgOcean_WaveBot;
+
+    // -------------------------------------------------------------
+
+    mat4 modelMatrix = osg_ViewMatrixInverse * gl_ModelViewMatrix;
+    mat3 modelMatrix3x3 = get3x3Matrix( modelMatrix );
+
+    // world space
+    vWorldVertex = modelMatrix * inputVertex;
+    vWorldNormal = modelMatrix3x3 * inputNormal;
+    vWorldViewDir = vWorldVertex.xyz - osgOcean_Eye.xyz;
+
+    // ------------- Texture Coords ---------------------------------
+
+    // Normal Map Coords
+    gl_TexCoord[0].xy = ( inputVertex.xy * osgOcean_NoiseCoords0.z + osgOcean_NoiseCoords0.xy );
+    gl_TexCoord[0].zw = ( inputVertex.xy * osgOcean_NoiseCoords1.z + osgOcean_NoiseCoords1.xy );
+    gl_TexCoord[0].y = -gl_TexCoord[0].y;
+    gl_TexCoord[0].w = -gl_TexCoord[0].w;
+
+    // Foam coords
+    gl_TexCoord[1].st = inputVertex.xy * osgOcean_FoamScale;
+
+    // Fog coords
+    gl_FogFragCoord = gl_Position.z;
+
+    if (osgOcean_EnableUnderwaterScattering)
+        computeScattering( osgOcean_Eye, vWorldVertex.xyz, vExtinction, vInScattering);
+}
\ No newline at end of file
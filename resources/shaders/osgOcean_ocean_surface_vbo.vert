@@ -1,3 +1,7 @@
+#ifdef OSGOCEAN_VERTEX_TEXTURES
+#extension GL_EXT_texture_array : enable
+#endif
+
 uniform mat4 osg_ViewMatrixInverse;
 uniform float osg_FrameTime;
 
@@ -14,12 +18,38 @@ uniform float osgOcean_FoamScale;
 // Used to blend the waves into a sinus curve near the shore
 uniform sampler2D osgOcean_Heightmap;
 uniform bool osgOcean_EnableHeightmap;
+uniform vec2 osgOcean_HeightmapUVScale;
+uniform bool osgOcean_EnableWorldHeightmap;
+uniform bool osgOcean_EnableRefractionHeightmap;
+uniform sampler2D osgOcean_RefractionDepthMap;
+uniform vec2 osgOcean_RefractionUVScale;
+uniform mat4 osgOcean_RefractionViewProjection;
+uniform mat4 osgOcean_RefractionInverseTransformation;
+uniform float osgOcean_WorldHeightmapSize;
+uniform vec2 osgOcean_WorldHeightmapCentre;
 
 uniform bool osgOcean_EnableUnderwaterScattering;
 uniform float osgOcean_WaterHeight;
 uniform vec3 osgOcean_UnderwaterAttenuation;
 uniform vec4 osgOcean_UnderwaterDiffuse;
 
+#ifdef OSGOCEAN_VERTEX_TEXTURES
+// One layer per frame: xyz = x,y displacement and height
+uniform sampler2DArray osgOcean_DisplacementMap;
+uniform sampler2DArray osgOcean_DisplacementNormalMap;
+// x: 1/tile resolution, y: half a texel
+uniform vec2 osgOcean_DisplacementCoords;
+uniform float osgOcean_DisplacementFrame;
+#endif
+
+#ifdef OSGOCEAN_INSTANCED_TILES
+// x: grid cells along a tile edge, y: grid spacing (m)
+uniform vec2 osgOcean_TileGrid;
+// Per instance: tile position, and grid step of the left, right, top and bottom edges
+attribute vec4 osgOcean_TileOffset;
+attribute vec4 osgOcean_TileStitch;
+#endif
+
 varying vec4 vVertex;
 varying vec4 vWorldVertex;
 varying vec3 vNormal;
@@ -66,6 +96,51 @@ void computeScattering( in vec3 eye, in vec3 worldVertex, out vec3 extinction, o
 	inScattering = osgOcean_UnderwaterDiffuse.rgb * (1.0-extinction*exp(-depth*vec3(0.001)));
 }
 
+#ifdef OSGOCEAN_INSTANCED_TILES
+// Moves edge vertices onto the grid of the coarser neighbouring tile
+// so that both tiles share the same edge and no cracks appear.
+vec4 stitchVertex( in vec4 vertex )
+{
+    vec2 cell = vec2(vertex.x, -vertex.y) / osgOcean_TileGrid.y;
+    float lastCell = osgOcean_TileGrid.x - 0.5;
+
+    if( cell.x < 0.5 )
+        cell.y = floor( cell.y / osgOcean_TileStitch.x + 0.001 ) * osgOcean_TileStitch.x;
+    else if( cell.x > lastCell )
+        cell.y = floor( cell.y / osgOcean_TileStitch.y + 0.001 ) * osgOcean_TileStitch.y;
+
+    if( cell.y < 0.5 )
+        cell.x = floor( cell.x / osgOcean_TileStitch.z + 0.001 ) * osgOcean_TileStitch.z;
+    else if( cell.y > lastCell )
+        cell.x = floor( cell.x / osgOcean_TileStitch.w + 0.001 ) * osgOcean_TileStitch.w;
+
+    return vec4( cell.x * osgOcean_TileGrid.y, -cell.y * osgOcean_TileGrid.y, vertex.z, vertex.w );
+}
+#endif
+
+// Water depth from the cached top-down heightmap, which repeats every 
+// osgOcean_WorldHeightmapSize metres. Deep water outside the cached area.
+float worldHeightmapDepth( vec2 worldCoords )
+{
+    vec2 offset = abs( worldCoords - osgOcean_WorldHeightmapCentre );
+    if( max(offset.x, offset.y) > osgOcean_WorldHeightmapSize * 0.5 )
+        return 1.0;
+
+    return texture2D( osgOcean_Heightmap, worldCoords / osgOcean_WorldHeightmapSize ).x;
+}
+
+// Water depth along the view ray from the refraction pass's depth, used 
+// in place of a separate height map pass. Scaled as the height map (500m).
+float refractionHeightmapDepth( vec4 worldVertex )
+{
+    vec4 refractionPos = osgOcean_RefractionViewProjection * worldVertex;
+    vec2 screenCoords = clamp( refractionPos.xy / refractionPos.w * 0.5 + 0.5, 0.0, 1.0 );
+    float depth = texture2D( osgOcean_RefractionDepthMap, screenCoords * osgOcean_RefractionUVScale ).x;
+
+    vec4 floorVertex = osgOcean_RefractionInverseTransformation * vec4( vec3(screenCoords, depth) * 2.0 - 1.0, 1.0 );
+    return clamp( (osgOcean_WaterHeight - floorVertex.z / floorVertex.w) / 500.0, 0.0, 1.0 );
+}
+
 // -------------------------------
 //          Main Program
 // -------------------------------
@@ -73,8 +148,27 @@ void computeScattering( in vec3 eye, in vec3 worldVertex, out vec3 extinction, o
 void main( void )
 {
     // Transform the vertex
+#ifdef OSGOCEAN_INSTANCED_TILES
+    vec4 inputVertex = stitchVertex( gl_Vertex );
+#else
     vec4 inputVertex = gl_Vertex;
+#endif
+    vec3 inputNormal = gl_Normal;
+
+#ifdef OSGOCEAN_VERTEX_TEXTURES
+    // The grid is flat, displace it with the current frame
+    vec3 frameCoords = vec3( vec2(inputVertex.x, -inputVertex.y) * osgOcean_DisplacementCoords.x + osgOcean_DisplacementCoords.y,
+                             osgOcean_DisplacementFrame );
+
+    inputVertex.xyz += texture2DArrayLod( osgOcean_DisplacementMap, frameCoords, 0.0 ).xyz;
+    inputNormal = texture2DArrayLod( osgOcean_DisplacementNormalMap, frameCoords, 0.0 ).xyz;
+#endif
+
+#ifdef OSGOCEAN_INSTANCED_TILES
+    inputVertex.xyz += osgOcean_TileOffset.xyz;
+#else
     inputVertex.xyz += gl_Color.xyz;
+#endif
 
     gl_Position = gl_ModelViewProjectionMatrix * inputVertex;
 
@@ -85,7 +179,15 @@ void main( void )
     {
         vec2 screenCoords = gl_Position.xy / gl_Position.w;
         
-        height = pow(clamp(1.0 - texture2D(osgOcean_Heightmap, clamp(screenCoords * 0.5 + 0.5, 0.0, 1.0)).x, 0.0, 1.0), 32.0);
+        float waterDepth;
+        if (osgOcean_EnableWorldHeightmap)
+            waterDepth = worldHeightmapDepth( (osg_ViewMatrixInverse * gl_ModelViewMatrix * inputVertex).xy );
+        else if (osgOcean_EnableRefractionHeightmap)
+            waterDepth = refractionHeightmapDepth( osg_ViewMatrixInverse * gl_ModelViewMatrix * inputVertex );
+        else
+            waterDepth = texture2D(osgOcean_Heightmap, clamp(screenCoords * 0.5 + 0.5, 0.0, 1.0) * osgOcean_HeightmapUVScale).x;
+
+        height = pow(clamp(1.0 - waterDepth, 0.0, 1.0), 32.0);
 
         inputVertex = vec4(inputVertex.x, 
                            inputVertex.y, 
@@ -101,7 +203,7 @@ void main( void )
     vVertex = inputVertex;
     vLightDir = normalize( vec3( gl_ModelViewMatrixInverse * ( gl_LightSource[osgOcean_LightID].position ) ) );
     vViewerDir = gl_ModelViewMatrixInverse[3].xyz - inputVertex.xyz;
-    vNormal = normalize(gl_Normal);
+    vNormal = normalize(inputNormal);
 
     vec4 waveColorDiff = osgOcean_WaveTop-osgOcean_WaveBot;
 
@@ -115,7 +217,7 @@ void main( void )
 
     // world space
     vWorldVertex = modelMatrix * inputVertex;
-    vWorldNormal = modelMatrix3x3 * gl_Normal;
+    vWorldNormal = modelMatrix3x3 * inputNormal;
     vWorldViewDir = vWorldVertex.xyz - osgOcean_Eye.xyz;
 
     // ------------- Texture Coords ---------------------------------
@@ -0,0 +1,47 @@
+#extension GL_ARB_texture_rectangle : enable
+
+#define NUM_SAMPLES 4
+
+uniform sampler2DRect osgOcean_Buffer;
+uniform float       osgOcean_Attenuation;
+
+// Both iterations of osgOcean_streak.frag for one direction. The second 
+// iteration's samples of the first one are evaluated inline instead of 
+// being read back from an intermediate buffer.
+vec3 streak( vec2 direction )
+{
+	vec2 pxSize = vec2(0.5);
+
+	float b1 = float(NUM_SAMPLES);
+	float b2 = b1 * b1;
+
+	vec3 cOut = vec3(0.0);
+
+	for (int s = 0; s < NUM_SAMPLES; s++)
+	{
+		float sf = float(s);
+		float weight = clamp(pow(osgOcean_Attenuation, b2 * sf), 0.0, 1.0);
+		vec2 sampleCoord = gl_TexCoord[0].st + (direction * b2 * vec2(sf) * pxSize);
+
+		vec3 pass1 = vec3(0.0);
+
+		for (int t = 0; t < NUM_SAMPLES; t++)
+		{
+			float tf = float(t);
+			float weight1 = clamp(pow(osgOcean_Attenuation, b1 * tf), 0.0, 1.0);
+			pass1 += weight1 * texture2DRect(osgOcean_Buffer, sampleCoord + (direction * b1 * vec2(tf) * pxSize)).rgb;
+		}
+
+		cOut += weight * clamp(pass1, 0.0, 1.0);
+	}
+
+	return clamp(cOut, 0.0, 1.0);
+}
+
+void main(void)
+{
+	gl_FragData[0] = vec4(streak(vec2( 0.5, 0.5)), 1.0);
+	gl_FragData[1] = vec4(streak(vec2(-0.5,-0.5)), 1.0);
+	gl_FragData[2] = vec4(streak(vec2( 0.5,-0.5)), 1.0);
+	gl_FragData[3] = vec4(streak(vec2(-0.5, 0.5)), 1.0);
+}
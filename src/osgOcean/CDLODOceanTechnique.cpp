@@ -0,0 +1,558 @@
+/*
+* This source file is part of the osgOcean library
+* 
+* Copyright (C) 2009 Kim Bale
+* Copyright (C) 2009 The University of Hull, UK
+* 
+* This program is free software; you can redistribute it and/or modify it under
+* the terms of the GNU Lesser General Public License as published by the Free Software
+* Foundation; either version 3 of the License, or (at your option) any later
+* version.
+
+* This program is distributed in the hope that it will be useful, but WITHOUT
+* ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+* FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+* http://www.gnu.org/copyleft/lesser.txt.
+*/
+
+#include <osgOcean/CDLODOceanTechnique>
+#include <osgOcean/ShaderManager>
+#include <osgOcean/IndexUtils>
+#include <osg/io_utils>
+#include <osg/Math>
+#include <osg/Version>
+#include <OpenThreads/ScopedLock>
+
+#if OPENSCENEGRAPH_MAJOR_VERSION > 3 || \
+    (OPENSCENEGRAPH_MAJOR_VERSION == 3 && OPENSCENEGRAPH_MINOR_VERSION >= 2)
+#include <osg/VertexAttribDivisor>
+#define OSGOCEAN_INSTANCED_ARRAYS
+#endif
+
+using namespace osgOcean;
+
+namespace
+{
+    // Vertex attribute location of the per instance node data.
+    const unsigned int NODE_PARAMS_ATTRIB = 6;
+
+    // The patch is laid out once in grid units, so its bounds come
+    // entirely from the initial bound set in selectNodes().
+    class PatchBoundCallback : public osg::Drawable::ComputeBoundingBoxCallback
+    {
+    public:
+        virtual osg::BoundingBox computeBound( const osg::Drawable& ) const
+        {
+            return osg::BoundingBox();
+        }
+    };
+
+    // Minimum distance from a point to a node on the water plane.
+    inline float distanceToNode( const osg::Vec3f& eye, float x, float y, float size )
+    {
+        float dx = eye.x() < x ? x - eye.x() : ( eye.x() > x+size ? eye.x() - (x+size) : 0.f );
+        float dy = eye.y() < y ? y - eye.y() : ( eye.y() > y+size ? eye.y() - (y+size) : 0.f );
+
+        return sqrtf( dx*dx + dy*dy + eye.z()*eye.z() );
+    }
+}
+
+CDLODOceanTechnique::CDLODOceanTechnique( unsigned int FFTGridSize,
+                                          unsigned int resolution,
+                                          unsigned int patchResolution,
+                                          unsigned int numLodLevels,
+                                          float visibleRange,
+                                          const osg::Vec2f& windDirection,
+                                          float windSpeed,
+                                          float depth,
+                                          float reflectionDamping,
+                                          float waveScale,
+                                          bool isChoppy,
+                                          float choppyFactor,
+                                          float animLoopTime,
+                                          unsigned int numFrames)
+    :FFTOceanTechnique( FFTGridSize,
+                        resolution,
+                        1,
+                        windDirection,
+                        windSpeed,
+                        depth,
+                        reflectionDamping,
+                        waveScale,
+                        isChoppy,
+                        choppyFactor,
+                        animLoopTime,
+                        numFrames)
+    ,_patchResolution   ( osg::maximum( patchResolution + (patchResolution & 1u), 2u ) )
+    ,_numLodLevels      ( osg::maximum( numLodLevels, 1u ) )
+    ,_lodRangeScale     ( 4.f )
+    ,_visibleRange      ( visibleRange )
+    ,_morphStart        ( 0.7f )
+    ,_isSelectionDirty  ( true )
+{
+    setUserData( new OceanDataType(*this, _NUMFRAMES, 25) );
+    setCullCallback( new OceanAnimationCallback );
+    setUpdateCallback( new OceanAnimationCallback );
+}
+
+CDLODOceanTechnique::CDLODOceanTechnique( const CDLODOceanTechnique& copy, const osg::CopyOp& copyop )
+    :FFTOceanTechnique   ( copy, copyop )
+    ,_patchResolution    ( copy._patchResolution )
+    ,_numLodLevels       ( copy._numLodLevels )
+    ,_lodRangeScale      ( copy._lodRangeScale )
+    ,_visibleRange       ( copy._visibleRange )
+    ,_morphStart         ( copy._morphStart )
+    ,_isSelectionDirty   ( true )
+    ,_mipmapData         ( copy._mipmapData )
+    ,_patchVertices      ( copy._patchVertices )
+    ,_patchElements      ( copy._patchElements )
+    ,_displacementMap    ( copy._displacementMap )
+    ,_displacementNormals( copy._displacementNormals )
+{}
+
+CDLODOceanTechnique::~CDLODOceanTechnique(void)
+{
+}
+
+CDLODOceanTechnique::ViewData::ViewData( void )
+    :_hasEye           ( false )
+    ,_isSelectionDirty ( true )
+    ,_isBoundDirty     ( false )
+    ,_geode            ( new osg::Geode )
+{}
+
+void CDLODOceanTechnique::build( void )
+{
+    osg::notify(osg::INFO) << "CDLODOceanTechnique::build()" << std::endl;
+
+    if( !ShaderManager::instance().areShadersEnabled() )
+        osg::notify(osg::WARN) << "CDLODOceanTechnique: Shaders are disabled, the surface will not be drawn." << std::endl;
+
+    computeFrames( _NUMFRAMES, true, _mipmapData );
+    createDisplacementMaps( _mipmapData, osg::Texture::LINEAR, _displacementMap, _displacementNormals );
+    createPatch();
+
+    initStateSet();
+
+    // The views select their nodes again when next culled.
+    dirtyBound();
+
+    _isDirty =  false;
+    _isStateDirty = false;
+
+    osg::notify(osg::INFO) << "CDLODOceanTechnique::build() Complete." << std::endl;
+}
+
+void CDLODOceanTechnique::initStateSet( void )
+{
+    osg::notify(osg::INFO) << "CDLODOceanTechnique::initStateSet()" << std::endl;
+
+    osg::ref_ptr<osg::Program> program = createShader();
+
+    initSurfaceStateSet( program.get() );
+
+    // Heightfield
+    _stateset->addUniform( new osg::Uniform("osgOcean_DisplacementMap",       DISPLACEMENT_MAP ) );
+    _stateset->addUniform( new osg::Uniform("osgOcean_DisplacementNormalMap", DISPLACEMENT_NORMAL_MAP ) );
+    _stateset->addUniform( new osg::Uniform("osgOcean_DisplacementCoords",    osg::Vec2f( _tileResInv, 0.5f/float(_tileSize) ) ) );
+
+    // Set every frame, so it must not be shared with a draw still in flight.
+    osg::Uniform* displacementFrame = new osg::Uniform("osgOcean_DisplacementFrame", float(_oldFrame) );
+    displacementFrame->setDataVariance( osg::Object::DYNAMIC );
+    _stateset->addUniform( displacementFrame );
+
+    _stateset->addUniform( new osg::Uniform("osgOcean_TileOrigin",            _startPos ) );
+    _stateset->addUniform( new osg::Uniform("osgOcean_CDLODParams",           osg::Vec4f( float(_patchResolution),
+                                                                                          getLodRange(0),
+                                                                                          _morphStart,
+                                                                                          float(_numLodLevels-1) ) ) );
+
+    // Only read by the vertex shader so no modes need enabling.
+    _stateset->setTextureAttribute( DISPLACEMENT_MAP,        _displacementMap.get(),     osg::StateAttribute::ON | osg::StateAttribute::PROTECTED );
+    _stateset->setTextureAttribute( DISPLACEMENT_NORMAL_MAP, _displacementNormals.get(), osg::StateAttribute::ON | osg::StateAttribute::PROTECTED );
+
+    _isStateDirty = false;
+    _isSelectionDirty = true;
+
+    osg::notify(osg::INFO) << "CDLODOceanTechnique::initStateSet() Complete." << std::endl;
+}
+
+void CDLODOceanTechnique::createPatch( void )
+{
+    osg::notify(osg::INFO) << "CDLODOceanTechnique::createPatch()" << std::endl;
+    osg::notify(osg::INFO) << "Patch: " << _patchResolution << "x" << _patchResolution << std::endl;
+
+    removeDrawables(0, getNumDrawables());
+
+    _patchVertices = NULL;
+    _patchElements = NULL;
+
+    // Views create their patches again when next culled.
+    {
+        OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_viewDataMapMutex);
+        _viewDataMap.clear();
+    }
+
+    if( !ShaderManager::instance().areShadersEnabled() )
+        return;
+
+    unsigned int rowLen = _patchResolution+1;
+
+    // Vertices are in grid units, the shader scales them to the node.
+    _patchVertices = new osg::Vec3Array;
+    _patchVertices->reserve( rowLen*rowLen );
+
+    for( unsigned int r = 0; r <= _patchResolution; ++r )
+    {
+        for( unsigned int c = 0; c <= _patchResolution; ++c )
+        {
+            _patchVertices->push_back( osg::Vec3f( float(c), float(r), 0.f ) );
+        }
+    }
+
+    std::vector<GLuint> triangles;
+    triangles.reserve( _patchResolution*_patchResolution*6 );
+
+    for( unsigned int r = 0; r < _patchResolution; ++r )
+    {
+        for( unsigned int c = 0; c < _patchResolution; ++c )
+        {
+            unsigned int i0 = c   +  r   *rowLen;
+            unsigned int i1 = c+1 +  r   *rowLen;
+            unsigned int i2 = c   + (r+1)*rowLen;
+            unsigned int i3 = c+1 + (r+1)*rowLen;
+
+            triangles.push_back(i0); triangles.push_back(i1); triangles.push_back(i2);
+            triangles.push_back(i1); triangles.push_back(i3); triangles.push_back(i2);
+        }
+    }
+
+    // Every instance draws the same mesh, so order it once for the post transform cache.
+    IndexUtils::optimizeTriangleOrder( triangles );
+    _patchElements = IndexUtils::createDrawElements( osg::PrimitiveSet::TRIANGLES, triangles );
+
+    _isSelectionDirty = true;
+}
+
+void CDLODOceanTechnique::createViewPatch( ViewData& view )
+{
+    // Each view has its own instance count, so its own copy of the triangles.
+    view._patchElements = dynamic_cast<osg::DrawElements*>( _patchElements->clone( osg::CopyOp::DEEP_COPY_ALL ) );
+
+    view._patch = new osg::Geometry;
+    view._patch->setUseDisplayList( false );
+    view._patch->setUseVertexBufferObjects( true );
+    view._patch->setDataVariance( osg::Object::DYNAMIC );
+    view._patch->setVertexArray( _patchVertices.get() );
+
+    view._patch->setVertexAttribArray  ( NODE_PARAMS_ATTRIB, new osg::Vec4Array );
+
+#ifdef OSGOCEAN_INSTANCED_ARRAYS
+    view._patch->setVertexAttribBinding( NODE_PARAMS_ATTRIB, osg::Geometry::BIND_PER_VERTEX );
+
+    // Advance the node data once per instance rather than per vertex.
+    view._patch->getOrCreateStateSet()->setAttribute( new osg::VertexAttribDivisor( NODE_PARAMS_ATTRIB, 1 ) );
+#else
+    // No instancing, the patch's triangles are added once per node with 
+    // the node data set before each of them.
+    view._patch->setVertexAttribBinding( NODE_PARAMS_ATTRIB, osg::Geometry::BIND_PER_PRIMITIVE_SET );
+#endif
+
+    view._patch->setComputeBoundingBoxCallback( new PatchBoundCallback );
+
+    // The morph distances are measured from the eye the nodes were selected from.
+    osg::Uniform* lodEye = new osg::Uniform("osgOcean_CDLODEye", osg::Vec3f() );
+    lodEye->setDataVariance( osg::Object::DYNAMIC );
+
+    view._geode->getOrCreateStateSet()->addUniform( lodEye );
+    view._geode->addDrawable( view._patch.get() );
+
+    view._isSelectionDirty = true;
+}
+
+void CDLODOceanTechnique::selectNodes( ViewData& view )
+{
+    const osg::Vec3f& eye = view._eye;
+
+    osg::Vec4Array* nodes = static_cast<osg::Vec4Array*>( view._patch->getVertexAttribArray(NODE_PARAMS_ATTRIB) );
+    nodes->clear();
+
+    osg::BoundingBox bound;
+
+    // Cover the visible range with root nodes aligned to the root size,
+    // so the same world position always falls in the same node.
+    unsigned int root = _numLodLevels-1;
+    float rootSize = getNodeSize( root );
+
+    int minX = (int)floorf( (eye.x()-_visibleRange) / rootSize );
+    int maxX = (int)floorf( (eye.x()+_visibleRange) / rootSize );
+    int minY = (int)floorf( (eye.y()-_visibleRange) / rootSize );
+    int maxY = (int)floorf( (eye.y()+_visibleRange) / rootSize );
+
+    for( int y = minY; y <= maxY; ++y )
+    {
+        for( int x = minX; x <= maxX; ++x )
+        {
+            selectNode( float(x)*rootSize, float(y)*rootSize, root, eye, *nodes, bound );
+        }
+    }
+
+    nodes->dirty();
+
+#ifdef OSGOCEAN_INSTANCED_ARRAYS
+    // A primitive set with no instances is drawn once without instancing, so remove it instead.
+    if( nodes->empty() )
+    {
+        if( view._patch->getNumPrimitiveSets() > 0 )
+            view._patch->removePrimitiveSet( 0, view._patch->getNumPrimitiveSets() );
+    }
+    else
+    {
+        view._patchElements->setNumInstances( nodes->size() );
+
+        if( view._patch->getNumPrimitiveSets() == 0 )
+            view._patch->addPrimitiveSet( view._patchElements.get() );
+    }
+#else
+    if( view._patch->getNumPrimitiveSets() > 0 )
+        view._patch->removePrimitiveSet( 0, view._patch->getNumPrimitiveSets() );
+
+    for( unsigned int i = 0; i < nodes->size(); ++i )
+        view._patch->addPrimitiveSet( view._patchElements.get() );
+#endif
+
+    // Pad the bounds by the wave height and the choppy displacement.
+    float pad = osg::maximum( _maxHeight, 1.f ) + _maxDisplacement;
+
+    if( bound.valid() )
+    {
+        bound.zMin() = -pad;
+        bound.zMax() =  pad;
+        bound.xMin() -= pad; bound.xMax() += pad;
+        bound.yMin() -= pad; bound.yMax() += pad;
+    }
+
+    view._patch->setInitialBound( bound );
+    view._patch->dirtyBound();
+
+    view._bound = bound;
+    view._lodEye = eye;
+    view._geode->getStateSet()->getUniform("osgOcean_CDLODEye")->set( view._lodEye );
+
+    view._isSelectionDirty = false;
+    view._isBoundDirty = true;
+}
+
+void CDLODOceanTechnique::selectNode( float x, float y, unsigned int level, const osg::Vec3f& eye,
+                                      osg::Vec4Array& nodes, osg::BoundingBox& bound ) const
+{
+    float size = getNodeSize( level );
+
+    // Nodes out of sight are dropped whole.
+    float dist = distanceToNode( eye, x, y, size );
+
+    if( dist > _visibleRange )
+        return;
+
+    // Subdivide while the finer level's range reaches into the node. Children that
+    // end up beyond their own range are fully morphed, matching this level exactly.
+    if( level > 0 && dist < getLodRange( level-1 ) )
+    {
+        float half = size * 0.5f;
+
+        selectNode( x,      y,      level-1, eye, nodes, bound );
+        selectNode( x+half, y,      level-1, eye, nodes, bound );
+        selectNode( x,      y+half, level-1, eye, nodes, bound );
+        selectNode( x+half, y+half, level-1, eye, nodes, bound );
+        return;
+    }
+
+    nodes.push_back( osg::Vec4f( x, y, size, float(level) ) );
+
+    bound.expandBy( osg::Vec3f( x,      y,      0.f ) );
+    bound.expandBy( osg::Vec3f( x+size, y+size, 0.f ) );
+}
+
+void CDLODOceanTechnique::update( unsigned int frame, const double& dt, const osg::Vec3f& eye )
+{
+    if(_isDirty)
+        build();
+    else if(_isStateDirty)
+        initStateSet();
+
+    if (_isAnimating)
+    {
+        static double time = 0.0;
+        time += (dt * 0.001);      // dt is in milliseconds (see FFTOceanTechnique::OceanDataType::updateOcean() )
+
+        getStateSet()->getUniform("osgOcean_FrameTime")->set( float(time) );
+        getStateSet()->getUniform("osgOcean_NoiseCoords0")->set( computeNoiseCoords( 32.f, osg::Vec2f( 2.f, 4.f), 2.f, time ) );
+        getStateSet()->getUniform("osgOcean_NoiseCoords1")->set( computeNoiseCoords( 8.f,  osg::Vec2f(-4.f, 2.f), 1.f, time ) );
+        getStateSet()->getUniform("osgOcean_DisplacementFrame")->set( float(frame) );
+    }
+
+    bool boundChanged = false;
+
+    {
+        OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_viewDataMapMutex);
+
+        ViewDataMap::iterator itr = _viewDataMap.begin();
+
+        while( itr != _viewDataMap.end() )
+        {
+            ViewData& view = *itr->second;
+
+            // Drop the views whose cameras have gone.
+            if( !view._camera.valid() )
+            {
+                _viewDataMap.erase( itr++ );
+                boundChanged = true;
+                continue;
+            }
+
+            if( _isSelectionDirty )
+                view._isSelectionDirty = true;
+
+            // Reselect once the eye has moved a fraction of the finest node, well
+            // before any node crosses a range boundary by a noticeable amount.
+            if( view._patch.valid() && view._hasEye &&
+                ( view._isSelectionDirty || (view._eye-view._lodEye).length2() > osg::square( getNodeSize(0) * 0.1f ) ) )
+            {
+                selectNodes( view );
+            }
+
+            boundChanged = boundChanged || view._isBoundDirty;
+
+            view._isBoundDirty = false;
+            view._hasEye = false;
+
+            ++itr;
+        }
+    }
+
+    _isSelectionDirty = false;
+
+    if( boundChanged )
+        dirtyBound();
+
+    _oldFrame = frame;
+}
+
+void CDLODOceanTechnique::cullView( osgUtil::CullVisitor& cv, bool lodEye, float projectionScale, bool drawing )
+{
+    if( _isDirty || !_patchElements.valid() )
+        return;
+
+    ViewData* view = getViewData( cv );
+
+    // OceanScene culls the surface for the view's own camera ahead of the 
+    // reflection and refraction passes, so the first eye is the view's.
+    if( lodEye && !view->_hasEye )
+    {
+        view->_eye = cv.getEyePoint();
+        view->_hasEye = true;
+    }
+
+    if( !drawing )
+        return;
+
+    if( !view->_patch.valid() )
+    {
+        if( !view->_hasEye )
+            view->_eye = cv.getEyePoint();
+
+        createViewPatch( *view );
+        selectNodes( *view );
+    }
+
+    view->_geode->accept( cv );
+}
+
+CDLODOceanTechnique::ViewData* CDLODOceanTechnique::getViewData( osgUtil::CullVisitor& cv )
+{
+    // The root render stage's camera is the view's, also during the RTT passes.
+    osg::Camera* camera = cv.getRenderStage()->getCamera();
+
+    OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_viewDataMapMutex);
+
+    osg::ref_ptr<ViewData>& view = _viewDataMap[ camera ];
+
+    if( !view.valid() || view->_camera.get() != camera )
+    {
+        view = new ViewData;
+        view->_camera = camera;
+    }
+
+    return view.get();
+}
+
+osg::BoundingSphere CDLODOceanTechnique::computeBound( void ) const
+{
+    osg::BoundingBox bound;
+
+    {
+        OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_viewDataMapMutex);
+
+        for( ViewDataMap::const_iterator itr = _viewDataMap.begin(); itr != _viewDataMap.end(); ++itr )
+            bound.expandBy( itr->second->_bound );
+    }
+
+    return osg::BoundingSphere( bound );
+}
+
+void CDLODOceanTechnique::resizeGLObjectBuffers( unsigned int maxSize )
+{
+    FFTOceanTechnique::resizeGLObjectBuffers( maxSize );
+
+    OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_viewDataMapMutex);
+
+    for( ViewDataMap::iterator itr = _viewDataMap.begin(); itr != _viewDataMap.end(); ++itr )
+        itr->second->_geode->resizeGLObjectBuffers( maxSize );
+}
+
+void CDLODOceanTechnique::releaseGLObjects( osg::State* state ) const
+{
+    FFTOceanTechnique::releaseGLObjects( state );
+
+    OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_viewDataMapMutex);
+
+    for( ViewDataMap::const_iterator itr = _viewDataMap.begin(); itr != _viewDataMap.end(); ++itr )
+        itr->second->_geode->releaseGLObjects( state );
+}
+
+float CDLODOceanTechnique::getSurfaceHeightAt(float x, float y, osg::Vec3f* normal)
+{
+    if(_isDirty)
+        build();
+
+    return getTileHeightAt( _mipmapData[_oldFrame], x, y, normal );
+}
+
+#include <osgOcean/shaders/osgOcean_ocean_surface_cdlod_vert.inl>
+#include <osgOcean/shaders/osgOcean_ocean_surface_frag.inl>
+
+osg::Program* CDLODOceanTechnique::createShader(void)
+{
+    static const char osgOcean_ocean_surface_vert_file[] = "osgOcean_ocean_surface_cdlod.vert";
+    static const char osgOcean_ocean_surface_frag_file[] = "osgOcean_ocean_surface.frag";
+
+    osg::Program* program =
+        ShaderManager::instance().createProgram("ocean_surface",
+        osgOcean_ocean_surface_vert_file, osgOcean_ocean_surface_frag_file,
+        osgOcean_ocean_surface_cdlod_vert, osgOcean_ocean_surface_frag);
+
+    if( program )
+        program->addBindAttribLocation( "osgOcean_NodeParams", NODE_PARAMS_ATTRIB );
+
+    return program;
+}
+
+// register the read and write functions with the osgDB::Registry.
+REGISTER_DOTOSGWRAPPER(CDLODOceanTechnique)
+(
+    new osgOcean::CDLODOceanTechnique,
+    "CDLODOceanTechnique",
+    "Object Node OceanTechnique FFTOceanTechnique CDLODOceanTechnique Geode",
+    NULL,
+    NULL
+);
@@ -0,0 +1,158 @@
+/*
+* This source file is part of the osgOcean library
+* 
+* Copyright (C) 2009 Kim Bale
+* Copyright (C) 2009 The University of Hull, UK
+* 
+* This program is free software; you can redistribute it and/or modify it under
+* the terms of the GNU Lesser General Public License as published by the Free Software
+* Foundation; either version 3 of the License, or (at your option) any later
+* version.
+
+* This program is distributed in the hope that it will be useful, but WITHOUT
+* ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+* FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+* http://www.gnu.org/copyleft/lesser.txt.
+*/
+
+
+#include <osgOcean/DirtyRangeUploadCallback>
+#include <osg/BufferObject>
+#include <osg/Version>
+
+#if OPENSCENEGRAPH_MAJOR_VERSION > 3 || \
+    (OPENSCENEGRAPH_MAJOR_VERSION == 3 && OPENSCENEGRAPH_MINOR_VERSION >= 4)
+#include <osg/GLExtensions>
+#endif
+
+using namespace osgOcean;
+
+DirtyRangeUploadCallback::DirtyRangeUploadCallback( void )
+    :_version   ( 0 )
+    ,_isAllDirty( false )
+{
+}
+
+DirtyRangeUploadCallback::DirtyRangeUploadCallback( const DirtyRangeUploadCallback& copy, const osg::CopyOp& copyop )
+    :osg::Object                ( copy, copyop )
+    ,osg::Drawable::DrawCallback( copy, copyop )
+    ,_arrays    ( copy._arrays )
+    ,_ranges    ( copy._ranges )
+    ,_version   ( copy._version )
+    ,_isAllDirty( copy._isAllDirty )
+{
+}
+
+void DirtyRangeUploadCallback::addArray( osg::Array* array )
+{
+    _arrays.push_back( array );
+}
+
+void DirtyRangeUploadCallback::clear( void )
+{
+    _arrays.clear();
+    _ranges.clear();
+    _isAllDirty = false;
+}
+
+void DirtyRangeUploadCallback::beginUpdate( void )
+{
+    _ranges.clear();
+    _isAllDirty = false;
+    ++_version;
+}
+
+void DirtyRangeUploadCallback::dirtyRange( unsigned int first, unsigned int count )
+{
+    if( count == 0 || _isAllDirty )
+        return;
+
+    if( !_ranges.empty() && _ranges.back().first + _ranges.back().count == first )
+    {
+        _ranges.back().count += count;
+        return;
+    }
+
+    Range range = { first, count };
+    _ranges.push_back( range );
+}
+
+void DirtyRangeUploadCallback::dirtyAll( void )
+{
+    _ranges.clear();
+    _isAllDirty = true;
+}
+
+void DirtyRangeUploadCallback::drawImplementation( osg::RenderInfo& renderInfo, const osg::Drawable* drawable ) const
+{
+    unsigned int contextID = renderInfo.getContextID();
+    unsigned int& uploaded = _uploadedVersion[contextID];
+
+    // The first drawable drawn in a context brings the buffers up to date for the rest.
+    if( uploaded != _version )
+    {
+        // A context that missed an update no longer knows what changed, so sends everything.
+        upload( contextID, uploaded+1 == _version && !_isAllDirty );
+        uploaded = _version;
+    }
+
+    drawable->drawImplementation( renderInfo );
+}
+
+void DirtyRangeUploadCallback::upload( unsigned int contextID, bool rangesOnly ) const
+{
+    if( rangesOnly && _ranges.empty() )
+        return;
+
+#if OPENSCENEGRAPH_MAJOR_VERSION > 3 || \
+    (OPENSCENEGRAPH_MAJOR_VERSION == 3 && OPENSCENEGRAPH_MINOR_VERSION >= 4)
+    const osg::GLExtensions* extensions = osg::GLExtensions::Get( contextID, true );
+#else
+    const osg::GLBufferObject::Extensions* extensions = osg::GLBufferObject::getExtensions( contextID, true );
+#endif
+
+    for( std::vector< osg::ref_ptr<osg::Array> >::const_iterator itr = _arrays.begin(); itr != _arrays.end(); ++itr )
+    {
+        const osg::Array* array = itr->get();
+        osg::BufferObject* bufferObject = array->getBufferObject();
+
+        if( !bufferObject )
+            continue;
+
+        // Not yet created, or already due a full upload by OSG when next bound.
+        osg::GLBufferObject* glBufferObject = bufferObject->getGLBufferObject( contextID );
+
+        if( !glBufferObject || glBufferObject->isDirty() )
+            continue;
+
+        unsigned int elementSize = array->getElementSize();
+        unsigned int numElements = array->getNumElements();
+        unsigned int offset      = glBufferObject->getOffset( array->getBufferIndex() );
+
+        const GLubyte* data = static_cast<const GLubyte*>( array->getDataPointer() );
+
+        glBufferObject->bindBuffer();
+
+        if( rangesOnly )
+        {
+            for( std::vector<Range>::const_iterator r = _ranges.begin(); r != _ranges.end(); ++r )
+            {
+                if( r->first >= numElements )
+                    continue;
+
+                unsigned int count = osg::minimum( r->count, numElements - r->first );
+
+                extensions->glBufferSubData( bufferObject->getTarget(),
+                                             offset + r->first*elementSize,
+                                             count*elementSize,
+                                             data + r->first*elementSize );
+            }
+        }
+        else
+        {
+            extensions->glBufferSubData( bufferObject->getTarget(), offset, numElements*elementSize, data );
+        }
+
+        glBufferObject->unbindBuffer();
+    }
+}
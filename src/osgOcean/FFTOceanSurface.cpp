@@ -17,8 +17,11 @@
 
 #include <osgOcean/FFTOceanSurface>
 #include <osgOcean/ShaderManager>
+#include <osgOcean/IndexUtils>
 #include <osg/io_utils>
-#include <osg/Material>
+#include <OpenThreads/ScopedLock>
+
+#include <algorithm>
 
 using namespace osgOcean;
 
@@ -46,11 +49,8 @@ FFTOceanSurface::FFTOceanSurface( unsigned int FFTGridSize,
                         choppyFactor, 
                         animLoopTime, 
                         numFrames)
-    ,_numVertices    ( 0 )
-    ,_newNumVertices ( 0 )
-    ,_activeVertices ( new osg::Vec3Array )
-    ,_activeNormals  ( new osg::Vec3Array )
     ,_totalPoints    ( _tileSize * _numTiles + 1 )
+    ,_farFieldDistance( 0.f )
 {
     setUserData( new OceanDataType(*this, _NUMFRAMES, 25) );
     setOceanAnimationCallback( new OceanAnimationCallback );
@@ -58,159 +58,115 @@ FFTOceanSurface::FFTOceanSurface( unsigned int FFTGridSize,
 
 FFTOceanSurface::FFTOceanSurface( const FFTOceanSurface& copy, const osg::CopyOp& copyop ):
     FFTOceanTechnique   ( copy, copyop )
-    ,_numVertices       ( copy._numVertices )
-    ,_newNumVertices    ( copy._newNumVertices )
-    ,_mipmapGeom        ( copy._mipmapGeom )
     ,_mipmapData        ( copy._mipmapData )
     ,_totalPoints       ( copy._totalPoints )
+    ,_farFieldDistance  ( copy._farFieldDistance )
 {}
 
 FFTOceanSurface::~FFTOceanSurface(void)
 {
 }
 
+FFTOceanSurface::ViewData::ViewData( void )
+    :_isBuilt         ( false )
+    ,_frame           ( 0 )
+    ,_hasEye          ( false )
+    ,_projectionScale ( 0.f )
+    ,_C               ( 0.f )
+    ,_geode           ( new osg::Geode )
+    ,_numVertices     ( 0 )
+    ,_newNumVertices  ( 0 )
+    ,_levelsSelected  ( false )
+    ,_activeVertices  ( new osg::Vec3Array )
+    ,_activeNormals   ( new osg::Vec3Array )
+    ,_vertexUploader  ( new DirtyRangeUploadCallback )
+    ,_farFieldDistance( 0.f )
+    ,_farFieldFrame   ( 0 )
+{}
+
 void FFTOceanSurface::build( void )
 {
     osg::notify(osg::INFO) << "FFTOceanSurface::build()" << std::endl;
 
     computeSea( _NUMFRAMES );
-    createOceanTiles();
-    computeVertices(0);
-    computePrimitives();
-
-    initStateSet();
 
-    _isDirty =  false;
-    _isStateDirty = false;
+    // The tiles are held by the views, the surface itself draws nothing.
+    if(getNumDrawables()>0)
+        removeDrawables(0,getNumDrawables());
 
-    osg::notify(osg::INFO) << "FFTOceanSurface::build() Complete." << std::endl;
-}
+    if( _useScreenSpaceError )
+    {
+        computeMinDistances();
+    }
+    else
+    {
+        // Fixed distances, one tile further out per level.
+        osg::notify(osg::INFO) << "Minimum Distances: " << std::endl;
 
-void FFTOceanSurface::initStateSet( void )
-{
-    osg::notify(osg::INFO) << "FFTOceanSurface::initStateSet()" << std::endl;
-    _stateset=new osg::StateSet;
+        _minDist.clear();
 
-    // Note that we will only set the textures in the state set if shaders are
-    // enabled, otherwise the fixed pipeline will try to put the env map onto
-    // the water surface, which has no texture coordinates, so the surface
-    // will take the general color of the env map...
+        for(unsigned int d = 0; d < _numLevels; ++d)
+        {
+            _minDist.push_back( d * (float(_tileResolution+1)) + ( float(_tileResolution+1.f)*0.5f ) );
+            _minDist.back() *= _minDist.back();
+            osg::notify(osg::INFO) << d << ": " << sqrt(_minDist.back()) << std::endl;
+        }
+    }
 
-    // Environment map    
-    _stateset->addUniform( new osg::Uniform("osgOcean_EnvironmentMap", ENV_MAP ) );
-    if (ShaderManager::instance().areShadersEnabled())
-        _stateset->setTextureAttributeAndModes( ENV_MAP, _environmentMap.get(), osg::StateAttribute::ON );
-    
-    // Foam
-    _stateset->addUniform( new osg::Uniform("osgOcean_EnableCrestFoam", _useCrestFoam ) );
-    _stateset->addUniform( new osg::Uniform("osgOcean_FoamCapBottom",   _foamCapBottom ) );
-    _stateset->addUniform( new osg::Uniform("osgOcean_FoamCapTop",      _foamCapTop ) );
-    _stateset->addUniform( new osg::Uniform("osgOcean_FoamMap",         FOAM_MAP ) );
-    _stateset->addUniform( new osg::Uniform("osgOcean_FoamScale",       _tileResInv*30.f ) );
-
-    if( _useCrestFoam )
+    // Views create their tiles again when next culled.
     {
-        osg::Texture2D* foam_tex = createTexture("sea_foam.png", osg::Texture::REPEAT );
-        if (ShaderManager::instance().areShadersEnabled())
-            _stateset->setTextureAttributeAndModes( FOAM_MAP, foam_tex, osg::StateAttribute::ON );
+        OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_viewDataMapMutex);
+        _viewDataMap.clear();
     }
 
-    // Noise
-    _stateset->addUniform( new osg::Uniform("osgOcean_NoiseMap",     NORMAL_MAP ) );
-    _stateset->addUniform( new osg::Uniform("osgOcean_NoiseCoords0", computeNoiseCoords( 32.f, osg::Vec2f( 2.f, 4.f), 2.f, 0.f ) ) );
-    _stateset->addUniform( new osg::Uniform("osgOcean_NoiseCoords1", computeNoiseCoords( 8.f,  osg::Vec2f(-4.f, 2.f), 1.f, 0.f ) ) );
+    initStateSet();
 
-    osg::ref_ptr<osg::Texture2D> noiseMap 
-        = createNoiseMap( _noiseTileSize, _noiseWindDir, _noiseWindSpeed, _noiseWaveScale, _noiseTileRes ); 
+    // The wave heights have changed.
+    dirtyBound();
 
-    if (ShaderManager::instance().areShadersEnabled())
-        _stateset->setTextureAttributeAndModes( NORMAL_MAP, noiseMap.get(), osg::StateAttribute::ON );
+    _isDirty =  false;
+    _isStateDirty = false;
 
-    // Colouring
-    osg::Vec4f waveTop = colorLerp(_lightColor, osg::Vec4f(), osg::Vec4f(_waveTopColor,1.f) );
-    osg::Vec4f waveBot = colorLerp(_lightColor, osg::Vec4f(), osg::Vec4f(_waveBottomColor,1.f) );
+    osg::notify(osg::INFO) << "FFTOceanSurface::build() Complete." << std::endl;
+}
 
-    _stateset->addUniform( new osg::Uniform("osgOcean_WaveTop", waveTop ) );
-    _stateset->addUniform( new osg::Uniform("osgOcean_WaveBot", waveBot ) );
-    _stateset->addUniform( new osg::Uniform("osgOcean_FresnelMul", _fresnelMul ) );    
-    _stateset->addUniform( new osg::Uniform("osgOcean_FrameTime", 0.0f ) );    
+void FFTOceanSurface::initStateSet( void )
+{
+    osg::notify(osg::INFO) << "FFTOceanSurface::initStateSet()" << std::endl;
 
     osg::ref_ptr<osg::Program> program = createShader();
-        
-    if(program.valid())
-        _stateset->setAttributeAndModes( program.get(), osg::StateAttribute::ON );
 
-    // If shaders are enabled, the final color will be determined by the 
-    // shader so we need a white base color. But on the fixed pipeline the
-    // material color will determine the ocean surface's color.
-    if (!ShaderManager::instance().areShadersEnabled())
-    {
-        osg::Material* mat = new osg::Material;
-        mat->setDiffuse(osg::Material::FRONT_AND_BACK, osg::Vec4f(_waveTopColor, 1.0f));
-        _stateset->setAttributeAndModes(mat, osg::StateAttribute::ON);
-    }
+    initSurfaceStateSet( program.get() );
 
     _isStateDirty = false;
 
     osg::notify(osg::INFO) << "FFTOceanSurface::initStateSet() Complete." << std::endl;
 }
 
-osg::ref_ptr<osg::Texture2D> FFTOceanSurface::createNoiseMap(unsigned int size, 
-                                                             const osg::Vec2f& windDir, 
-                                                             float windSpeed,                                         
-                                                             float waveScale,
-                                                             float tileResolution )
-{
-    osg::ref_ptr<osg::FloatArray> heights = new osg::FloatArray;
-
-    FFTSimulation noiseFFT(size, windDir, windSpeed, _depth, _reflDampFactor, waveScale, tileResolution, 10.f);
-    noiseFFT.setTime(0.f);
-    noiseFFT.computeHeights(heights.get());
-        
-    OceanTile oceanTile(heights.get(),size,tileResolution/size);
-
-    return oceanTile.createNormalMap();
-}
-
 void FFTOceanSurface::computeSea( unsigned int totalFrames )
 {
     osg::notify(osg::INFO) << "FFTOceanSurface::computeSea("<<totalFrames<<")" << std::endl;
-    osg::notify(osg::INFO) << "Mipmap Levels: " << _numLevels << std::endl;
-    osg::notify(osg::INFO) << "Highest Resolution: " << _tileSize << std::endl;
 
-    FFTSimulation FFTSim( _tileSize, _windDirection, _windSpeed, _depth, _reflDampFactor, _waveScale, _tileResolution, _cycleTime );
+    std::vector<OceanTile> frames;
+    computeFrames( totalFrames, false, frames );
 
     // clear previous mipmaps (if any)
     _mipmapData.clear();
     _mipmapData.resize( totalFrames );
 
-    _averageHeight = 0.f;
-    _maxHeight = -FLT_MAX;
+    // Used for lowest resolution tile
+    osg::ref_ptr<osg::FloatArray> zeroHeights = new osg::FloatArray(4);
+    zeroHeights->at(0) = 0.f;
+    zeroHeights->at(1) = 0.f;
+    zeroHeights->at(2) = 0.f;
+    zeroHeights->at(3) = 0.f;
 
     for( unsigned int frame = 0; frame < totalFrames; ++frame )
     {
-        osg::ref_ptr<osg::FloatArray> heights = new osg::FloatArray;
-        osg::ref_ptr<osg::Vec2Array> displacements = NULL;
-
-        if (_isChoppy)
-            displacements = new osg::Vec2Array;
-
-        float time = _cycleTime * ( float(frame) / float(totalFrames) );
-
-        FFTSim.setTime( time );
-        FFTSim.computeHeights( heights.get() );
-
-        if(_isChoppy)
-            FFTSim.computeDisplacements( _choppyFactor, displacements.get() );
-
         _mipmapData[frame].resize( _numLevels );
 
         // Level 0
-        _mipmapData[frame][0] = OceanTile( heights.get(), _tileSize, _pointSpacing, displacements.get() );
-
-        _averageHeight += _mipmapData[frame][0].getAverageHeight();
-
-        _maxHeight = osg::maximum(_maxHeight, _mipmapData[frame][0].getMaximumHeight());
+        _mipmapData[frame][0] = frames[frame];
 
         // Levels 1 -> Max Level
         for(unsigned int level = 1; level < _numLevels-1; ++level )
@@ -220,23 +176,16 @@ void FFTOceanSurface::computeSea( unsigned int totalFrames )
             _mipmapData[frame][level] = OceanTile( lastTile, _tileSize >> level, _tileSize/(_tileSize>>level)*_pointSpacing );
         }
 
-        // Used for lowest resolution tile
-        osg::ref_ptr<osg::FloatArray> zeroHeights = new osg::FloatArray(4);
-        zeroHeights->at(0) = 0.f;
-        zeroHeights->at(1) = 0.f;
-        zeroHeights->at(2) = 0.f;
-        zeroHeights->at(3) = 0.f;
-
         _mipmapData[frame][_numLevels-1] = OceanTile( zeroHeights.get(), 1, _tileSize/(_tileSize>>(_numLevels-1))*_pointSpacing );
     }
 
-    _averageHeight /= (float)totalFrames;
+    // The lowest level is flat, so it is out by as much as the highest wave.
+    _levelErrors.back() = osg::maximum( _levelErrors.back(), _maxHeight );
 
-    osg::notify(osg::INFO) << "Average Height: " << _averageHeight << std::endl;
     osg::notify(osg::INFO) << "FFTOceanSurface::computeSea() Complete." << std::endl;
 }
 
-void FFTOceanSurface::createOceanTiles( void )
+void FFTOceanSurface::createOceanTiles( ViewData& view )
 {
     osg::notify(osg::INFO) << "FFTOceanSurface::createOceanTiles()" << std::endl;
     osg::notify(osg::INFO) << "Total tiles: " << _numTiles*_numTiles << std::endl;
@@ -245,17 +194,31 @@ void FFTOceanSurface::createOceanTiles( void )
     MipmapGeometry::BORDER_TYPE border = MipmapGeometry::BORDER_NONE;
 
     // Clear previous data if it exists
-    _numVertices = 0;
-    _newNumVertices = 0;
-    _mipmapGeom.clear();
-    _activeVertices->clear();
-    _activeNormals->clear();
-    _minDist.clear();
+    view._numVertices = 0;
+    view._newNumVertices = 0;
+    view._levelsSelected = false;
+    view._mipmapGeom.clear();
+    view._activeVertices->clear();
+    view._activeNormals->clear();
 
-    if(getNumDrawables()>0)
-        removeDrawables(0,getNumDrawables());
+    if(view._geode->getNumDrawables()>0)
+        view._geode->removeDrawables(0,view._geode->getNumDrawables());
+
+    view._farField = NULL;
+    view._farFieldLevels.clear();
+
+    view._mipmapGeom.resize( _numTiles );
 
-    _mipmapGeom.resize( _numTiles );
+    // Everything is visible until the first views have been culled.
+    view._tileVisible.assign( _numTiles*_numTiles, true );
+    view._tileNeeded.assign( _numTiles*_numTiles, true );
+
+    TileVertexState unwritten = { ~0u, ~0u, ~0u, osg::Vec2f() };
+    view._tileVertexState.assign( _numTiles*_numTiles, unwritten );
+
+    view._vertexUploader->clear();
+    view._vertexUploader->addArray( view._activeVertices.get() );
+    view._vertexUploader->addArray( view._activeNormals.get() );
 
     osg::ref_ptr<osg::Vec4Array> colours = new osg::Vec4Array;
     colours->push_back( osg::Vec4f(1.f, 1.f,1.f,1.f) );
@@ -276,17 +239,19 @@ void FFTOceanSurface::createOceanTiles( void )
             MipmapGeometry* patch = new MipmapGeometry( _numLevels-2, _numLevels, 0, border );
 
             patch->setUseDisplayList( false );
-            patch->setVertexArray( _activeVertices.get() );
-            patch->setNormalArray( _activeNormals.get() );
+            patch->setUseVertexBufferObjects( true );
+            patch->setDrawCallback( view._vertexUploader.get() );
+            patch->setVertexArray( view._activeVertices.get() );
+            patch->setNormalArray( view._activeNormals.get() );
             patch->setColorArray    ( colours.get() );
             patch->setNormalBinding( osg::Geometry::BIND_PER_VERTEX );
             patch->setColorBinding( osg::Geometry::BIND_OVERALL );
             patch->setDataVariance( osg::Object::DYNAMIC );
-            patch->setIdx( _numVertices );
+            patch->setIdx( view._numVertices );
 
-            addDrawable( patch );
+            view._geode->addDrawable( patch );
 
-            _mipmapGeom[y].push_back( patch );
+            view._mipmapGeom[y].push_back( patch );
 
             unsigned int verts = 0;
             unsigned int s = 2;
@@ -300,41 +265,32 @@ void FFTOceanSurface::createOceanTiles( void )
             if(x == _numTiles-1 && y == _numTiles-1)    // If corner piece add corner vertex
                 verts += 1;
 
-            _numVertices += verts;
+            view._numVertices += verts;
         }
     }
 
-    osg::notify(osg::INFO) << "Vertices needed: " << _numVertices << std::endl;
-
-    _activeVertices->resize( _numVertices );
-    _activeNormals->resize( _numVertices );
-
-// Correct dMin calculations for geomipmap distances. Not used at the moment
-//    float T = (2.0f * TRESHOLD) / VRES;
-//    float A = 1.0f / (float)tan(FOV / 2.0f);
-//    float C = A / T;
+    osg::notify(osg::INFO) << "Vertices needed: " << view._numVertices << std::endl;
 
-    osg::notify(osg::INFO) << "Minimum Distances: " << std::endl;
-
-    for(unsigned int d = 0; d < _numLevels; ++d)
-    {
-        _minDist.push_back( d * (float(_tileResolution+1)) + ( float(_tileResolution+1.f)*0.5f ) );
-        _minDist.back() *= _minDist.back();
-        osg::notify(osg::INFO) << d << ": " << sqrt(_minDist.back()) << std::endl;
-    }
+    view._activeVertices->resize( view._numVertices );
+    view._activeNormals->resize( view._numVertices );
 
     osg::notify(osg::INFO) << "FFTOceanSurface::createOceanTiles() Complete." << std::endl;
 }
 
-void FFTOceanSurface::computeVertices( unsigned int frame )
+void FFTOceanSurface::computeVertices( ViewData& view, unsigned int frame )
 {
+    view._vertexUploader->beginUpdate();
+
+    bool resized = false;
+
     // Only resize vertex/normal arrays if more are needed
-    if(_newNumVertices > _numVertices )
+    if(view._newNumVertices > view._numVertices )
     {
-        osg::notify(osg::INFO) << "Resizing vertex array from " << _numVertices << "to " << _newNumVertices << std::endl;
-        _numVertices = _newNumVertices;
-        _activeVertices->resize(_numVertices);
-        _activeNormals->resize(_numVertices);
+        osg::notify(osg::INFO) << "Resizing vertex array from " << view._numVertices << "to " << view._newNumVertices << std::endl;
+        view._numVertices = view._newNumVertices;
+        view._activeVertices->resize(view._numVertices);
+        view._activeNormals->resize(view._numVertices);
+        resized = true;
     }
 
     osg::Vec3f tileOffset,vertexOffset,vertex;
@@ -345,13 +301,48 @@ void FFTOceanSurface::computeVertices( unsigned int frame )
 
     for(unsigned int y = 0; y < _numTiles; ++y )
     {    
-        tileOffset.y() = _startPos.y() - y*_tileResolution;
+        tileOffset.y() = view._startPos.y() - y*_tileResolution;
 
         for(unsigned int x = 0; x < _numTiles; ++x )
         {
-            tileOffset.x() = _startPos.x() + x*_tileResolution;
+            tileOffset.x() = view._startPos.x() + x*_tileResolution;
+
+            MipmapGeometry* tile = getTile(view,x,y);
+            TileVertexState& state = view._tileVertexState[x + y*_numTiles];
+
+            unsigned int numTileVertices = tile->getColLen() * tile->getRowLen();
+
+            // Tiles nothing visible is drawn from are not animated, but are still drawn
+            // in case the culling was wrong, so they are rewritten if they have moved.
+            if( !view._tileNeeded[x + y*_numTiles] && 
+                !resized && 
+                state.frame != ~0u && 
+                state.level == tile->getLevel() && 
+                state.idx == ptr && 
+                state.offset == osg::Vec2f( tileOffset.x(), tileOffset.y() ) )
+            {
+                ptr += numTileVertices;
+                continue;
+            }
+
+            // Skip tiles whose range already holds what would be written.
+            if( !resized && 
+                state.frame == frame && 
+                state.level == tile->getLevel() && 
+                state.idx == ptr && 
+                state.offset == osg::Vec2f( tileOffset.x(), tileOffset.y() ) )
+            {
+                ptr += numTileVertices;
+                continue;
+            }
+
+            state.frame  = frame;
+            state.level  = tile->getLevel();
+            state.idx    = ptr;
+            state.offset.set( tileOffset.x(), tileOffset.y() );
+
+            view._vertexUploader->dirtyRange( ptr, numTileVertices );
 
-            MipmapGeometry* tile = getTile(x,y);
             const OceanTile& data = curData[ tile->getLevel() ];
 
             for(unsigned int row = 0; row < tile->getColLen(); ++row )
@@ -362,13 +353,21 @@ void FFTOceanSurface::computeVertices( unsigned int frame )
                 {
                     vertexOffset.x() = data.getSpacing()*float(col) + tileOffset.x();
 
-                    (*_activeVertices)[ptr] = data.getVertex(col,row) + vertexOffset;
-                    (*_activeNormals) [ptr] = data.getNormal(col,row);
+                    (*view._activeVertices)[ptr] = data.getVertex(col,row) + vertexOffset;
+                    (*view._activeNormals) [ptr] = data.getNormal(col,row);
                     ++ptr;
                 }
             }
         }
     }
+
+    // Resized arrays need new buffer storage, which OSG allocates and fills as a whole.
+    if( resized )
+    {
+        view._vertexUploader->dirtyAll();
+        view._activeVertices->dirty();
+        view._activeNormals->dirty();
+    }
 }
 
 void FFTOceanSurface::update( unsigned int frame, const double& dt, const osg::Vec3f& eye )
@@ -390,81 +389,455 @@ void FFTOceanSurface::update( unsigned int frame, const double& dt, const osg::V
 
         getStateSet()->getUniform("osgOcean_NoiseCoords0")->set( computeNoiseCoords( 32.f, osg::Vec2f( 2.f, 4.f), 2.f, time ) );
         getStateSet()->getUniform("osgOcean_NoiseCoords1")->set( computeNoiseCoords( 8.f,  osg::Vec2f(-4.f, 2.f), 1.f, time ) );
+    }
 
-        if( updateMipmaps( eye, frame ) )
-        {
-            computeVertices( frame );
-            computePrimitives();
-        }
-        else if( frame != _oldFrame )
+    // Views are updated when paused too, so their detail follows the cameras.
+    {
+        OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_viewDataMapMutex);
+
+        ViewDataMap::iterator itr = _viewDataMap.begin();
+
+        while( itr != _viewDataMap.end() )
         {
-            computeVertices( frame );
+            // Drop the views whose cameras have gone.
+            if( !itr->second->_camera.valid() )
+            {
+                _viewDataMap.erase( itr++ );
+                continue;
+            }
+
+            if( itr->second->_isBuilt )
+                updateView( *itr->second, frame );
+
+            ++itr;
         }
     }
 
     _oldFrame = frame;
 }
 
-float FFTOceanSurface::getSurfaceHeightAt(float x, float y, osg::Vec3f* normal)
+void FFTOceanSurface::cullView( osgUtil::CullVisitor& cv, bool lodEye, float projectionScale, bool drawing )
 {
-    if(_isDirty)
-        build();
+    if( _isDirty || _mipmapData.empty() )
+        return;
+
+    ViewData* view = getViewData( cv );
+
+    // OceanScene culls the surface for the view's own camera ahead of the 
+    // reflection and refraction passes, so the first eye is the view's.
+    if( lodEye && !view->_hasEye )
+    {
+        view->_eye = cv.getEyePoint();
+        view->_hasEye = true;
+    }
+
+    view->_frusta.push_back( cv.getCurrentCullingSet().getFrustum() );
+    view->_projectionScale = osg::maximum( view->_projectionScale, projectionScale );
+
+    if( !drawing )
+        return;
+
+    if( !view->_isBuilt )
+    {
+        if( !view->_hasEye )
+            view->_eye = cv.getEyePoint();
+
+        buildView( *view );
+    }
+
+    view->_geode->accept( cv );
+}
+
+FFTOceanSurface::ViewData* FFTOceanSurface::getViewData( osgUtil::CullVisitor& cv )
+{
+    // The root render stage's camera is the view's, also during the RTT passes.
+    osg::Camera* camera = cv.getRenderStage()->getCamera();
+
+    OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_viewDataMapMutex);
+
+    osg::ref_ptr<ViewData>& view = _viewDataMap[ camera ];
+
+    if( !view.valid() || view->_camera.get() != camera )
+    {
+        view = new ViewData;
+        view->_camera = camera;
+        view->_startPos = _startPos;
+    }
+
+    return view.get();
+}
+
+osg::BoundingSphere FFTOceanSurface::computeBound( void ) const
+{
+    float size = float(_numTiles*_tileResolution);
+    float pad = _maxDisplacement;
+    float height = osg::maximum( _maxHeight, 0.f ) + 1.f;
+
+    // New views start at _startPos and only move in the update traversal.
+    std::vector<osg::Vec2f> starts( 1, _startPos );
 
-    // Initialize normal so it's in a "known" state if we can't calculate it later.
-    if (normal != 0)
     {
-        normal->set(0, 0, 1);
+        OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_viewDataMapMutex);
+
+        for( ViewDataMap::const_iterator itr = _viewDataMap.begin(); itr != _viewDataMap.end(); ++itr )
+            starts.push_back( itr->second->_startPos );
     }
 
-    // ocean surface coordinates
-    float oceanX, oceanY;
+    osg::BoundingBox bound;
+
+    for( unsigned int i = 0; i < starts.size(); ++i )
+    {
+        const osg::Vec2f& start = starts[i];
+
+        // The far-field ring reaches out from the centre of the tiles.
+        float extent = osg::maximum( 0.5f*size, _farFieldDistance ) + pad;
+        osg::Vec2f centre( start.x() + 0.5f*size, start.y() - 0.5f*size );
+
+        bound.expandBy( osg::Vec3f( centre.x()-extent, centre.y()-extent, -height ) );
+        bound.expandBy( osg::Vec3f( centre.x()+extent, centre.y()+extent,  height ) );
+    }
+
+    return osg::BoundingSphere( bound );
+}
+
+void FFTOceanSurface::resizeGLObjectBuffers( unsigned int maxSize )
+{
+    FFTOceanTechnique::resizeGLObjectBuffers( maxSize );
+
+    OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_viewDataMapMutex);
+
+    for( ViewDataMap::iterator itr = _viewDataMap.begin(); itr != _viewDataMap.end(); ++itr )
+        itr->second->_geode->resizeGLObjectBuffers( maxSize );
+}
+
+void FFTOceanSurface::releaseGLObjects( osg::State* state ) const
+{
+    FFTOceanTechnique::releaseGLObjects( state );
+
+    OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_viewDataMapMutex);
+
+    for( ViewDataMap::const_iterator itr = _viewDataMap.begin(); itr != _viewDataMap.end(); ++itr )
+        itr->second->_geode->releaseGLObjects( state );
+}
+
+void FFTOceanSurface::buildView( ViewData& view )
+{
+    osg::notify(osg::INFO) << "FFTOceanSurface::buildView()" << std::endl;
+
+    createOceanTiles( view );
+    updateViewDistances( view );
+
+    // Nothing has been culled against yet, so every tile is visible.
+    updateMipmaps( view );
+    updateVisibility( view );
+    computeVertices( view, _oldFrame );
+    computePrimitives( view );
+    updateFarField( view, _oldFrame );
+
+    view._frame = _oldFrame;
+    view._isBuilt = true;
+}
+
+void FFTOceanSurface::updateView( ViewData& view, unsigned int frame )
+{
+    // Views not culled since the last update are left as they were drawn.
+    if( view._frusta.empty() )
+        return;
 
-    // translate x, y to oceanSurface origin coordinates
-    oceanX = -_startPos.x() + x;
-    oceanY =  _startPos.y() - y;
+    view._viewFrusta.swap( view._frusta );
+    view._frusta.clear();
 
-    // calculate the corresponding tile on the ocean surface
-    unsigned int ix = oceanX/_tileResolution;
-    unsigned int iy = oceanY/_tileResolution;
+    updateViewDistances( view );
 
-    unsigned int frame = _oldFrame;
+    osg::Vec2f startPos = view._startPos;
 
-    // Test if the tile is valid 
-    if (ix < _numTiles && iy < _numTiles)
+    bool levelsChanged = updateMipmaps( view );
+
+    if( view._startPos != startPos )
+        dirtyBound();
+
+    bool visibilityChanged = updateVisibility( view );
+
+    if( levelsChanged || visibilityChanged )
+    {
+        computeVertices( view, frame );
+        computePrimitives( view );
+        updateFarField( view, frame );
+    }
+    else if( frame != view._frame )
     {
-        const OceanTile& data = _mipmapData[_oldFrame][0];
+        computeVertices( view, frame );
+        updateFarField( view, frame );
+    }
 
-        float tile_x = oceanX - ix * _tileResolution;
-        float tile_y = oceanY - iy * _tileResolution;
+    view._frame = frame;
+    view._hasEye = false;
+    view._projectionScale = 0.f;
+}
 
-        if (normal != 0)
+void FFTOceanSurface::updateViewDistances( ViewData& view )
+{
+    if( !_useScreenSpaceError || _levelErrors.size() != _numLevels )
+    {
+        view._minDist = _minDist;
+        return;
+    }
+
+    float C = view._projectionScale > 0.f ? view._projectionScale / ( 2.f * _THRESHOLD ) : _C;
+
+    // Small changes aren't worth moving the level boundaries for.
+    if( view._minDist.size() != _numLevels || fabs( C - view._C ) > view._C * 0.01f )
+    {
+        view._C = C;
+        computeMinDistances( C, view._minDist );
+    }
+}
+
+void FFTOceanSurface::updateFarField( ViewData& view, unsigned int frame )
+{
+    osg::Vec2f halfSize( 0.5f*float(_numTiles*_tileResolution), 0.5f*float(_numTiles*_tileResolution) );
+
+    // Nothing to draw unless the far-field reaches beyond the tiles.
+    if( _farFieldDistance <= halfSize.x() )
+    {
+        if( view._farField.valid() )
+        {
+            view._geode->removeDrawable( view._farField.get() );
+            view._farField = NULL;
+        }
+        return;
+    }
+
+    std::vector<unsigned int> levels;
+    levels.reserve( _numTiles*4 );
+
+    for( unsigned int i = 0; i < _numTiles; ++i )
+    {
+        levels.push_back( getTile(view,0,i)->getLevel() );
+        levels.push_back( getTile(view,i,_numTiles-1)->getLevel() );
+        levels.push_back( getTile(view,_numTiles-1,i)->getLevel() );
+        levels.push_back( getTile(view,i,0)->getLevel() );
+    }
+
+    bool rebuild = !view._farField.valid() 
+        || levels != view._farFieldLevels 
+        || view._farFieldStartPos != view._startPos 
+        || view._farFieldDistance != _farFieldDistance;
+
+    if( !rebuild && frame == view._farFieldFrame )
+        return;
+
+    // Inner edge, counter clockwise from the top left corner: down the left column, 
+    // along the bottom row, up the right column and back along the top row.
+    // Each side is walked from corner to corner and its end left to the next side.
+    std::vector<osg::Vec3f> vertices;
+    std::vector<osg::Vec3f> normals;
+    std::vector<bool> corners;
+
+    for( unsigned int side = 0; side < 4; ++side )
+    {
+        std::vector<osg::Vec3f> sideVertices;
+        std::vector<osg::Vec3f> sideNormals;
+        std::vector<bool> sideCorners;
+
+        for( unsigned int i = 0; i < _numTiles; ++i )
+        {
+            switch( side )
+            {
+            case 0: getTileEdge( view, frame, 0, i,           true,  false, sideVertices, sideNormals, sideCorners ); break;
+            case 1: getTileEdge( view, frame, i, _numTiles-1, false, true,  sideVertices, sideNormals, sideCorners ); break;
+            case 2: getTileEdge( view, frame, _numTiles-1, i, true,  true,  sideVertices, sideNormals, sideCorners ); break;
+            case 3: getTileEdge( view, frame, i, 0,           false, false, sideVertices, sideNormals, sideCorners ); break;
+            }
+        }
+
+        // The right column and top row are walked against the tiles' order.
+        if( side > 1 )
+        {
+            std::reverse( sideVertices.begin(), sideVertices.end() );
+            std::reverse( sideNormals.begin(),  sideNormals.end() );
+            std::reverse( sideCorners.begin(),  sideCorners.end() );
+            sideCorners.back() = false;
+            sideCorners.front() = true;
+        }
+
+        vertices.insert( vertices.end(), sideVertices.begin(), sideVertices.end()-1 );
+        normals.insert ( normals.end(),  sideNormals.begin(),  sideNormals.end()-1 );
+        corners.insert ( corners.end(),  sideCorners.begin(),  sideCorners.end()-1 );
+    }
+
+    unsigned int numInner = vertices.size();
+
+    std::vector<unsigned int> cornerIdx;
+
+    for( unsigned int i = 0; i < numInner; ++i )
+    {
+        if( corners[i] )
+            cornerIdx.push_back( i );
+    }
+
+    // Tile corners in the same order, before displacement.
+    const float res = float(_tileResolution);
+    const osg::Vec2f& start = view._startPos;
+
+    std::vector<osg::Vec2f> border;
+    border.reserve( _numTiles*4 );
+
+    for( unsigned int i = 0; i < _numTiles; ++i ) border.push_back( osg::Vec2f( start.x(),                     start.y() - i*res ) );
+    for( unsigned int i = 0; i < _numTiles; ++i ) border.push_back( osg::Vec2f( start.x() + i*res,            start.y() - _numTiles*res ) );
+    for( unsigned int i = 0; i < _numTiles; ++i ) border.push_back( osg::Vec2f( start.x() + _numTiles*res,    start.y() - (_numTiles-i)*res ) );
+    for( unsigned int i = 0; i < _numTiles; ++i ) border.push_back( osg::Vec2f( start.x() + (_numTiles-i)*res, start.y() ) );
+
+    // Rings of the tile corners scaled out from the centre, doubling in size out to the far-field distance.
+    osg::Vec2f centre( start.x() + halfSize.x(), start.y() - halfSize.y() );
+
+    float maxScale = _farFieldDistance / halfSize.x();
+    unsigned int numRings = (unsigned int)ceilf( logf(maxScale) / logf(2.f) );
+    numRings = osg::maximum( numRings, 1u );
+
+    float scale = 1.f;
+
+    for( unsigned int ring = 0; ring < numRings; ++ring )
+    {
+        scale = osg::minimum( scale*2.f, maxScale );
+
+        for( unsigned int k = 0; k < border.size(); ++k )
+        {
+            osg::Vec2f pos = centre + ( border[k] - centre ) * scale;
+            vertices.push_back( osg::Vec3f( pos.x(), pos.y(), 0.f ) );
+            normals.push_back( osg::Vec3f( 0.f, 0.f, 1.f ) );
+        }
+    }
+
+    if( !view._farField.valid() )
+    {
+        osg::ref_ptr<osg::Vec4Array> colours = new osg::Vec4Array;
+        colours->push_back( osg::Vec4f(1.f, 1.f,1.f,1.f) );
+
+        view._farField = new osg::Geometry;
+        view._farField->setUseDisplayList( false );
+        view._farField->setUseVertexBufferObjects( true );
+        view._farField->setDataVariance( osg::Object::DYNAMIC );
+        view._farField->setVertexArray( new osg::Vec3Array );
+        view._farField->setNormalArray( new osg::Vec3Array );
+        view._farField->setColorArray( colours.get() );
+        view._farField->setNormalBinding( osg::Geometry::BIND_PER_VERTEX );
+        view._farField->setColorBinding( osg::Geometry::BIND_OVERALL );
+
+        view._geode->addDrawable( view._farField.get() );
+    }
+
+    osg::Vec3Array* farVertices = static_cast<osg::Vec3Array*>( view._farField->getVertexArray() );
+    osg::Vec3Array* farNormals  = static_cast<osg::Vec3Array*>( view._farField->getNormalArray() );
+
+    farVertices->assign( vertices.begin(), vertices.end() );
+    farNormals->assign( normals.begin(), normals.end() );
+    farVertices->dirty();
+    farNormals->dirty();
+
+    view._farField->dirtyBound();
+
+    if( rebuild )
+    {
+        unsigned int numBorder = border.size();
+
+        std::vector<GLuint> triangles;
+
+        for( unsigned int k = 0; k < numBorder; ++k )
         {
-            *normal = data.normalBiLinearInterp(tile_x, tile_y);
+            unsigned int next  = (k+1) % numBorder;
+            unsigned int end   = next == 0 ? numInner : cornerIdx[next];
+            unsigned int outer = numInner + k;
+            unsigned int outerNext = numInner + next;
+
+            // Fan the border tile's edge vertices to the ring, so it joins at any level.
+            for( unsigned int i = cornerIdx[k]; i < end; ++i )
+            {
+                triangles.push_back( i );
+                triangles.push_back( outerNext );
+                triangles.push_back( (i+1) % numInner );
+            }
+
+            triangles.push_back( cornerIdx[k] );
+            triangles.push_back( outer );
+            triangles.push_back( outerNext );
+
+            for( unsigned int ring = 1; ring < numRings; ++ring )
+            {
+                unsigned int i0 = outer     + (ring-1)*numBorder;
+                unsigned int i1 = outerNext + (ring-1)*numBorder;
+                unsigned int i2 = outer     +  ring   *numBorder;
+                unsigned int i3 = outerNext +  ring   *numBorder;
+
+                triangles.push_back(i0); triangles.push_back(i2); triangles.push_back(i3);
+                triangles.push_back(i0); triangles.push_back(i3); triangles.push_back(i1);
+            }
         }
 
-        return data.biLinearInterp(tile_x, tile_y);
+        if( view._farField->getNumPrimitiveSets() > 0 )
+            view._farField->removePrimitiveSet( 0, view._farField->getNumPrimitiveSets() );
+
+        view._farField->addPrimitiveSet( IndexUtils::createDrawElements( osg::PrimitiveSet::TRIANGLES, triangles ) );
+
+        view._farFieldLevels.swap( levels );
+        view._farFieldStartPos = view._startPos;
+        view._farFieldDistance = _farFieldDistance;
+    }
+
+    view._farFieldFrame = frame;
+}
+
+void FFTOceanSurface::getTileEdge( ViewData& view, unsigned int frame, unsigned int x, unsigned int y, bool column, bool last,
+                                   std::vector<osg::Vec3f>& vertices, std::vector<osg::Vec3f>& normals, std::vector<bool>& corners )
+{
+    MipmapGeometry* tile = getTile(view,x,y);
+
+    const OceanTile& data = _mipmapData[frame][ tile->getLevel() ];
+
+    osg::Vec3f tileOffset( view._startPos.x() + x*_tileResolution, view._startPos.y() - y*_tileResolution, 0.f );
+
+    unsigned int length = column ? tile->getColLen() : tile->getRowLen();
+    unsigned int fixed  = last ? ( column ? tile->getRowLen() : tile->getColLen() ) - 1 : 0;
+
+    for( unsigned int i = 0; i < length; ++i )
+    {
+        unsigned int col = column ? fixed : i;
+        unsigned int row = column ? i : fixed;
+
+        osg::Vec3f vertexOffset( data.getSpacing()*float(col), data.getSpacing()*-float(row), 0.f );
+
+        vertices.push_back( data.getVertex(col,row) + vertexOffset + tileOffset );
+        normals.push_back( data.getNormal(col,row) );
+        corners.push_back( i == 0 );
     }
+}
 
-    return 0.0f;
+float FFTOceanSurface::getSurfaceHeightAt(float x, float y, osg::Vec3f* normal)
+{
+    if(_isDirty)
+        build();
+
+    return getTileHeightAt( _mipmapData[_oldFrame][0], x, y, normal );
 }
 
-bool FFTOceanSurface::updateMipmaps( const osg::Vec3f& eye, unsigned int frame )
+bool FFTOceanSurface::updateMipmaps( ViewData& view )
 {
-    static unsigned int count = 0;
+    const osg::Vec3f& eye = view._eye;
 
     bool updated = false;
 
-    _newNumVertices = 0;
+    view._newNumVertices = 0;
 
-    int tileSize = _tileResolution+1;
+    // Move by whole tiles only so the wave pattern stays fixed in the world.
+    int tileSize = _tileResolution;
 
     int x_offset = 0;
     int y_offset = 0;
 
     if(_isEndless)
     {
-        float xMin = _startPos.x();
-        float yMin = _startPos.y() - (float)((_tileResolution+1)*_numTiles);
+        float xMin = view._startPos.x();
+        float yMin = view._startPos.y() - (float)(_tileResolution*_numTiles);
 
         x_offset = (int) ( (eye.x()-xMin) / (float)_tileResolution );
         y_offset = (int) ( (eye.y()-yMin) / (float)_tileResolution );
@@ -472,36 +845,51 @@ bool FFTOceanSurface::updateMipmaps( const osg::Vec3f& eye, unsigned int frame )
         x_offset -= _numTiles/2;
         y_offset -= _numTiles/2;
 
-        _startPos.x() += (float)(x_offset * tileSize); 
-        _startPos.y() += (float)(y_offset * tileSize); 
+        view._startPos.x() += (float)(x_offset * tileSize); 
+        view._startPos.y() += (float)(y_offset * tileSize); 
     }
 
+    std::vector<unsigned int> levels( _numTiles*_numTiles );
+    std::vector<float> distances( _numTiles*_numTiles );
+
     for( unsigned int y = 0; y < _numTiles; ++y)
     {
         for( unsigned int x = 0; x < _numTiles; ++x)
         {
-            osg::Vec3f newbound = getTile(x,y)->getBound().center();
-            newbound.x() += (float)(x_offset * tileSize);
-            newbound.y() += (float)(y_offset * tileSize);
+            // Centre from the tile's position, culled tiles have no geometry to bound.
+            osg::Vec3f centre( view._startPos.x() + ((float)x + 0.5f) * (float)tileSize, 
+                               view._startPos.y() - ((float)y + 0.5f) * (float)tileSize, 
+                               0.f );
 
-            osg::Vec3f distanceToTile = newbound - eye;
-            
-            unsigned int mipmapLevel = 0;
+            distances[x + y*_numTiles] = (centre - eye).length2();
 
-            for( unsigned int m = 0; m < _minDist.size(); ++m )
-            {
-                if( distanceToTile.length2() > _minDist.at(m) )
-                    mipmapLevel = m;
-            }
+            // Tiles stay in place as the surface moves, so start from the level of 
+            // the tile that was covering this area (or the nearest edge tile).
+            int oldX = osg::clampBetween( (int)x + x_offset, 0, (int)_numTiles-1 );
+            int oldY = osg::clampBetween( (int)y - y_offset, 0, (int)_numTiles-1 );
+
+            // New tiles take their levels straight away.
+            levels[x + y*_numTiles] = view._levelsSelected ? getTile(view,oldX,oldY)->getLevel() : ~0u;
+        }
+    }
+
+    updateTileLevels( levels, distances, view._minDist );
+    view._levelsSelected = true;
+
+    for( unsigned int y = 0; y < _numTiles; ++y)
+    {
+        for( unsigned int x = 0; x < _numTiles; ++x)
+        {
+            unsigned int mipmapLevel = levels[x + y*_numTiles];
 
-            if( getTile(x,y)->getLevel() != mipmapLevel )
+            if( getTile(view,x,y)->getLevel() != mipmapLevel )
                 updated = true;
 
-            getTile(x,y)->setLevel( mipmapLevel );
-            getTile(x,y)->setIdx( _newNumVertices );
+            getTile(view,x,y)->setLevel( mipmapLevel );
+            getTile(view,x,y)->setIdx( view._newNumVertices );
             
             unsigned int verts = 0;
-            unsigned int size = getTile(x,y)->getResolution();
+            unsigned int size = getTile(view,x,y)->getResolution();
 
             verts = size * size;
 
@@ -512,14 +900,64 @@ bool FFTOceanSurface::updateMipmaps( const osg::Vec3f& eye, unsigned int frame )
             if(x == _numTiles-1 && y == _numTiles-1)
                 verts += 1;
 
-            _newNumVertices += verts;
+            view._newNumVertices += verts;
         }
     }
 
     return updated;    
 }
 
-void FFTOceanSurface::computePrimitives( void )
+bool FFTOceanSurface::updateVisibility( ViewData& view )
+{
+    bool updated = false;
+
+    // Pad the tiles by the wave height and choppy displacement, plus a margin
+    // as the frusta are those of the previous frame's views.
+    float res = (float)_tileResolution;
+    float pad = _maxDisplacement + res * 0.25f;
+    float height = osg::maximum( _maxHeight, 0.f ) + 1.f;
+
+    for( unsigned int y = 0; y < _numTiles; ++y )
+    {
+        for( unsigned int x = 0; x < _numTiles; ++x )
+        {
+            float xMin = view._startPos.x() + float(x)*res;
+            float yMax = view._startPos.y() - float(y)*res;
+
+            osg::BoundingBox bound( xMin-pad,     yMax-res-pad, -height, 
+                                    xMin+res+pad, yMax+pad,      height );
+
+            bool visible = isTileVisible( bound, view._eye, view._viewFrusta );
+
+            if( view._tileVisible[x + y*_numTiles] != visible )
+            {
+                view._tileVisible[x + y*_numTiles] = visible;
+                updated = true;
+            }
+        }
+    }
+
+    for( unsigned int y = 0; y < _numTiles; ++y )
+    {
+        for( unsigned int x = 0; x < _numTiles; ++x )
+        {
+            bool needed = view._tileVisible[x + y*_numTiles]
+                || ( x > 0          && view._tileVisible[x-1 +  y   *_numTiles] )
+                || ( y > 0          && view._tileVisible[x   + (y-1)*_numTiles] )
+                || ( x > 0 && y > 0 && view._tileVisible[x-1 + (y-1)*_numTiles] );
+
+            if( view._tileNeeded[x + y*_numTiles] != needed )
+            {
+                view._tileNeeded[x + y*_numTiles] = needed;
+                updated = true;
+            }
+        }
+    }
+
+    return updated;
+}
+
+void FFTOceanSurface::computePrimitives( ViewData& view )
 {
     int x1 = 0;
     int y1 = 0;
@@ -535,18 +973,22 @@ void FFTOceanSurface::computePrimitives( void )
 
         for(unsigned int x = 0; x < _numTiles; ++x )
         {
-            osg::notify(osg::DEBUG_INFO) <<getTile(x,y)->getLevel() << " ";
+            osg::notify(osg::DEBUG_INFO) <<getTile(view,x,y)->getLevel() << " ";
             
             x+1 > _numTiles-1 ? x1 = _numTiles-1 : x1 = x+1;
             y+1 > _numTiles-1 ? y1 = _numTiles-1 : y1 = y+1;
 
-            MipmapGeometry* cTile  = getTile(x, y);    // Current tile
-            MipmapGeometry* xTile  = getTile(x1,y);    // Right Tile
-            MipmapGeometry* yTile  = getTile(x, y1);   // Bottom Tile
-            MipmapGeometry* xyTile = getTile(x1,y1);   // Bottom right Tile
+            MipmapGeometry* cTile  = getTile(view, x, y);    // Current tile
+            MipmapGeometry* xTile  = getTile(view, x1,y);    // Right Tile
+            MipmapGeometry* yTile  = getTile(view, x, y1);   // Bottom Tile
+            MipmapGeometry* xyTile = getTile(view, x1,y1);   // Bottom right Tile
 
-            // First clear old primitive sets
-            cTile->removePrimitiveSet(0, cTile->getNumPrimitiveSets() );
+            // Triangles only need rebuilding if this tile or one of the 
+            // neighbours it stitches to has changed level or moved in the array.
+            if( !cTile->updateNeighbourhood( xTile, yTile, xyTile ) )
+                continue;
+
+            cTile->clearTriangles();
 
             if(cTile->getResolution()!=1)
             {
@@ -567,42 +1009,23 @@ void FFTOceanSurface::computePrimitives( void )
                 else
                     addMaxDistEdge(cTile,xTile,yTile);
             }
+
+            cTile->finishTriangles();
         }
     }
 
     // Make sure the bounds are updated now that we've changed the topology.
-    dirtyBound();
+    view._geode->dirtyBound();
 }
 
 void FFTOceanSurface::addMainBody( MipmapGeometry* cTile )
 {
-    unsigned int degenX = cTile->getRowLen()-1;
-    unsigned int degenY = cTile->getColLen()-1;
-
-    unsigned int numDegens = (cTile->getColLen()-1)*2-2;
-    unsigned int stripSize = (cTile->getRowLen()*2)*(cTile->getColLen()-1) + numDegens;
-    unsigned int i = 0;
-
-    // Generate 1 tristrip using degen triangles
-    osg::DrawElementsUInt* strip = new osg::DrawElementsUInt( osg::PrimitiveSet::TRIANGLE_STRIP, stripSize );
-
-    for( unsigned int row = 0; row < cTile->getColLen()-1; ++row )
-    {
-        for( unsigned int col = 0; col < cTile->getRowLen(); ++col )
-        {
-            (*strip)[i]   = cTile->getIndex( col, row   );
-            (*strip)[i+1] = cTile->getIndex( col, row+1 );
-            i+=2;
+    // The main body only depends on the tile's size, so its cache ordered
+    // triangles are built once and offset to the tile's vertices.
+    const std::vector<GLuint>& triangles = 
+        IndexUtils::getGridTriangles( cTile->getRowLen(), cTile->getColLen(), 1, cTile->getRowLen() );
 
-            if( col == degenX && row+1 != degenY )
-            {
-                (*strip)[i]   = cTile->getIndex( col, row+1 );
-                (*strip)[i+1] = cTile->getIndex( 0,   row+1 );
-                i+=2;
-            }
-        }
-    }
-    cTile->addPrimitiveSet( strip );
+    cTile->addTriangles( triangles, cTile->getIdx() );
 }
 
 void FFTOceanSurface::addMaxDistEdge(  MipmapGeometry* cTile, MipmapGeometry* xTile, MipmapGeometry* yTile )
@@ -616,7 +1039,7 @@ void FFTOceanSurface::addMaxDistEdge(  MipmapGeometry* cTile, MipmapGeometry* xT
         (*strip)[2] = cTile->getIndex ( 1, 0 );
         (*strip)[3] = yTile->getIndex ( 1, 0 );
 
-        cTile->addPrimitiveSet( strip );
+        cTile->addTriangles( strip );
     }
     else if( cTile->getBorder() == MipmapGeometry::BORDER_Y )
     {
@@ -627,7 +1050,7 @@ void FFTOceanSurface::addMaxDistEdge(  MipmapGeometry* cTile, MipmapGeometry* xT
         (*strip)[2] = xTile->getIndex ( 0, 0 );
         (*strip)[3] = xTile->getIndex ( 0, 1 );
 
-        cTile->addPrimitiveSet( strip );
+        cTile->addTriangles( strip );
     }
     else if( cTile->getBorder() == MipmapGeometry::BORDER_XY )
     {
@@ -638,7 +1061,7 @@ void FFTOceanSurface::addMaxDistEdge(  MipmapGeometry* cTile, MipmapGeometry* xT
         (*strip)[2] = cTile->getIndex ( 1, 0 );
         (*strip)[3] = cTile->getIndex ( 1, 1 );
 
-        cTile->addPrimitiveSet( strip );
+        cTile->addTriangles( strip );
     }
 }
 
@@ -657,7 +1080,7 @@ void FFTOceanSurface::addMaxDistMainBody(  MipmapGeometry* cTile, MipmapGeometry
         (*strip)[2] = xTile->getIndex ( 0, 0 );
         (*strip)[3] = xyTile->getIndex( 0, 0 );
         
-        cTile->addPrimitiveSet( strip );
+        cTile->addTriangles( strip );
     }
     // high res below same res right
     else if( x_points == 1 && y_points == 2 )
@@ -670,7 +1093,7 @@ void FFTOceanSurface::addMaxDistMainBody(  MipmapGeometry* cTile, MipmapGeometry
         (*fan)[3] = yTile->getIndex ( 1, 0 );
         (*fan)[4] = xyTile->getIndex( 0, 0 );
 
-        cTile->addPrimitiveSet( fan );
+        cTile->addTriangles( fan );
     }
     // same res below high res below
     else if( x_points == 2 && y_points == 1 )
@@ -683,7 +1106,7 @@ void FFTOceanSurface::addMaxDistMainBody(  MipmapGeometry* cTile, MipmapGeometry
         (*fan)[3] = xTile->getIndex ( 0, 1 );
         (*fan)[4] = xTile->getIndex ( 0, 0 );
 
-        cTile->addPrimitiveSet( fan );
+        cTile->addTriangles( fan );
     }
     // high res below and right
     else if( x_points == 2 && y_points == 2 )
@@ -697,7 +1120,7 @@ void FFTOceanSurface::addMaxDistMainBody(  MipmapGeometry* cTile, MipmapGeometry
         (*fan)[4] = xTile->getIndex ( 0, 1 );
         (*fan)[5] = xTile->getIndex ( 0, 0 );
 
-        cTile->addPrimitiveSet( fan );
+        cTile->addTriangles( fan );
     }
 }
 
@@ -721,7 +1144,7 @@ void FFTOceanSurface::addRightBorder( MipmapGeometry* cTile, MipmapGeometry* xTi
             (*fan)[2] = xTile->getIndex( 0,      r   );        
             (*fan)[3] = cTile->getIndex( endCol, r   );        
 
-            cTile->addPrimitiveSet( fan );
+            cTile->addTriangles( fan );
         }
     }
     // low res to the right
@@ -751,7 +1174,7 @@ void FFTOceanSurface::addRightBorder( MipmapGeometry* cTile, MipmapGeometry* xTi
 
             fan->push_back( xTile->getIndex( 0, r+1 ) );
 
-            cTile->addPrimitiveSet( fan );
+            cTile->addTriangles( fan );
         }
     }
     // high res to the right
@@ -781,7 +1204,7 @@ void FFTOceanSurface::addRightBorder( MipmapGeometry* cTile, MipmapGeometry* xTi
 
             fan->push_back( cTile->getIndex( endCol, r ) );
 
-            cTile->addPrimitiveSet( fan );
+            cTile->addTriangles( fan );
         }
     }
 }
@@ -804,7 +1227,7 @@ void FFTOceanSurface::addBottomBorder( MipmapGeometry* cTile, MipmapGeometry* yT
             i+=2;
         }
 
-        cTile->addPrimitiveSet( fan );
+        cTile->addTriangles( fan );
     }
     // lower res below
     else if( cTile->getLevel() < yTile->getLevel() )
@@ -832,7 +1255,7 @@ void FFTOceanSurface::addBottomBorder( MipmapGeometry* cTile, MipmapGeometry* yT
                 fan->push_back( cTile->getIndex( start-i, endRow ) );
             }
 
-            cTile->addPrimitiveSet( fan );
+            cTile->addTriangles( fan );
         }
     }
     // Higher res below
@@ -861,7 +1284,7 @@ void FFTOceanSurface::addBottomBorder( MipmapGeometry* cTile, MipmapGeometry* yT
                 fan->push_back( yTile->getIndex( start+i, 0 ) );
             }
 
-            cTile->addPrimitiveSet( fan );
+            cTile->addTriangles( fan );
         }
     }
 }
@@ -895,7 +1318,7 @@ void FFTOceanSurface::addCornerPatch( MipmapGeometry* cTile, MipmapGeometry* xTi
                 (*fan)[4] = xTile->getIndex ( 0,         rightSize ); // 2         3
                 (*fan)[5] = cTile->getIndex ( curSize,   curSize-1 );    
 
-                cTile->addPrimitiveSet( fan );
+                cTile->addTriangles( fan );
             }
             // same res right
             else if( x_points == 1 )
@@ -908,7 +1331,7 @@ void FFTOceanSurface::addCornerPatch( MipmapGeometry* cTile, MipmapGeometry* xTi
                 (*fan)[3] = cTile->getIndex ( curSize,   curSize   );    // 0         1
                 (*fan)[4] = cTile->getIndex ( curSize-1, curSize   );    //
 
-                cTile->addPrimitiveSet( fan );
+                cTile->addTriangles( fan );
             }
             // high res right
             else if( x_points == 2 )
@@ -922,7 +1345,7 @@ void FFTOceanSurface::addCornerPatch( MipmapGeometry* cTile, MipmapGeometry* xTi
                 (*fan)[4] = cTile->getIndex    ( curSize,   curSize     );    // 0         1
                 (*fan)[5] = cTile->getIndex    ( curSize-1, curSize     );    
 
-                cTile->addPrimitiveSet( fan );
+                cTile->addTriangles( fan );
             }
         }
         // same res bottom
@@ -941,7 +1364,7 @@ void FFTOceanSurface::addCornerPatch( MipmapGeometry* cTile, MipmapGeometry* xTi
                 (*fan)[5] = xTile->getIndex ( 0,         rightSize );
                 (*fan)[6] = cTile->getIndex ( curSize,   curSize-1 );    
 
-                cTile->addPrimitiveSet( fan );
+                cTile->addTriangles( fan );
             }
             // same res right
             else if( x_points == 1 )
@@ -955,7 +1378,7 @@ void FFTOceanSurface::addCornerPatch( MipmapGeometry* cTile, MipmapGeometry* xTi
                 (*strip)[4] = xTile->getIndex ( 0,         rightSize );    
                 (*strip)[5] = xyTile->getIndex( 0,         0         );
 
-                cTile->addPrimitiveSet( strip );
+                cTile->addTriangles( strip );
             }
             // high res right
             else if( x_points == 2 )
@@ -970,7 +1393,7 @@ void FFTOceanSurface::addCornerPatch( MipmapGeometry* cTile, MipmapGeometry* xTi
                 (*fan)[5] = xTile->getIndex ( 0,         rightSize   );
                 (*fan)[6] = xTile->getIndex ( 0,         rightSize-1 );
 
-                cTile->addPrimitiveSet( fan );
+                cTile->addTriangles( fan );
             }
         }
         // high res bottom
@@ -988,7 +1411,7 @@ void FFTOceanSurface::addCornerPatch( MipmapGeometry* cTile, MipmapGeometry* xTi
                 (*fan)[4] = yTile->getIndex( botSize,   0         );    // 3    4    5
                 (*fan)[5] = xyTile->getIndex( 0,        0         );                    
 
-                cTile->addPrimitiveSet( fan );
+                cTile->addTriangles( fan );
             }
             // same res right
             if( x_points == 1 )
@@ -1001,7 +1424,7 @@ void FFTOceanSurface::addCornerPatch( MipmapGeometry* cTile, MipmapGeometry* xTi
                 (*fan)[3] = yTile->getIndex ( botSize,   0         );    // 2    3    4
                 (*fan)[4] = xyTile->getIndex( 0,         0         );                    
 
-                cTile->addPrimitiveSet( fan );
+                cTile->addTriangles( fan );
             }
             // high res right
             if( x_points == 2 )
@@ -1015,24 +1438,12 @@ void FFTOceanSurface::addCornerPatch( MipmapGeometry* cTile, MipmapGeometry* xTi
                 (*fan)[4] = xTile->getIndex ( 0,         rightSize   );    //
                 (*fan)[5] = xTile->getIndex ( 0,         rightSize-1 );    // 1    2    3            
 
-                cTile->addPrimitiveSet( fan );
+                cTile->addTriangles( fan );
             }
         }
     }
 }
 
-osg::Vec3f FFTOceanSurface::computeNoiseCoords(float noiseSize, const osg::Vec2f& movement, float speed, float time )
-{
-    float length = noiseSize*movement.length();
-    float totalTime = length / speed;    
-    float tileScale = _tileResInv * noiseSize;
-
-    osg::Vec2f velocity = movement * speed / length;
-    osg::Vec2f pos = velocity * fmod( time, totalTime );
-
-    return osg::Vec3f( pos, tileScale );
-}
-
 #include <osgOcean/shaders/osgOcean_ocean_surface_vert.inl>
 #include <osgOcean/shaders/osgOcean_ocean_surface_frag.inl>
 
@@ -18,14 +18,39 @@
 #include <osgOcean/FFTOceanSurfaceVBO>
 #include <osgOcean/ShaderManager>
 #include <osg/io_utils>
-#include <osg/Material>
 #include <osg/Math>
+#include <osg/Version>
 #include <osgDB/WriteFile>
+#include <osgOcean/IndexUtils>
+
+#if OPENSCENEGRAPH_MAJOR_VERSION > 3 || \
+    (OPENSCENEGRAPH_MAJOR_VERSION == 3 && OPENSCENEGRAPH_MINOR_VERSION >= 2)
+#include <osg/VertexAttribDivisor>
+#define OSGOCEAN_INSTANCED_ARRAYS
+#endif
 
 using namespace osgOcean;
 
 #define USE_LOCAL_SHADERS 1
 
+namespace
+{
+    // Vertex attribute locations of the per instance tile data.
+    const unsigned int TILE_OFFSET_ATTRIB = 6;
+    const unsigned int TILE_STITCH_ATTRIB = 7;
+
+    // The instanced meshes are laid out once at the origin, so their bounds
+    // come entirely from the initial bound set in updateInstances().
+    class InstancedTileBoundCallback : public osg::Drawable::ComputeBoundingBoxCallback
+    {
+    public:
+        virtual osg::BoundingBox computeBound( const osg::Drawable& ) const
+        {
+            return osg::BoundingBox();
+        }
+    };
+}
+
 FFTOceanSurfaceVBO::FFTOceanSurfaceVBO( unsigned int FFTGridSize,
                                         unsigned int resolution,
                                         unsigned int numTiles, 
@@ -52,6 +77,9 @@ FFTOceanSurfaceVBO::FFTOceanSurfaceVBO( unsigned int FFTGridSize,
                         numFrames)
     ,_masterVertices ( new osg::Vec3Array )
     ,_masterNormals  ( new osg::Vec3Array )
+    ,_useResidentFrames( false )
+    ,_useVertexTextures( false )
+    ,_useInstancing  ( false )
 {
     setUserData( new OceanDataType(*this, _NUMFRAMES, 25) );
     setCullCallback( new OceanAnimationCallback );
@@ -76,7 +104,17 @@ FFTOceanSurfaceVBO::FFTOceanSurfaceVBO( const FFTOceanSurfaceVBO& copy, const os
     ,_masterVertices   ( copy._masterVertices )
     ,_masterNormals    ( copy._masterNormals )
     ,_mipmapGeom       ( copy._mipmapGeom )
+    ,_primitiveCache   ( copy._primitiveCache )
     ,_mipmapData       ( copy._mipmapData )
+    ,_useResidentFrames( copy._useResidentFrames )
+    ,_frameVertices    ( copy._frameVertices )
+    ,_frameNormals     ( copy._frameNormals )
+    ,_useVertexTextures( copy._useVertexTextures )
+    ,_displacementMap  ( copy._displacementMap )
+    ,_displacementNormals( copy._displacementNormals )
+    ,_useInstancing    ( copy._useInstancing )
+    ,_instancedTiles   ( copy._instancedTiles )
+    ,_instancedElements( copy._instancedElements )
 {}
 
 FFTOceanSurfaceVBO::~FFTOceanSurfaceVBO(void)
@@ -87,11 +125,34 @@ void FFTOceanSurfaceVBO::build( void )
 {
     osg::notify(osg::INFO) << "FFTOceanSurfaceVBO::build()" << std::endl;
 
-    computeSea( _NUMFRAMES );
+    computeFrames( _NUMFRAMES, true, _mipmapData );
+
+    if( _useScreenSpaceError )
+        computeMinDistances();
+
+    if( _useVertexTextures && !ShaderManager::instance().areShadersEnabled() )
+        osg::notify(osg::WARN) << "FFTOceanSurfaceVBO: Vertex textures require shaders, using CPU vertex updates." << std::endl;
+
+    if( _useInstancing && !useVertexTextures() )
+        osg::notify(osg::WARN) << "FFTOceanSurfaceVBO: Instancing requires vertex textures, drawing tiles individually." << std::endl;
+
+    if( useVertexTextures() )
+    {
+        createDisplacementMaps( _mipmapData, osg::Texture::NEAREST, _displacementMap, _displacementNormals );
+    }
+    else
+    {
+        _displacementMap = NULL;
+        _displacementNormals = NULL;
+    }
+
     createOceanTiles();
     updateLevels(osg::Vec3f(0.0f, 0.0f, 0.0f));
     updateVertices(0);
 
+    if( useInstancing() )
+        updateInstances();
+
     initStateSet();
 
     _isDirty =  false;
@@ -103,69 +164,32 @@ void FFTOceanSurfaceVBO::build( void )
 void FFTOceanSurfaceVBO::initStateSet( void )
 {
     osg::notify(osg::INFO) << "FFTOceanSurfaceVBO::initStateSet()" << std::endl;
-    _stateset=new osg::StateSet;
-
-    // Note that we will only set the textures in the state set if shaders are
-    // enabled, otherwise the fixed pipeline will try to put the env map onto
-    // the water surface, which has no texture coordinates, so the surface
-    // will take the general color of the env map...
-
-    // Environment map    
-    _stateset->addUniform( new osg::Uniform("osgOcean_EnvironmentMap", ENV_MAP ) );
-    if (ShaderManager::instance().areShadersEnabled())
-       _stateset->setTextureAttributeAndModes( ENV_MAP, _environmentMap.get(), osg::StateAttribute::ON
-                                                                                   | osg::StateAttribute::PROTECTED);
-    // Foam
-    _stateset->addUniform( new osg::Uniform("osgOcean_EnableCrestFoam", _useCrestFoam ) );
-    _stateset->addUniform( new osg::Uniform("osgOcean_FoamCapBottom",   _foamCapBottom ) );
-    _stateset->addUniform( new osg::Uniform("osgOcean_FoamCapTop",      _foamCapTop ) );
-    _stateset->addUniform( new osg::Uniform("osgOcean_FoamMap",         FOAM_MAP ) );
-    _stateset->addUniform( new osg::Uniform("osgOcean_FoamScale",       _tileResInv*30.f ) );
-
-    if( _useCrestFoam )
-    {
-        osg::Texture2D* foam_tex = createTexture("sea_foam.png", osg::Texture::REPEAT );
-        if (ShaderManager::instance().areShadersEnabled())
-           _stateset->setTextureAttributeAndModes( FOAM_MAP, foam_tex, osg::StateAttribute::ON |
-                                                   osg::StateAttribute::PROTECTED);
-    }
 
-    // Noise
-    _stateset->addUniform( new osg::Uniform("osgOcean_NoiseMap",     NORMAL_MAP ) );
-    _stateset->addUniform( new osg::Uniform("osgOcean_NoiseCoords0", computeNoiseCoords( 32.f, osg::Vec2f( 2.f, 4.f), 2.f, 0.f ) ) );
-    _stateset->addUniform( new osg::Uniform("osgOcean_NoiseCoords1", computeNoiseCoords( 8.f,  osg::Vec2f(-4.f, 2.f), 1.f, 0.f ) ) );
+    osg::ref_ptr<osg::Program> program = createShader();
 
-    osg::ref_ptr<osg::Texture2D> noiseMap 
-        = createNoiseMap( _noiseTileSize, _noiseWindDir, _noiseWindSpeed, _noiseWaveScale, _noiseTileRes ); 
+    initSurfaceStateSet( program.get() );
 
-    if (ShaderManager::instance().areShadersEnabled())
+    // Vertex texture displacement
+    if( useVertexTextures() )
     {
-        _stateset->setTextureAttributeAndModes( NORMAL_MAP, noiseMap.get(), osg::StateAttribute::ON |
-                                                                            osg::StateAttribute::PROTECTED);
+        _stateset->addUniform( new osg::Uniform("osgOcean_DisplacementMap",       DISPLACEMENT_MAP ) );
+        _stateset->addUniform( new osg::Uniform("osgOcean_DisplacementNormalMap", DISPLACEMENT_NORMAL_MAP ) );
+        _stateset->addUniform( new osg::Uniform("osgOcean_DisplacementCoords",    osg::Vec2f( _tileResInv, 0.5f/float(_tileSize) ) ) );
+
+        // Set every frame, so it must not be shared with a draw still in flight.
+        osg::Uniform* displacementFrame = new osg::Uniform("osgOcean_DisplacementFrame", float(_oldFrame) );
+        displacementFrame->setDataVariance( osg::Object::DYNAMIC );
+        _stateset->addUniform( displacementFrame );
+
+        // Only read by the vertex shader so no modes need enabling.
+        _stateset->setTextureAttribute( DISPLACEMENT_MAP,        _displacementMap.get(),     osg::StateAttribute::ON | osg::StateAttribute::PROTECTED );
+        _stateset->setTextureAttribute( DISPLACEMENT_NORMAL_MAP, _displacementNormals.get(), osg::StateAttribute::ON | osg::StateAttribute::PROTECTED );
     }
 
-    // Colouring
-    osg::Vec4f waveTop = colorLerp(_lightColor, osg::Vec4f(), osg::Vec4f(_waveTopColor,1.f) );
-    osg::Vec4f waveBot = colorLerp(_lightColor, osg::Vec4f(), osg::Vec4f(_waveBottomColor,1.f) );
-
-    _stateset->addUniform( new osg::Uniform("osgOcean_WaveTop", waveTop ) );
-    _stateset->addUniform( new osg::Uniform("osgOcean_WaveBot", waveBot ) );
-    _stateset->addUniform( new osg::Uniform("osgOcean_FresnelMul", _fresnelMul ) );    
-    _stateset->addUniform( new osg::Uniform("osgOcean_FrameTime", 0.0f ) );    
-
-    osg::ref_ptr<osg::Program> program = createShader();
-        
-    if(program.valid())
-        _stateset->setAttributeAndModes( program.get(), osg::StateAttribute::ON );
-
-    // If shaders are enabled, the final color will be determined by the 
-    // shader so we need a white base color. But on the fixed pipeline the
-    // material color will determine the ocean surface's color.
-    if (!ShaderManager::instance().areShadersEnabled())
+    // Instanced tiles
+    if( useInstancing() )
     {
-        osg::Material* mat = new osg::Material;
-        mat->setDiffuse(osg::Material::FRONT_AND_BACK, osg::Vec4f(_waveTopColor, 1.0f));
-        _stateset->setAttributeAndModes(mat, osg::StateAttribute::ON);
+        _stateset->addUniform( new osg::Uniform("osgOcean_TileGrid", osg::Vec2f( float(_tileSize), _pointSpacing ) ) );
     }
 
     _isStateDirty = false;
@@ -173,67 +197,6 @@ void FFTOceanSurfaceVBO::initStateSet( void )
     osg::notify(osg::INFO) << "FFTOceanSurfaceVBO::initStateSet() Complete." << std::endl;
 }
 
-osg::ref_ptr<osg::Texture2D> FFTOceanSurfaceVBO::createNoiseMap(unsigned int size, 
-                                                             const osg::Vec2f& windDir, 
-                                                             float windSpeed,                                         
-                                                             float waveScale,
-                                                             float tileResolution )
-{
-    osg::ref_ptr<osg::FloatArray> heights = new osg::FloatArray;
-
-    FFTSimulation noiseFFT(size, windDir, windSpeed, _depth, _reflDampFactor, waveScale, tileResolution, 10.f);
-    noiseFFT.setTime(0.f);
-    noiseFFT.computeHeights(heights.get());
-        
-    OceanTile oceanTile(heights.get(),size,tileResolution/size);
-
-    return oceanTile.createNormalMap();
-}
-
-void FFTOceanSurfaceVBO::computeSea( unsigned int totalFrames )
-{
-    osg::notify(osg::INFO) << "FFTOceanSurfaceVBO::computeSea("<<totalFrames<<")" << std::endl;
-    osg::notify(osg::INFO) << "Mipmap Levels: " << _numLevels << std::endl;
-    osg::notify(osg::INFO) << "Highest Resolution: " << _tileSize << std::endl;
-
-    FFTSimulation FFTSim( _tileSize, _windDirection, _windSpeed, _depth, _reflDampFactor, _waveScale, _tileResolution, _cycleTime );
-
-    // clear previous mipmaps (if any)
-    _mipmapData.clear();
-    _mipmapData.resize( totalFrames );
-
-    _averageHeight = 0.f;
-    _maxHeight = -FLT_MAX;
-
-    for( unsigned int frame = 0; frame < totalFrames; ++frame )
-    {
-        osg::ref_ptr<osg::FloatArray> heights = new osg::FloatArray;
-        osg::ref_ptr<osg::Vec2Array> displacements = NULL;
-
-        if (_isChoppy)
-            displacements = new osg::Vec2Array;
-
-        float time = _cycleTime * ( float(frame) / float(totalFrames) );
-
-        FFTSim.setTime( time );
-        FFTSim.computeHeights( heights.get() );
-
-        if(_isChoppy)
-            FFTSim.computeDisplacements( _choppyFactor, displacements.get() );
-
-        // Level 0
-        _mipmapData[frame] = OceanTile( heights.get(), _tileSize, _pointSpacing, displacements.get(), true );
-
-        _averageHeight += _mipmapData[frame].getAverageHeight();
-
-        _maxHeight = osg::maximum(_maxHeight, _mipmapData[frame].getMaximumHeight());
-    }
-    _averageHeight /= (float)totalFrames;
-
-    osg::notify(osg::INFO) << "Average Height: " << _averageHeight << std::endl;
-    osg::notify(osg::INFO) << "FFTOceanSurfaceVBO::computeSea() Complete." << std::endl;
-}
-
 void FFTOceanSurfaceVBO::createOceanTiles( void )
 {
     osg::notify(osg::INFO) << "FFTOceanSurfaceVBO::createOceanTiles()" << std::endl;
@@ -246,11 +209,15 @@ void FFTOceanSurfaceVBO::createOceanTiles( void )
 
     // Setup Vertex buffer objects
     // ------------------------------------------------------------
+    // Data is changed every frame unless the grid is displaced by vertex textures
+    // or every frame is resident.
+    GLenum usage = useVertexTextures() || useResidentFrames() ? GL_STATIC_DRAW : GL_DYNAMIC_DRAW;
+
     osg::VertexBufferObject* vertexVBO = new osg::VertexBufferObject;
-    vertexVBO->setUsage( GL_DYNAMIC_DRAW );   // data will be changed frequently (specified and used repeatedly)
+    vertexVBO->setUsage( usage );
 
     osg::VertexBufferObject* normalVBO = new osg::VertexBufferObject;
-    normalVBO->setUsage( GL_DYNAMIC_DRAW );
+    normalVBO->setUsage( usage );
 
     // reset (just in case)
     _masterVertices->clear();
@@ -259,24 +226,76 @@ void FFTOceanSurfaceVBO::createOceanTiles( void )
     _masterVertices->resize( _mipmapData[0].getNumVertices() );
     _masterNormals->resize ( _mipmapData[0].getNumVertices() );
 
-    // assign vbos to the master arrays
-    _masterVertices->setVertexBufferObject( vertexVBO );
-    _masterNormals->setVertexBufferObject( normalVBO );
+    if( useVertexTextures() )
+    {
+        // Flat grid, the vertex shader adds the displacement for the current frame.
+        unsigned int rowLen = _tileSize+1;
+
+        for( unsigned int r = 0; r < rowLen; ++r )
+        {
+            for( unsigned int c = 0; c < rowLen; ++c )
+            {
+                (*_masterVertices)[c+r*rowLen].set( float(c*_pointSpacing), -float(r*_pointSpacing), 0.f );
+                (*_masterNormals) [c+r*rowLen].set( 0.f, 0.f, 1.f );
+            }
+        }
+    }
+
+    // assign vbos to the master arrays, unless the tiles draw from the resident
+    // frames, whose buffers the unused master arrays would otherwise be packed into.
+    if( useResidentFrames() )
+    {
+        _masterVertices->setVertexBufferObject( 0 );
+        _masterNormals->setVertexBufferObject( 0 );
+    }
+    else
+    {
+        _masterVertices->setVertexBufferObject( vertexVBO );
+        _masterNormals->setVertexBufferObject( normalVBO );
+    }
+
+    _frameVertices.clear();
+    _frameNormals.clear();
+
+    // Every frame shares the same buffer objects, which OSG packs one after another
+    // into a single buffer, so a frame is selected by the offset of its arrays.
+    if( useResidentFrames() )
+    {
+        for( unsigned int frame = 0; frame < _mipmapData.size(); ++frame )
+        {
+            osg::Vec3Array* vertices = new osg::Vec3Array( *_mipmapData[frame].getVertices() );
+            osg::Vec3Array* normals  = new osg::Vec3Array( *_mipmapData[frame].getNormals() );
+
+            vertices->setVertexBufferObject( vertexVBO );
+            normals->setVertexBufferObject( normalVBO );
+
+            _frameVertices.push_back( vertices );
+            _frameNormals.push_back( normals );
+        }
+
+        osg::notify(osg::INFO) << "Resident frame buffers: " 
+            << 2 * _mipmapData.size() * _mipmapData[0].getNumVertices() * sizeof(osg::Vec3f) / 1024 << "kB" << std::endl;
+    }
 
     // Setup mipmap geometry tiles
     // ------------------------------------------------------------
 
+    // Tiles are laid out from _startPos so that the endless ocean shifts and
+    // getSurfaceHeightAt() agree on where each tile starts.
+    _startPos.set( -float( _numTiles*_tileResolution/2 ), float( _numTiles*_tileResolution/2 ) );
+
+    _primitiveCache = new MipmapPrimitiveCache;
+
     for(int y = 0; y < (int)_numTiles; ++y )
     {
         std::vector< osg::ref_ptr<osgOcean::MipmapGeometryVBO> > tileRow(_numTiles);
         for(int x = 0; x < (int)_numTiles; ++x )
         {
-            int centreX = -((int)(_numTiles*(int)_tileResolution))/2;
-            int centreY =  ((int)(_numTiles*(int)_tileResolution))/2;
-            osg::Vec3f offset( centreX+x*(int)_tileResolution, centreY-y*(int)_tileResolution, 0.f ); 
+            osg::Vec3f offset( _startPos.x()+x*(int)_tileResolution, _startPos.y()-y*(int)_tileResolution, 0.f ); 
 
             osgOcean::MipmapGeometryVBO* tile = new osgOcean::MipmapGeometryVBO( _numLevels, _tileResolution );
             tile->setOffset( offset );
+            tile->setPrimitiveCache( _primitiveCache.get() );
 
             osg::BoundingBoxf bb;
 
@@ -294,17 +313,152 @@ void FFTOceanSurfaceVBO::createOceanTiles( void )
             tileRow.at(x)=tile;
 
             // assign the master arrays to the tile geometry
-            tile->initialiseArrays( _masterVertices.get(), _masterNormals.get() );
+            if( useResidentFrames() )
+                tile->initialiseArrays( _frameVertices[0].get(), _frameNormals[0].get() );
+            else
+                tile->initialiseArrays( _masterVertices.get(), _masterNormals.get() );
 
-            addDrawable( tile );
+            // Instanced tiles only keep the per tile geometry for its level and offset.
+            if( !useInstancing() )
+                addDrawable( tile );
 
         }
         _mipmapGeom.push_back(tileRow);
     }
 
+    if( useInstancing() )
+        createInstancedTiles();
+
     return;
 }
 
+bool FFTOceanSurfaceVBO::useInstancing( void ) const
+{
+#ifdef OSGOCEAN_INSTANCED_ARRAYS
+    return _useInstancing && useVertexTextures();
+#else
+    return false;
+#endif
+}
+
+void FFTOceanSurfaceVBO::createInstancedTiles( void )
+{
+    osg::notify(osg::INFO) << "FFTOceanSurfaceVBO::createInstancedTiles()" << std::endl;
+
+    _instancedTiles.clear();
+    _instancedElements.clear();
+
+    unsigned int rowLen = _tileSize+1;
+
+    for( unsigned int level = 0; level < _numLevels; ++level )
+    {
+        // Every level indexes the same flat grid, skipping vertices as the level increases.
+        unsigned int inc = 1 << level;
+
+        unsigned int numPoints = _tileSize/inc + 1;
+
+        osg::DrawElements* triangles = 
+            IndexUtils::createDrawElements( osg::PrimitiveSet::TRIANGLES, IndexUtils::getGridTriangles( numPoints, numPoints, inc, rowLen ) );
+
+        osg::Geometry* geom = new osg::Geometry;
+        geom->setUseDisplayList( false );
+        geom->setUseVertexBufferObjects( true );
+        geom->setDataVariance( osg::Object::DYNAMIC );
+        geom->setVertexArray( _masterVertices.get() );
+        geom->setNormalArray( _masterNormals.get() );
+        geom->setNormalBinding( osg::Geometry::BIND_PER_VERTEX );
+
+        geom->setVertexAttribArray  ( TILE_OFFSET_ATTRIB, new osg::Vec4Array );
+        geom->setVertexAttribBinding( TILE_OFFSET_ATTRIB, osg::Geometry::BIND_PER_VERTEX );
+        geom->setVertexAttribArray  ( TILE_STITCH_ATTRIB, new osg::Vec4Array );
+        geom->setVertexAttribBinding( TILE_STITCH_ATTRIB, osg::Geometry::BIND_PER_VERTEX );
+
+#ifdef OSGOCEAN_INSTANCED_ARRAYS
+        // Advance the tile attributes once per instance rather than per vertex.
+        osg::StateSet* ss = geom->getOrCreateStateSet();
+        ss->setAttribute( new osg::VertexAttribDivisor( TILE_OFFSET_ATTRIB, 1 ) );
+        ss->setAttribute( new osg::VertexAttribDivisor( TILE_STITCH_ATTRIB, 1 ) );
+#endif
+
+        geom->setComputeBoundingBoxCallback( new InstancedTileBoundCallback );
+
+        _instancedTiles.push_back( geom );
+        _instancedElements.push_back( triangles );
+
+        addDrawable( geom );
+    }
+}
+
+void FFTOceanSurfaceVBO::updateInstances( void )
+{
+    std::vector< osg::BoundingBox > bounds( _numLevels );
+
+    for( unsigned int level = 0; level < _numLevels; ++level )
+    {
+        static_cast<osg::Vec4Array*>( _instancedTiles[level]->getVertexAttribArray(TILE_OFFSET_ATTRIB) )->clear();
+        static_cast<osg::Vec4Array*>( _instancedTiles[level]->getVertexAttribArray(TILE_STITCH_ATTRIB) )->clear();
+    }
+
+    int lastTile = (int)_numTiles-1;
+
+    for( int r = 0; r <= lastTile; ++r )
+    {
+        for( int c = 0; c <= lastTile; ++c )
+        {
+            MipmapGeometryVBO* tile = _mipmapGeom.at(r).at(c).get();
+
+            int level = tile->getLevel();
+
+            // Edges are drawn at the grid step of the coarser of the two tiles sharing them.
+            int left  = c > 0        ? osg::maximum( level, _mipmapGeom.at(r).at(c-1)->getLevel() ) : level;
+            int right = c < lastTile ? osg::maximum( level, _mipmapGeom.at(r).at(c+1)->getLevel() ) : level;
+            int above = r > 0        ? osg::maximum( level, _mipmapGeom.at(r-1).at(c)->getLevel() ) : level;
+            int below = r < lastTile ? osg::maximum( level, _mipmapGeom.at(r+1).at(c)->getLevel() ) : level;
+
+            osg::Geometry* geom = _instancedTiles[level].get();
+
+            static_cast<osg::Vec4Array*>( geom->getVertexAttribArray(TILE_OFFSET_ATTRIB) )->push_back( osg::Vec4f( tile->_offset, 1.f ) );
+            static_cast<osg::Vec4Array*>( geom->getVertexAttribArray(TILE_STITCH_ATTRIB) )->push_back( 
+                osg::Vec4f( float(1<<left), float(1<<right), float(1<<above), float(1<<below) ) );
+
+            bounds[level].expandBy( tile->getBound() );
+        }
+    }
+
+    for( unsigned int level = 0; level < _numLevels; ++level )
+    {
+        osg::Geometry* geom = _instancedTiles[level].get();
+        osg::DrawElements* triangles = _instancedElements[level].get();
+
+        osg::Array* offsets  = geom->getVertexAttribArray(TILE_OFFSET_ATTRIB);
+        osg::Array* stitches = geom->getVertexAttribArray(TILE_STITCH_ATTRIB);
+
+        offsets->dirty();
+        stitches->dirty();
+
+        unsigned int numInstances = offsets->getNumElements();
+
+        // A primitive set with no instances is drawn once without instancing, so remove it instead.
+        if( numInstances == 0 )
+        {
+            if( geom->getNumPrimitiveSets() > 0 )
+                geom->removePrimitiveSet( 0, geom->getNumPrimitiveSets() );
+        }
+        else
+        {
+#ifdef OSGOCEAN_INSTANCED_ARRAYS
+            triangles->setNumInstances( numInstances );
+#endif
+
+            if( geom->getNumPrimitiveSets() == 0 )
+                geom->addPrimitiveSet( triangles );
+        }
+
+        geom->setInitialBound( bounds[level] );
+        geom->dirtyBound();
+    }
+}
+
 void FFTOceanSurfaceVBO::setMinDistances( std::vector<float> &minDist )
 {
     if (_numLevels != minDist.size())
@@ -314,6 +468,10 @@ void FFTOceanSurfaceVBO::setMinDistances( std::vector<float> &minDist )
         osg::notify(osg::WARN) << "Ignoring Min Distances" << std::endl;
         return;
     }
+
+    // Fixed distances replace the screen space error metric.
+    _useScreenSpaceError = false;
+
     _minDist.clear();
 
     osg::notify(osg::INFO) << "setting Minimum Distances: " << std::endl;
@@ -335,6 +493,37 @@ void FFTOceanSurfaceVBO::updateVertices(unsigned int frame)
     startTime = osg::Timer::instance()->tick();
 #endif /*OSTOCEAN_TIMING*/
 
+    if( useVertexTextures() )
+    {
+        // All frames are already on the GPU, just select the layer.
+        osg::Uniform* frameUniform = getStateSet() ? getStateSet()->getUniform("osgOcean_DisplacementFrame") : NULL;
+
+        if( frameUniform )
+            frameUniform->set( float(frame) );
+
+        return;
+    }
+
+    if( useResidentFrames() )
+    {
+        // Already uploaded, only the array offsets the tiles draw from change.
+        osg::Vec3Array* vertices = _frameVertices[frame].get();
+        osg::Vec3Array* normals  = _frameNormals[frame].get();
+
+        for( unsigned int r = 0; r < _numTiles; ++r )
+        {
+            for( unsigned int c = 0; c < _numTiles; ++c )
+            {
+                MipmapGeometryVBO* tile = getTile(c,r);
+
+                if( tile->getVertexArray() != vertices )
+                    tile->initialiseArrays( vertices, normals );
+            }
+        }
+
+        return;
+    }
+
     osg::Vec3f tileOffset;
 
     const OceanTile& data = _mipmapData[frame];
@@ -358,6 +547,7 @@ bool FFTOceanSurfaceVBO::updateLevels(const osg::Vec3f& eye)
 {
    int x_offset = 0;
    int y_offset = 0;
+   bool moved = false;
 
    if(_isEndless)
    {
@@ -375,6 +565,7 @@ bool FFTOceanSurfaceVBO::updateLevels(const osg::Vec3f& eye)
       if(x_offset != 0 || y_offset != 0)
       {
          //std::cerr << "Surface Move." << std::endl;
+         moved = true;
          
          while ((x_offset != 0) || (y_offset != 0))
          {
@@ -460,24 +651,43 @@ bool FFTOceanSurfaceVBO::updateLevels(const osg::Vec3f& eye)
    }
    
    unsigned updates=0;
+
+   // Tiles move with the surface so they keep their own levels, new tiles (-1) are set straight away.
+   std::vector<unsigned int> levels( _numTiles*_numTiles );
+   std::vector<float> distances( _numTiles*_numTiles );
+
+   for(unsigned int r = 0; r < _numTiles; ++r )
+   {
+      for(unsigned int c = 0; c < _numTiles; ++c )
+      {
+         osgOcean::MipmapGeometryVBO* curGeom = _mipmapGeom.at(r).at(c).get();
+
+         distances[c + r*_numTiles] = (curGeom->getBound().center()-eye).length2();
+         levels[c + r*_numTiles] = (unsigned int)curGeom->getLevel();
+      }
+   }
+
+   updateTileLevels( levels, distances );
    
    for(int r = _numTiles-1; r>=0; --r )
    {
       for(int c = _numTiles-1; c>=0; --c )
       {
          osgOcean::MipmapGeometryVBO* curGeom = _mipmapGeom.at(r).at(c).get();
-         osg::Vec3f centre = curGeom->getBound().center();
-         
-         float distanceToTile2 = (centre-eye).length2();
          
-         unsigned mipmapLevel = 0;
+         unsigned mipmapLevel = levels[c + r*_numTiles];
          unsigned rightLevel  = 0;
          unsigned belowLevel  = 0;
-         
-         for( unsigned int m = 0; m < _minDist.size(); ++m )
+
+         // Instanced tiles are stitched in the vertex shader, only the level is needed.
+         if( useInstancing() )
          {
-            if( distanceToTile2 > _minDist.at(m) )
-               mipmapLevel = m;
+            if( curGeom->getLevel() != (int)mipmapLevel )
+            {
+               curGeom->setLevel( mipmapLevel );
+               updates++;
+            }
+            continue;
          }
          
          if( c != _numTiles-1 && r != _numTiles-1 ){
@@ -525,7 +735,7 @@ bool FFTOceanSurfaceVBO::updateLevels(const osg::Vec3f& eye)
    }
 #endif /*OSGOCEAN_MIPMAP*/
 
-   return updates > 0;
+   return updates > 0 || moved;
 }
 
 
@@ -555,7 +765,12 @@ void FFTOceanSurfaceVBO::update( unsigned int frame, const double& dt, const osg
         getStateSet()->getUniform("osgOcean_NoiseCoords0")->set( computeNoiseCoords( 32.f, osg::Vec2f( 2.f, 4.f), 2.f, time ) );
         getStateSet()->getUniform("osgOcean_NoiseCoords1")->set( computeNoiseCoords( 8.f,  osg::Vec2f(-4.f, 2.f), 1.f, time ) );
 
-        if( updateLevels(eye) || frame != _oldFrame )
+        bool levelsChanged = updateLevels(eye);
+
+        if( levelsChanged && useInstancing() )
+            updateInstances();
+
+        if( levelsChanged || frame != _oldFrame )
         {
             updateVertices(frame);
         } 
@@ -575,55 +790,23 @@ float FFTOceanSurfaceVBO::getSurfaceHeightAt(float x, float y, osg::Vec3f* norma
     if(_isDirty)
         build();
 
-    // Initialize normal so it's in a "known" state if we can't calculate it later.
-    if (normal != 0)
-    {
-        normal->set(0, 0, 1);
-    }
-
-    // ocean surface coordinates
-    float oceanX, oceanY;
-
-    // translate x, y to oceanSurface origin coordinates
-    oceanX = -_startPos.x() + x;
-    oceanY =  _startPos.y() - y;
-
-    // calculate the corresponding tile on the ocean surface
-    unsigned int ix = oceanX/_tileResolution;
-    unsigned int iy = oceanY/_tileResolution;
-
-    unsigned int frame = _oldFrame;
-
-    // Test if the tile is valid 
-    if (ix < _numTiles && iy < _numTiles)
-    {
-        const OceanTile& data = _mipmapData[_oldFrame];
-
-        float tile_x = oceanX - ix * (int) _tileResolution;
-        float tile_y = oceanY - iy * (int) _tileResolution;
-
-        if (normal != 0)
-        {
-            *normal = data.normalBiLinearInterp(tile_x, tile_y);
-        }
+    return getTileHeightAt( _mipmapData[_oldFrame], x, y, normal );
+}
 
-        return data.biLinearInterp(tile_x, tile_y);
-    }
+void FFTOceanSurfaceVBO::resizeGLObjectBuffers( unsigned int maxSize )
+{
+    FFTOceanTechnique::resizeGLObjectBuffers( maxSize );
 
-    return 0.0f;
+    if( _primitiveCache.valid() )
+        _primitiveCache->resizeGLObjectBuffers( maxSize );
 }
 
-
-osg::Vec3f FFTOceanSurfaceVBO::computeNoiseCoords(float noiseSize, const osg::Vec2f& movement, float speed, double time )
+void FFTOceanSurfaceVBO::releaseGLObjects( osg::State* state ) const
 {
-    float length = noiseSize*movement.length();
-    double totalTime = length / speed;    
-    float tileScale = _tileResInv * noiseSize;
+    FFTOceanTechnique::releaseGLObjects( state );
 
-    osg::Vec2f velocity = movement * speed / length;
-    osg::Vec2f pos = velocity * fmod( time, totalTime );
-
-    return osg::Vec3f( pos, tileScale );
+    if( _primitiveCache.valid() )
+        _primitiveCache->releaseGLObjects( state );
 }
 
 #include <osgOcean/shaders/osgOcean_ocean_surface_vbo_vert.inl>
@@ -634,11 +817,54 @@ osg::Program* FFTOceanSurfaceVBO::createShader(void)
     static const char osgOcean_ocean_surface_vert_file[] = "osgOcean_ocean_surface_vbo.vert";
     static const char osgOcean_ocean_surface_frag_file[] = "osgOcean_ocean_surface.frag";
 
+    // Reading the displacement texture arrays, and taking the tile position from
+    // the instance attributes, are separate programs to the plain ocean surface.
+    std::string name = "ocean_surface";
+    std::string defines;
+
+    if( useVertexTextures() )
+    {
+        name = "ocean_surface_vertex_textures";
+        defines = "#define OSGOCEAN_VERTEX_TEXTURES 1\n";
+
+        if( useInstancing() )
+        {
+            name = "ocean_surface_instanced_tiles";
+            defines += "#define OSGOCEAN_INSTANCED_TILES 1\n";
+        }
+    }
+
     osg::Program* program = 
-        ShaderManager::instance().createProgram("ocean_surface", 
+        ShaderManager::instance().createProgram(name, 
         osgOcean_ocean_surface_vert_file, osgOcean_ocean_surface_frag_file, 
         osgOcean_ocean_surface_vbo_vert,  osgOcean_ocean_surface_frag);
 
+    if( program && !defines.empty() )
+    {
+        // The shader read from file may be shared through the osgDB cache,
+        // so compile the defines into a copy rather than altering it.
+        for( unsigned int i = 0; i < program->getNumShaders(); ++i )
+        {
+            osg::ref_ptr<osg::Shader> shader = program->getShader(i);
+
+            if( shader->getType() == osg::Shader::VERTEX )
+            {
+                osg::Shader* definedShader = new osg::Shader( osg::Shader::VERTEX, defines + shader->getShaderSource() );
+                definedShader->setName( shader->getName() );
+
+                program->removeShader( shader.get() );
+                program->addShader( definedShader );
+                break;
+            }
+        }
+
+        if( useInstancing() )
+        {
+            program->addBindAttribLocation( "osgOcean_TileOffset", TILE_OFFSET_ATTRIB );
+            program->addBindAttribLocation( "osgOcean_TileStitch", TILE_STITCH_ATTRIB );
+        }
+    }
+
     return program;
 }
 
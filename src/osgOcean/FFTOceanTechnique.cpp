@@ -20,6 +20,11 @@
 #include <osg/io_utils>
 #include <osg/Material>
 #include <osg/Timer>
+#include <osg/Math>
+#include <OpenThreads/ScopedLock>
+
+#include <algorithm>
+#include <climits>
 
 using namespace osgOcean;
 
@@ -61,6 +66,8 @@ FFTOceanTechnique::FFTOceanTechnique( unsigned int FFTGridSize,
     ,_startPos       ( -float( (_tileResolution+1)*_numTiles) * 0.5f, float( (_tileResolution+1)*_numTiles) * 0.5f )
     ,_THRESHOLD      ( 3.f )
     ,_VRES           ( 1920 )
+    ,_C              ( _VRES / ( 2.f * _THRESHOLD * tan( osg::DegreesToRadians(22.5f) ) ) )
+    ,_useScreenSpaceError( true )
     ,_NUMFRAMES      ( numFrames )
     ,_waveTopColor   ( 0.192156862f, 0.32549019f, 0.36862745098f )
     ,_waveBottomColor( 0.11372549019f, 0.219607843f, 0.3568627450f )
@@ -68,7 +75,11 @@ FFTOceanTechnique::FFTOceanTechnique( unsigned int FFTGridSize,
     ,_foamCapBottom  ( 2.2f )
     ,_foamCapTop     ( 3.0f )
     ,_isStateDirty   ( true )
+    ,_lodHysteresis  ( 0.1f )
+    ,_maxLodChanges  ( 0 )
     ,_averageHeight  ( 0.f )
+    ,_maxDisplacement( 0.f )
+    ,_useTileCulling ( true )
     ,_lightColor     ( 0.411764705f, 0.54117647f, 0.6823529f, 1.f )
 {
     _stateset = new osg::StateSet;
@@ -103,8 +114,13 @@ FFTOceanTechnique::FFTOceanTechnique( const FFTOceanTechnique& copy, const osg::
     ,_startPos       ( copy._startPos )
     ,_THRESHOLD      ( copy._THRESHOLD )
     ,_VRES           ( copy._VRES )
+    ,_C              ( copy._C )
+    ,_useScreenSpaceError( copy._useScreenSpaceError )
+    ,_levelErrors    ( copy._levelErrors )
     ,_NUMFRAMES      ( copy._NUMFRAMES )
     ,_minDist        ( copy._minDist )
+    ,_lodHysteresis  ( copy._lodHysteresis )
+    ,_maxLodChanges  ( copy._maxLodChanges )
     ,_environmentMap ( copy._environmentMap )
     ,_waveTopColor   ( copy._waveTopColor )
     ,_waveBottomColor( copy._waveBottomColor )
@@ -113,6 +129,8 @@ FFTOceanTechnique::FFTOceanTechnique( const FFTOceanTechnique& copy, const osg::
     ,_foamCapTop     ( copy._foamCapTop )
     ,_isStateDirty   ( copy._isStateDirty )
     ,_averageHeight  ( copy._averageHeight )
+    ,_maxDisplacement( copy._maxDisplacement )
+    ,_useTileCulling ( copy._useTileCulling )
     ,_lightColor     ( copy._lightColor )
 {}
 
@@ -133,6 +151,447 @@ osg::Texture2D* FFTOceanTechnique::createTexture(const std::string& name, osg::T
     return tex;
 }
 
+void FFTOceanTechnique::computeFrames( unsigned int totalFrames, bool useVBO, std::vector<OceanTile>& frames )
+{
+    osg::notify(osg::INFO) << "FFTOceanTechnique::computeFrames("<<totalFrames<<")" << std::endl;
+    osg::notify(osg::INFO) << "Mipmap Levels: " << _numLevels << std::endl;
+    osg::notify(osg::INFO) << "Highest Resolution: " << _tileSize << std::endl;
+
+    FFTSimulation FFTSim( _tileSize, _windDirection, _windSpeed, _depth, _reflDampFactor, _waveScale, _tileResolution, _cycleTime );
+
+    // clear previous frames (if any)
+    frames.clear();
+    frames.resize( totalFrames );
+
+    _averageHeight = 0.f;
+    _maxHeight = -FLT_MAX;
+    _maxDisplacement = 0.f;
+    _levelErrors.assign( _numLevels, 0.f );
+
+    for( unsigned int frame = 0; frame < totalFrames; ++frame )
+    {
+        osg::ref_ptr<osg::FloatArray> heights = new osg::FloatArray;
+        osg::ref_ptr<osg::Vec2Array> displacements = NULL;
+
+        if (_isChoppy)
+            displacements = new osg::Vec2Array;
+
+        float time = _cycleTime * ( float(frame) / float(totalFrames) );
+
+        FFTSim.setTime( time );
+        FFTSim.computeHeights( heights.get() );
+
+        if(_isChoppy)
+        {
+            FFTSim.computeDisplacements( _choppyFactor, displacements.get() );
+
+            for( osg::Vec2Array::const_iterator itr = displacements->begin(); itr != displacements->end(); ++itr )
+                _maxDisplacement = osg::maximum( _maxDisplacement, itr->length() );
+        }
+
+        frames[frame] = OceanTile( heights.get(), _tileSize, _pointSpacing, displacements.get(), useVBO );
+
+        _averageHeight += frames[frame].getAverageHeight();
+
+        _maxHeight = osg::maximum(_maxHeight, frames[frame].getMaximumHeight());
+
+        computeLevelErrors( frames[frame] );
+    }
+
+    _averageHeight /= (float)totalFrames;
+
+    osg::notify(osg::INFO) << "Average Height: " << _averageHeight << std::endl;
+    osg::notify(osg::INFO) << "FFTOceanTechnique::computeFrames() Complete." << std::endl;
+}
+
+float FFTOceanTechnique::getTileHeightAt( const OceanTile& tile, float x, float y, osg::Vec3f* normal ) const
+{
+    // The surface is periodic, so any point maps onto the tile
+    // whether or not it lies inside the geometry currently being drawn.
+    osg::Vec2f tileCoords = getTileCoords( x, y );
+
+    if (normal != 0)
+    {
+        *normal = tile.normalBiLinearInterp(tileCoords.x(), tileCoords.y());
+    }
+
+    return tile.biLinearInterp(tileCoords.x(), tileCoords.y());
+}
+
+void FFTOceanTechnique::initSurfaceStateSet( osg::Program* program )
+{
+    _stateset=new osg::StateSet;
+
+    // Note that we will only set the textures in the state set if shaders are
+    // enabled, otherwise the fixed pipeline will try to put the env map onto
+    // the water surface, which has no texture coordinates, so the surface
+    // will take the general color of the env map...
+
+    // Environment map    
+    _stateset->addUniform( new osg::Uniform("osgOcean_EnvironmentMap", ENV_MAP ) );
+    if (ShaderManager::instance().areShadersEnabled())
+       _stateset->setTextureAttributeAndModes( ENV_MAP, _environmentMap.get(), osg::StateAttribute::ON
+                                                                                   | osg::StateAttribute::PROTECTED);
+    // Foam
+    _stateset->addUniform( new osg::Uniform("osgOcean_EnableCrestFoam", _useCrestFoam ) );
+    _stateset->addUniform( new osg::Uniform("osgOcean_FoamCapBottom",   _foamCapBottom ) );
+    _stateset->addUniform( new osg::Uniform("osgOcean_FoamCapTop",      _foamCapTop ) );
+    _stateset->addUniform( new osg::Uniform("osgOcean_FoamMap",         FOAM_MAP ) );
+    _stateset->addUniform( new osg::Uniform("osgOcean_FoamScale",       _tileResInv*30.f ) );
+
+    if( _useCrestFoam )
+    {
+        osg::Texture2D* foam_tex = createTexture("sea_foam.png", osg::Texture::REPEAT );
+        if (ShaderManager::instance().areShadersEnabled())
+           _stateset->setTextureAttributeAndModes( FOAM_MAP, foam_tex, osg::StateAttribute::ON |
+                                                   osg::StateAttribute::PROTECTED);
+    }
+
+    // Noise
+    _stateset->addUniform( new osg::Uniform("osgOcean_NoiseMap",     NORMAL_MAP ) );
+    _stateset->addUniform( new osg::Uniform("osgOcean_NoiseCoords0", computeNoiseCoords( 32.f, osg::Vec2f( 2.f, 4.f), 2.f, 0.f ) ) );
+    _stateset->addUniform( new osg::Uniform("osgOcean_NoiseCoords1", computeNoiseCoords( 8.f,  osg::Vec2f(-4.f, 2.f), 1.f, 0.f ) ) );
+
+    osg::ref_ptr<osg::Texture2D> noiseMap 
+        = createNoiseMap( _noiseTileSize, _noiseWindDir, _noiseWindSpeed, _noiseWaveScale, _noiseTileRes ); 
+
+    if (ShaderManager::instance().areShadersEnabled())
+    {
+        _stateset->setTextureAttributeAndModes( NORMAL_MAP, noiseMap.get(), osg::StateAttribute::ON |
+                                                                            osg::StateAttribute::PROTECTED);
+    }
+
+    // Colouring
+    osg::Vec4f waveTop = colorLerp(_lightColor, osg::Vec4f(), osg::Vec4f(_waveTopColor,1.f) );
+    osg::Vec4f waveBot = colorLerp(_lightColor, osg::Vec4f(), osg::Vec4f(_waveBottomColor,1.f) );
+
+    _stateset->addUniform( new osg::Uniform("osgOcean_WaveTop", waveTop ) );
+    _stateset->addUniform( new osg::Uniform("osgOcean_WaveBot", waveBot ) );
+    _stateset->addUniform( new osg::Uniform("osgOcean_FresnelMul", _fresnelMul ) );    
+    _stateset->addUniform( new osg::Uniform("osgOcean_FrameTime", 0.0f ) );    
+
+    if( program )
+        _stateset->setAttributeAndModes( program, osg::StateAttribute::ON );
+
+    // If shaders are enabled, the final color will be determined by the 
+    // shader so we need a white base color. But on the fixed pipeline the
+    // material color will determine the ocean surface's color.
+    if (!ShaderManager::instance().areShadersEnabled())
+    {
+        osg::Material* mat = new osg::Material;
+        mat->setDiffuse(osg::Material::FRONT_AND_BACK, osg::Vec4f(_waveTopColor, 1.0f));
+        _stateset->setAttributeAndModes(mat, osg::StateAttribute::ON);
+    }
+}
+
+osg::Vec3f FFTOceanTechnique::computeNoiseCoords( float noiseSize, const osg::Vec2f& movement, float speed, double time ) const
+{
+    float length = noiseSize*movement.length();
+    double totalTime = length / speed;    
+    float tileScale = _tileResInv * noiseSize;
+
+    osg::Vec2f velocity = movement * speed / length;
+    osg::Vec2f pos = velocity * fmod( time, totalTime );
+
+    return osg::Vec3f( pos, tileScale );
+}
+
+osg::ref_ptr<osg::Texture2D> FFTOceanTechnique::createNoiseMap( unsigned int size, 
+                                                                const osg::Vec2f& windDir, 
+                                                                float windSpeed,                                         
+                                                                float waveScale,
+                                                                float tileResolution ) const
+{
+    osg::ref_ptr<osg::FloatArray> heights = new osg::FloatArray;
+
+    FFTSimulation noiseFFT(size, windDir, windSpeed, _depth, _reflDampFactor, waveScale, tileResolution, 10.f);
+    noiseFFT.setTime(0.f);
+    noiseFFT.computeHeights(heights.get());
+        
+    OceanTile oceanTile(heights.get(),size,tileResolution/size);
+
+    return oceanTile.createNormalMap();
+}
+
+void FFTOceanTechnique::createDisplacementMaps( const std::vector<OceanTile>& frames,
+                                                osg::Texture::FilterMode filter,
+                                                osg::ref_ptr<osg::Texture2DArray>& displacementMap,
+                                                osg::ref_ptr<osg::Texture2DArray>& normalMap ) const
+{
+    osg::notify(osg::INFO) << "FFTOceanTechnique::createDisplacementMaps()" << std::endl;
+
+    unsigned int numFrames = frames.size();
+
+    displacementMap = new osg::Texture2DArray;
+    normalMap       = new osg::Texture2DArray;
+
+    osg::Texture2DArray* maps[2] = { displacementMap.get(), normalMap.get() };
+
+    for( unsigned int i = 0; i < 2; ++i )
+    {
+        maps[i]->setTextureSize( _tileSize, _tileSize, numFrames );
+        maps[i]->setInternalFormat( GL_RGBA32F_ARB );
+        maps[i]->setSourceFormat( GL_RGBA );
+        maps[i]->setSourceType( GL_FLOAT );
+        maps[i]->setFilter( osg::Texture::MIN_FILTER, filter );
+        maps[i]->setFilter( osg::Texture::MAG_FILTER, filter );
+        maps[i]->setWrap( osg::Texture::WRAP_S, osg::Texture::REPEAT );
+        maps[i]->setWrap( osg::Texture::WRAP_T, osg::Texture::REPEAT );
+        maps[i]->setUseHardwareMipMapGeneration( false );
+    }
+
+    // The tiles are periodic so only the first _tileSize rows and columns
+    // are stored, the skirt is picked up by the REPEAT wrap mode.
+    for( unsigned int frame = 0; frame < numFrames; ++frame )
+    {
+        const OceanTile& tile = frames[frame];
+
+        osg::ref_ptr<osg::Image> displacements = new osg::Image;
+        displacements->allocateImage( _tileSize, _tileSize, 1, GL_RGBA, GL_FLOAT );
+        displacements->setInternalTextureFormat( GL_RGBA32F_ARB );
+
+        osg::ref_ptr<osg::Image> normals = new osg::Image;
+        normals->allocateImage( _tileSize, _tileSize, 1, GL_RGBA, GL_FLOAT );
+        normals->setInternalTextureFormat( GL_RGBA32F_ARB );
+
+        float* d = (float*)displacements->data();
+        float* n = (float*)normals->data();
+
+        for( unsigned int y = 0; y < _tileSize; ++y )
+        {
+            for( unsigned int x = 0; x < _tileSize; ++x )
+            {
+                const osg::Vec3f& vertex = tile.getVertex(x,y);
+                const osg::Vec3f& normal = tile.getNormal(x,y);
+
+                // VBO tiles store the grid position in x,y so remove it to leave the displacement
+                *d++ = vertex.x() - float(x*_pointSpacing);
+                *d++ = vertex.y() + float(y*_pointSpacing);
+                *d++ = vertex.z();
+                *d++ = 1.f;
+
+                *n++ = normal.x();
+                *n++ = normal.y();
+                *n++ = normal.z();
+                *n++ = 0.f;
+            }
+        }
+
+        displacementMap->setImage( frame, displacements.get() );
+        normalMap->setImage( frame, normals.get() );
+    }
+
+    osg::notify(osg::INFO) << "FFTOceanTechnique::createDisplacementMaps() Complete." << std::endl;
+}
+
+void FFTOceanTechnique::computeLevelErrors( const OceanTile& tile )
+{
+    if( _levelErrors.size() != _numLevels )
+        _levelErrors.assign( _numLevels, 0.f );
+
+    for( unsigned int level = 1; level < _numLevels; ++level )
+    {
+        _levelErrors[level] = osg::maximum( _levelErrors[level], tile.computeMaxDelta( 1u << level ) );
+    }
+}
+
+void FFTOceanTechnique::computeMinDistances( void )
+{
+    computeMinDistances( _C, _minDist );
+}
+
+void FFTOceanTechnique::computeMinDistances( float C, std::vector<float>& minDist ) const
+{
+    if( _levelErrors.size() != _numLevels )
+        return;
+
+    // Neighbours along a diagonal are at most this much further from the eye.
+    float tileSpacing = float(_tileResolution) * 1.41421356f;
+
+    minDist.assign( _numLevels, 0.f );
+
+    osg::notify(osg::INFO) << "Minimum Distances (C=" << C << "): " << std::endl;
+
+    float lastDist = 0.f;
+
+    for( unsigned int level = 1; level < _numLevels; ++level )
+    {
+        float dist = osg::maximum( _levelErrors[level] * C, lastDist + tileSpacing );
+
+        minDist[level] = dist*dist;
+        lastDist = dist;
+
+        osg::notify(osg::INFO) << level << ": " << dist << std::endl;
+    }
+}
+
+void FFTOceanTechnique::updateLodConstant( float projectionScale )
+{
+    if( !_useScreenSpaceError || projectionScale <= 0.f )
+        return;
+
+    float C = projectionScale / ( 2.f * _THRESHOLD );
+
+    // Small changes aren't worth moving the level boundaries for.
+    if( fabs( C - _C ) > _C * 0.01f )
+    {
+        _C = C;
+        computeMinDistances();
+    }
+}
+
+unsigned int FFTOceanTechnique::updateTileLevels( std::vector<unsigned int>& levels, const std::vector<float>& distances ) const
+{
+    return updateTileLevels( levels, distances, _minDist );
+}
+
+unsigned int FFTOceanTechnique::updateTileLevels( std::vector<unsigned int>& levels, 
+                                                  const std::vector<float>& distances,
+                                                  const std::vector<float>& minDist ) const
+{
+    unsigned int numTiles = _numTiles*_numTiles;
+
+    if( minDist.empty() || levels.size() != numTiles || distances.size() != numTiles )
+        return 0;
+
+    unsigned int maxLevel = minDist.size()-1;
+
+    float coarsen = (1.f+_lodHysteresis) * (1.f+_lodHysteresis);
+    float refine  = (1.f-_lodHysteresis) * (1.f-_lodHysteresis);
+
+    std::vector<unsigned int> targets( numTiles );
+    std::vector< std::pair<float,unsigned int> > pending;
+
+    unsigned int changes = 0;
+
+    for( unsigned int i = 0; i < numTiles; ++i )
+    {
+        unsigned int level = 0;
+
+        if( levels[i] > maxLevel )
+        {
+            while( level < maxLevel && distances[i] > minDist[level+1] )
+                ++level;
+
+            levels[i] = level;
+            ++changes;
+        }
+        else
+        {
+            level = levels[i];
+
+            while( level < maxLevel && distances[i] > minDist[level+1] * coarsen )
+                ++level;
+
+            while( level > 0 && distances[i] <= minDist[level] * refine )
+                --level;
+        }
+
+        targets[i] = level;
+
+        if( levels[i] != level )
+            pending.push_back( std::make_pair( distances[i], i ) );
+    }
+
+    if( pending.empty() )
+        return changes;
+
+    // Nearest first, as those changes are the most noticeable.
+    std::sort( pending.begin(), pending.end() );
+
+    unsigned int budget = _maxLodChanges > 0 ? changes + _maxLodChanges : UINT_MAX;
+    bool stepped = true;
+
+    while( stepped && changes < budget )
+    {
+        stepped = false;
+
+        for( unsigned int p = 0; p < pending.size() && changes < budget; ++p )
+        {
+            unsigned int i = pending[p].second;
+
+            if( levels[i] == targets[i] )
+                continue;
+
+            int next = targets[i] > levels[i] ? (int)levels[i]+1 : (int)levels[i]-1;
+            int x = i % _numTiles;
+            int y = i / _numTiles;
+
+            bool allowed = true;
+
+            for( int ny = y-1; ny <= y+1 && allowed; ++ny )
+            {
+                for( int nx = x-1; nx <= x+1 && allowed; ++nx )
+                {
+                    if( nx < 0 || ny < 0 || nx >= (int)_numTiles || ny >= (int)_numTiles || (nx == x && ny == y) )
+                        continue;
+
+                    unsigned int n = nx + ny*_numTiles;
+
+                    int diff    = abs( next - (int)levels[n] );
+                    int limit   = osg::maximum( 1, abs( (int)targets[i] - (int)targets[n] ) );
+                    int current = abs( (int)levels[i] - (int)levels[n] );
+
+                    allowed = diff <= limit || diff < current;
+                }
+            }
+
+            if( allowed )
+            {
+                levels[i] = next;
+                ++changes;
+                stepped = true;
+            }
+        }
+    }
+
+    return changes;
+}
+
+bool FFTOceanTechnique::isTileVisible( const osg::BoundingBox& bound, const osg::Vec3f& eye )
+{
+    return isTileVisible( bound, eye, _viewFrusta );
+}
+
+bool FFTOceanTechnique::isTileVisible( const osg::BoundingBox& bound, const osg::Vec3f& eye, std::vector<osg::Polytope>& frusta ) const
+{
+    if( !_useTileCulling )
+        return true;
+
+    // No views yet (first frame or not yet culled) so nothing can be ruled out.
+    if( !frusta.empty() )
+    {
+        bool inView = false;
+
+        for( std::vector<osg::Polytope>::iterator itr = frusta.begin(); itr != frusta.end() && !inView; ++itr )
+            inView = itr->contains( bound );
+
+        if( !inView )
+            return false;
+    }
+
+    // Above the water the earth's curvature hides anything past the horizon
+    // distance of the eye plus that of the highest wave.
+    if( eye.z() > 0.f )
+    {
+        static const double EARTH_RADIUS = 6371000.0;
+
+        double eyeHeight  = eye.z();
+        double waveHeight = osg::maximum( _maxHeight, 0.f );
+
+        double horizon = sqrt( eyeHeight  * (2.0*EARTH_RADIUS + eyeHeight) )
+                       + sqrt( waveHeight * (2.0*EARTH_RADIUS + waveHeight) );
+
+        float dx = osg::maximum( osg::maximum( bound.xMin() - eye.x(), eye.x() - bound.xMax() ), 0.f );
+        float dy = osg::maximum( osg::maximum( bound.yMin() - eye.y(), eye.y() - bound.yMax() ), 0.f );
+
+        if( dx*dx + dy*dy > horizon*horizon )
+            return false;
+    }
+
+    return true;
+}
+
 float FFTOceanTechnique::getSurfaceHeightAt(float x, float y, osg::Vec3f* normal)
 {
     osg::notify(osg::INFO) << "getSurfaceHeightAt() not implemented." << std::endl;
@@ -165,6 +624,7 @@ FFTOceanTechnique::OceanDataType::OceanDataType( FFTOceanTechnique& ocean,
     ,_frame         ( 0 )
     ,_oldTime       ( 0 )
     ,_newTime       ( 0 )
+    ,_projectionScale( 0.f )
 {}
 
 FFTOceanTechnique::OceanDataType::OceanDataType( const OceanDataType& copy, const osg::CopyOp& copyop )
@@ -177,8 +637,27 @@ FFTOceanTechnique::OceanDataType::OceanDataType( const OceanDataType& copy, cons
     ,_frame         ( copy._frame )
     ,_oldTime       ( copy._oldTime )
     ,_newTime       ( copy._newTime )
+    ,_frusta        ( copy._frusta )
+    ,_projectionScale( copy._projectionScale )
 {}
 
+void FFTOceanTechnique::OceanDataType::addFrustum( const osg::Polytope& frustum )
+{
+    OpenThreads::ScopedLock<OpenThreads::Mutex> lock( _viewMutex );
+
+    _frusta.push_back( frustum );
+
+    // Test against every plane rather than those left active by the parent nodes.
+    _frusta.back().setupMask();
+}
+
+void FFTOceanTechnique::OceanDataType::addProjectionScale( float scale )
+{
+    OpenThreads::ScopedLock<OpenThreads::Mutex> lock( _viewMutex );
+
+    _projectionScale = osg::maximum( _projectionScale, scale );
+}
+
 void FFTOceanTechnique::OceanDataType::updateOcean( double simulationTime )
 {
     _oldTime = _newTime;
@@ -206,6 +685,15 @@ void FFTOceanTechnique::OceanDataType::updateOcean( double simulationTime )
         _time = fmod( _time, (double)_msPerFrame );
     }
 
+    {
+        OpenThreads::ScopedLock<OpenThreads::Mutex> lock( _viewMutex );
+        _oceanSurface._viewFrusta.swap( _frusta );
+        _frusta.clear();
+
+        _oceanSurface.updateLodConstant( _projectionScale );
+        _projectionScale = 0.f;
+    }
+
     _oceanSurface.update( _frame, dt, _eye );
 }
 
@@ -356,6 +844,9 @@ void FFTOceanTechnique::OceanAnimationCallback::update(osg::Node* node, osg::Nod
         {
             osgUtil::CullVisitor* cv = static_cast<osgUtil::CullVisitor*>(nv);
             osg::Camera* currentCamera = cv->getCurrentRenderBin()->getStage()->getCamera();
+            bool lodEye = false;
+            float projectionScale = 0.f;
+
             if (currentCamera->getName() == "ShadowCamera" ||
                 currentCamera->getName() == "AnalysisCamera" )
             {
@@ -363,6 +854,32 @@ void FFTOceanTechnique::OceanAnimationCallback::update(osg::Node* node, osg::Nod
             else
             {
                 oceanData->setEye( cv->getEyePoint() );
+                lodEye = true;
+            }
+
+            // Every view, including shadow and analysis cameras, has to see the tiles it draws.
+            oceanData->addFrustum( cv->getCurrentCullingSet().getFrustum() );
+
+            // Only perspective views drawing the surface for display set the detail needed.
+            const osg::Matrix* projection = cv->getProjectionMatrix();
+            const osg::Viewport* viewport = cv->getViewport();
+
+            if( projection && viewport && (*projection)(3,3) == 0.0 &&
+                currentCamera->getName() != "ShadowCamera" )
+            {
+                // (1,1) of a perspective projection is 1/tan(fovy/2).
+                projectionScale = float( (*projection)(1,1) * viewport->height() );
+                oceanData->addProjectionScale( projectionScale );
+            }
+
+            // The surface itself is at the end of the path when it's being culled for drawing,
+            // rather than called directly by OceanScene ahead of its passes.
+            FFTOceanTechnique* ocean = dynamic_cast<FFTOceanTechnique*>(node);
+
+            if( ocean )
+            {
+                bool drawing = !nv->getNodePath().empty() && nv->getNodePath().back() == node;
+                ocean->cullView( *cv, lodEye, projectionScale, drawing );
             }
         }
         else if( nv->getVisitorType() == osg::NodeVisitor::UPDATE_VISITOR ){
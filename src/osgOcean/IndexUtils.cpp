@@ -0,0 +1,222 @@
+/*
+* This source file is part of the osgOcean library
+* 
+* Copyright (C) 2009 Kim Bale
+* Copyright (C) 2009 The University of Hull, UK
+* 
+* This program is free software; you can redistribute it and/or modify it under
+* the terms of the GNU Lesser General Public License as published by the Free Software
+* Foundation; either version 3 of the License, or (at your option) any later
+* version.
+
+* This program is distributed in the hope that it will be useful, but WITHOUT
+* ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+* FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+* http://www.gnu.org/copyleft/lesser.txt.
+*/
+
+
+#include <osgOcean/IndexUtils>
+#include <OpenThreads/Mutex>
+#include <OpenThreads/ScopedLock>
+
+#include <algorithm>
+#include <map>
+
+namespace
+{
+    struct GridKey
+    {
+        GridKey( unsigned int c, unsigned int r, unsigned int s, unsigned int st )
+            :cols(c), rows(r), step(s), stride(st)
+        {}
+
+        bool operator<( const GridKey& rhs ) const
+        {
+            if( cols != rhs.cols )  return cols < rhs.cols;
+            if( rows != rhs.rows )  return rows < rhs.rows;
+            if( step != rhs.step )  return step < rhs.step;
+            return stride < rhs.stride;
+        }
+
+        unsigned int cols;
+        unsigned int rows;
+        unsigned int step;
+        unsigned int stride;
+    };
+
+    typedef std::map< GridKey, std::vector<GLuint> > GridMap;
+
+    OpenThreads::Mutex s_gridMutex;
+    GridMap s_grids;
+}
+
+namespace osgOcean
+{
+    namespace IndexUtils
+    {
+        void optimizeTriangleOrder( std::vector<GLuint>& indices, unsigned int cacheSize )
+        {
+            unsigned int numTriangles = indices.size() / 3;
+
+            if( numTriangles < 2 )
+                return;
+
+            unsigned int numVertices = *std::max_element( indices.begin(), indices.end() ) + 1;
+
+            // Triangles using each vertex.
+            std::vector<unsigned int> offsets( numVertices+1, 0 );
+
+            for( unsigned int i = 0; i < numTriangles*3; ++i )
+                ++offsets[ indices[i]+1 ];
+
+            for( unsigned int v = 0; v < numVertices; ++v )
+                offsets[v+1] += offsets[v];
+
+            std::vector<unsigned int> adjacency( numTriangles*3 );
+            std::vector<unsigned int> fill( offsets.begin(), offsets.end()-1 );
+
+            for( unsigned int i = 0; i < numTriangles*3; ++i )
+                adjacency[ fill[ indices[i] ]++ ] = i/3;
+
+            // Triangles still to be emitted that use each vertex.
+            std::vector<unsigned int> live( numVertices );
+
+            for( unsigned int v = 0; v < numVertices; ++v )
+                live[v] = offsets[v+1] - offsets[v];
+
+            std::vector<unsigned int> cacheTime( numVertices, 0 );
+            std::vector<bool> emitted( numTriangles, false );
+            std::vector<unsigned int> deadEnd;
+            std::vector<unsigned int> candidates;
+
+            std::vector<GLuint> output;
+            output.reserve( numTriangles*3 );
+
+            unsigned int time = cacheSize+1;
+            unsigned int cursor = 0;
+            int fanning = indices[0];
+
+            while( fanning >= 0 )
+            {
+                candidates.clear();
+
+                // Emit every remaining triangle around the fanning vertex.
+                for( unsigned int a = offsets[fanning]; a < offsets[fanning+1]; ++a )
+                {
+                    unsigned int t = adjacency[a];
+
+                    if( emitted[t] )
+                        continue;
+
+                    for( unsigned int k = 0; k < 3; ++k )
+                    {
+                        GLuint v = indices[t*3+k];
+
+                        output.push_back( v );
+                        deadEnd.push_back( v );
+                        candidates.push_back( v );
+                        --live[v];
+
+                        if( time - cacheTime[v] > cacheSize )
+                            cacheTime[v] = time++;
+                    }
+
+                    emitted[t] = true;
+                }
+
+                // Continue from the candidate that will stay in the cache longest once
+                // its remaining triangles are emitted, preferring the oldest.
+                int next = -1;
+                int bestPriority = -1;
+
+                for( unsigned int c = 0; c < candidates.size(); ++c )
+                {
+                    unsigned int v = candidates[c];
+
+                    if( live[v] == 0 )
+                        continue;
+
+                    int priority = 0;
+
+                    if( time - cacheTime[v] + 2*live[v] <= cacheSize )
+                        priority = time - cacheTime[v];
+
+                    if( priority > bestPriority )
+                    {
+                        bestPriority = priority;
+                        next = v;
+                    }
+                }
+
+                // Dead end, go back to a recently used vertex or else the next unfinished one.
+                while( next < 0 && !deadEnd.empty() )
+                {
+                    unsigned int v = deadEnd.back();
+                    deadEnd.pop_back();
+
+                    if( live[v] > 0 )
+                        next = v;
+                }
+
+                while( next < 0 && cursor < numVertices )
+                {
+                    if( live[cursor] > 0 )
+                        next = cursor;
+
+                    ++cursor;
+                }
+
+                fanning = next;
+            }
+
+            indices.swap( output );
+        }
+
+        const std::vector<GLuint>& getGridTriangles( unsigned int cols, unsigned int rows, unsigned int step, unsigned int stride )
+        {
+            OpenThreads::ScopedLock<OpenThreads::Mutex> lock(s_gridMutex);
+
+            GridKey key( cols, rows, step, stride );
+
+            GridMap::iterator itr = s_grids.find( key );
+
+            if( itr != s_grids.end() )
+                return itr->second;
+
+            std::vector<GLuint>& triangles = s_grids[key];
+
+            if( cols < 2 || rows < 2 )
+                return triangles;
+
+            triangles.reserve( (cols-1)*(rows-1)*6 );
+
+            // Same winding as the row by row strips.
+            for( unsigned int r = 0; r < rows-1; ++r )
+            {
+                for( unsigned int c = 0; c < cols-1; ++c )
+                {
+                    GLuint i0 = ( c   +  r   *stride ) * step;
+                    GLuint i1 = ( c+1 +  r   *stride ) * step;
+                    GLuint i2 = ( c   + (r+1)*stride ) * step;
+                    GLuint i3 = ( c+1 + (r+1)*stride ) * step;
+
+                    triangles.push_back(i0); triangles.push_back(i2); triangles.push_back(i1);
+                    triangles.push_back(i1); triangles.push_back(i2); triangles.push_back(i3);
+                }
+            }
+
+            optimizeTriangleOrder( triangles );
+
+            return triangles;
+        }
+
+        osg::DrawElements* createDrawElements( GLenum mode, const std::vector<GLuint>& indices )
+        {
+            if( indices.empty() || *std::max_element( indices.begin(), indices.end() ) <= 0xFFFF )
+                return new osg::DrawElementsUShort( mode, indices.begin(), indices.end() );
+            else
+                return new osg::DrawElementsUInt( mode, indices.begin(), indices.end() );
+        }
+    }
+}
@@ -16,6 +16,9 @@
 */
 
 #include <osgOcean/MipmapGeometry>
+#include <osgOcean/IndexUtils>
+
+#include <algorithm>
 
 namespace osgOcean
 {
@@ -26,9 +29,13 @@ namespace osgOcean
         _rowLen     ( 0 ),
         _colLen     ( 0 ),
         _startIdx   ( 0 ),
-        _border     ( BORDER_NONE )
+        _border     ( BORDER_NONE ),
+        _triangles  ( new osg::DrawElementsUShort( osg::PrimitiveSet::TRIANGLES ) )
     {
+        for( unsigned int i = 0; i < 8; ++i )
+            _neighbourhood[i] = ~0u;
 
+        addPrimitiveSet( _triangles.get() );
     }
 
     MipmapGeometry::MipmapGeometry( unsigned int level, 
@@ -41,8 +48,13 @@ namespace osgOcean
         _rowLen     ( border==BORDER_X || border==BORDER_XY ? _resolution+1 : _resolution),
         _colLen     ( border==BORDER_Y || border==BORDER_XY ? _resolution+1 : _resolution),
         _startIdx   ( startIdx ),
-        _border     ( border )
+        _border     ( border ),
+        _triangles  ( new osg::DrawElementsUShort( osg::PrimitiveSet::TRIANGLES ) )
     {
+        for( unsigned int i = 0; i < 8; ++i )
+            _neighbourhood[i] = ~0u;
+
+        addPrimitiveSet( _triangles.get() );
     }
 
     MipmapGeometry::~MipmapGeometry( void )
@@ -58,8 +70,137 @@ namespace osgOcean
         _rowLen       ( copy._rowLen ),
         _colLen       ( copy._colLen ),
         _startIdx     ( copy._startIdx ),
-        _border       ( copy._border )
+        _border       ( copy._border ),
+        _indices      ( copy._indices ),
+        _triangles    ( getNumPrimitiveSets() > 0 ? getPrimitiveSet(0)->getDrawElements() : 0 )
+    {
+        for( unsigned int i = 0; i < 8; ++i )
+            _neighbourhood[i] = copy._neighbourhood[i];
+
+        if( !_triangles.valid() )
+        {
+            _triangles = new osg::DrawElementsUShort( osg::PrimitiveSet::TRIANGLES );
+            addPrimitiveSet( _triangles.get() );
+        }
+    }
+
+    bool MipmapGeometry::updateNeighbourhood( const MipmapGeometry* xTile, const MipmapGeometry* yTile, const MipmapGeometry* xyTile )
+    {
+        unsigned int neighbourhood[8] = 
+        {
+            _startIdx,          _level,
+            xTile->getIdx(),    xTile->getLevel(),
+            yTile->getIdx(),    yTile->getLevel(),
+            xyTile->getIdx(),   xyTile->getLevel()
+        };
+
+        bool changed = false;
+
+        for( unsigned int i = 0; i < 8; ++i )
+        {
+            if( _neighbourhood[i] != neighbourhood[i] )
+            {
+                _neighbourhood[i] = neighbourhood[i];
+                changed = true;
+            }
+        }
+
+        return changed;
+    }
+
+    void MipmapGeometry::clearTriangles( void )
+    {
+        _indices.clear();
+
+        if( _triangles->getNumIndices() > 0 )
+        {
+            osg::DrawElementsUShort* shorts = dynamic_cast<osg::DrawElementsUShort*>( _triangles.get() );
+
+            if( shorts )
+                shorts->clear();
+            else
+                static_cast<osg::DrawElementsUInt*>( _triangles.get() )->clear();
+
+            _triangles->dirty();
+        }
+
+        dirtyBound();
+    }
+
+    void MipmapGeometry::addTriangles( osg::DrawElementsUInt* primitive )
+    {
+        osg::ref_ptr<osg::DrawElementsUInt> source = primitive;
+
+        unsigned int numIndices = source->size();
+
+        if( numIndices < 3 )
+            return;
+
+        _indices.reserve( _indices.size() + (numIndices-2)*3 );
+
+        for( unsigned int i = 2; i < numIndices; ++i )
+        {
+            GLuint a, b, c;
+
+            if( source->getMode() == osg::PrimitiveSet::TRIANGLE_FAN )
+            {
+                a = (*source)[0];
+                b = (*source)[i-1];
+                c = (*source)[i];
+            }
+            else if( source->getMode() == osg::PrimitiveSet::TRIANGLE_STRIP )
+            {
+                // Every other triangle in a strip is flipped to keep the winding consistent.
+                a = (*source)[ i%2==0 ? i-2 : i-1 ];
+                b = (*source)[ i%2==0 ? i-1 : i-2 ];
+                c = (*source)[i];
+            }
+            else
+            {
+                osg::notify(osg::WARN) << "MipmapGeometry::addTriangles() Unsupported primitive mode." << std::endl;
+                return;
+            }
+
+            if( a == b || b == c || a == c )
+                continue;
+
+            _indices.push_back( a );
+            _indices.push_back( b );
+            _indices.push_back( c );
+        }
+    }
+
+    void MipmapGeometry::addTriangles( const std::vector<GLuint>& triangles, unsigned int offset )
     {
-        
+        _indices.reserve( _indices.size() + triangles.size() );
+
+        for( std::vector<GLuint>::const_iterator itr = triangles.begin(); itr != triangles.end(); ++itr )
+            _indices.push_back( *itr + offset );
+    }
+
+    void MipmapGeometry::finishTriangles( void )
+    {
+        bool fits = _indices.empty() || *std::max_element( _indices.begin(), _indices.end() ) <= 0xFFFF;
+
+        osg::DrawElementsUShort* shorts = dynamic_cast<osg::DrawElementsUShort*>( _triangles.get() );
+
+        if( fits && shorts )
+        {
+            shorts->assign( _indices.begin(), _indices.end() );
+        }
+        else if( !fits && !shorts )
+        {
+            static_cast<osg::DrawElementsUInt*>( _triangles.get() )->assign( _indices.begin(), _indices.end() );
+        }
+        else
+        {
+            // The tile has moved across the 16 bit boundary of the vertex array.
+            osg::ref_ptr<osg::DrawElements> triangles = osgOcean::IndexUtils::createDrawElements( osg::PrimitiveSet::TRIANGLES, _indices );
+            setPrimitiveSet( 0, triangles.get() );
+            _triangles = triangles;
+        }
+
+        _triangles->dirty();
+        dirtyBound();
     }
 }
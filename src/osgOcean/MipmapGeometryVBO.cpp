@@ -16,10 +16,92 @@
 */
 
 #include "osgOcean/MipmapGeometryVBO"
+#include "osgOcean/IndexUtils"
+#include <OpenThreads/Mutex>
+#include <OpenThreads/ScopedLock>
 #include <stdlib.h>
 
 namespace osgOcean
 {
+    bool MipmapPrimitiveCache::find( unsigned int maxResolution, unsigned int level, unsigned int levelRight, unsigned int levelBelow,
+                                     osg::Geometry::PrimitiveSetList& primitives ) const
+    {
+        OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_mutex);
+
+        PrimitiveMap::const_iterator itr = _primitives.find( Key(maxResolution,level,levelRight,levelBelow) );
+
+        if( itr == _primitives.end() )
+            return false;
+
+        primitives = itr->second;
+        return true;
+    }
+
+    void MipmapPrimitiveCache::insert( unsigned int maxResolution, unsigned int level, unsigned int levelRight, unsigned int levelBelow,
+                                       osg::Geometry::PrimitiveSetList& primitives )
+    {
+        OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_mutex);
+
+        Key key(maxResolution,level,levelRight,levelBelow);
+
+        PrimitiveMap::const_iterator itr = _primitives.find( key );
+
+        if( itr != _primitives.end() )
+        {
+            primitives = itr->second;
+            return;
+        }
+
+        // Indices are local to the tile's vertices, so are stored as unsigned shorts when they fit.
+        osg::ref_ptr<osg::ElementBufferObject> ebo = new osg::ElementBufferObject;
+
+        for( osg::Geometry::PrimitiveSetList::iterator p = primitives.begin(); p != primitives.end(); ++p )
+        {
+            osg::DrawElementsUInt* uints = dynamic_cast<osg::DrawElementsUInt*>( p->get() );
+
+            if( uints )
+                *p = osgOcean::IndexUtils::createDrawElements( uints->getMode(), std::vector<GLuint>( uints->begin(), uints->end() ) );
+
+            (*p)->setDataVariance( osg::Object::STATIC );
+
+            osg::DrawElements* elements = (*p)->getDrawElements();
+            if( elements )
+                elements->setElementBufferObject( ebo.get() );
+        }
+
+        _primitives[key] = primitives;
+    }
+
+    void MipmapPrimitiveCache::resizeGLObjectBuffers( unsigned int maxSize )
+    {
+        OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_mutex);
+
+        for( PrimitiveMap::iterator itr = _primitives.begin(); itr != _primitives.end(); ++itr )
+        {
+            for( osg::Geometry::PrimitiveSetList::iterator p = itr->second.begin(); p != itr->second.end(); ++p )
+            {
+                osg::DrawElements* elements = (*p)->getDrawElements();
+                if( elements && elements->getElementBufferObject() )
+                    elements->getElementBufferObject()->resizeGLObjectBuffers( maxSize );
+            }
+        }
+    }
+
+    void MipmapPrimitiveCache::releaseGLObjects( osg::State* state ) const
+    {
+        OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_mutex);
+
+        for( PrimitiveMap::const_iterator itr = _primitives.begin(); itr != _primitives.end(); ++itr )
+        {
+            for( osg::Geometry::PrimitiveSetList::const_iterator p = itr->second.begin(); p != itr->second.end(); ++p )
+            {
+                const osg::DrawElements* elements = (*p)->getDrawElements();
+                if( elements && elements->getElementBufferObject() )
+                    elements->getElementBufferObject()->releaseGLObjects( state );
+            }
+        }
+    }
+
     MipmapGeometryVBO::MipmapGeometryVBO( void )
         :_numLevels      ( 0 )
         ,_level          ( -1 )
@@ -80,6 +162,7 @@ namespace osgOcean
         ,_rightBorder  ( copy._rightBorder )
         ,_belowBorder  ( copy._belowBorder )
         ,_cornerPiece  ( copy._cornerPiece )
+        ,_primitiveCache( copy._primitiveCache )
     {
     }
 
@@ -99,13 +182,44 @@ namespace osgOcean
 
     bool MipmapGeometryVBO::updatePrimitives( unsigned int level, unsigned int levelRight, unsigned int levelBelow )
     {
-        if( checkPrimitives(level,levelRight,levelBelow) )
+        if( _level      == (int)level      && 
+            _levelRight == (int)levelRight && 
+            _levelBelow == (int)levelBelow )
         {
+            return false;
+        }
+
+        if( !_primitiveCache.valid() )
+        {
+            checkPrimitives(level,levelRight,levelBelow);
             assignPrimitives();
             return true;
         }
 
-        return false;
+        if( _primitiveCache->find(_maxResolution, level, levelRight, levelBelow, _primitives) )
+        {
+            _level      = level;
+            _levelRight = levelRight;
+            _levelBelow = levelBelow;
+
+            _resolution = calcResolution(_level,      _numLevels);
+            _resRight   = calcResolution(_levelRight, _numLevels);
+            _resBelow   = calcResolution(_levelBelow, _numLevels);
+            _rowLen     = _resolution+1;
+
+            return true;
+        }
+
+        // Not built yet, so build every piece from scratch rather than 
+        // patching this tile's previous primitives, then share them.
+        _level = _levelRight = _levelBelow = -1;
+
+        checkPrimitives(level,levelRight,levelBelow);
+        assignPrimitives();
+
+        _primitiveCache->insert(_maxResolution, level, levelRight, levelBelow, _primitives);
+
+        return true;
     }
 
     bool MipmapGeometryVBO::checkPrimitives( unsigned int level, unsigned int levelRight, unsigned int levelBelow )
@@ -194,7 +308,7 @@ namespace osgOcean
         _mainBody.clear();
 
         // Degenerate triangles seem to cause problems on some cards so leave the original 
-        // version in here. The degenerate version does appear to provide a noticeable
+        // version in here. The single primitive does appear to provide a noticeable
         // difference in draw time.
 #ifdef NO_DEGENERATE_TRIANGLES
         
@@ -219,27 +333,11 @@ namespace osgOcean
             _mainBody[p++]=primitive;
         }
 #else
-        unsigned indices = (_resolution*2)*(_resolution) - 4;
-        osg::DrawElementsUInt* primitive = new osg::DrawElementsUInt( osg::PrimitiveSet::TRIANGLE_STRIP, indices );
-
-        int i = 0;
-        for( unsigned r = 0; r < _resolution-1; ++r )
-        {
-            unsigned row = r*inc;
+        // A triangle list in vertex cache order, shared by every tile of this level.
+        const std::vector<GLuint>& triangles = 
+            osgOcean::IndexUtils::getGridTriangles( _resolution, _resolution, inc, _maxResolution+1 );
 
-            for( unsigned c = 0; c < _resolution; ++c )
-            {
-                unsigned col = c*inc;
-                (*primitive)[i++] = getIndex( col, row );
-                (*primitive)[i++] = getIndex( col, row+inc );
-
-                if( (c == _resolution-1) && (r+1 != _resolution-1) )
-                {
-                    (*primitive)[i++] = getIndex( col, row+inc );
-                    (*primitive)[i++] = getIndex( 0,   row+inc );
-                }
-            }
-        }
+        osg::DrawElementsUInt* primitive = new osg::DrawElementsUInt( osg::PrimitiveSet::TRIANGLES, triangles.begin(), triangles.end() );
 
         _mainBody.push_back( primitive );
 #endif
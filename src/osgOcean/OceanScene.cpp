@@ -19,7 +19,23 @@
 #include <osgOcean/ShaderManager>
 #include <osgOcean/FFTOceanTechnique>
 
+#include <osg/ColorMask>
 #include <osg/Depth>
+#include <osg/FrontFace>
+#include <osg/Geometry>
+#include <osg/Stats>
+#include <osg/Version>
+#include <osg/Viewport>
+#include <osg/buffered_value>
+
+#if OPENSCENEGRAPH_MAJOR_VERSION > 3 || \
+    (OPENSCENEGRAPH_MAJOR_VERSION == 3 && OPENSCENEGRAPH_MINOR_VERSION >= 4)
+#include <osg/GLExtensions>
+#endif
+
+#ifndef GL_SAMPLE_BUFFERS
+#define GL_SAMPLE_BUFFERS 0x80A8
+#endif
 
 using namespace osgOcean;
 
@@ -145,14 +161,296 @@ namespace
 
     static const float OCEAN_CYLINDER_HEIGHT = 4000.f;
 
+    // Frames after which a surface occlusion query result is too old to 
+    // skip the RTT passes on.
+    static const unsigned int MAX_OCCLUSION_QUERY_AGE = 4;
+
+    // Sets an RTT camera's viewport to the given fraction of its texture and
+    // passes the covered fraction, and the last texel centre inside it, on to
+    // the surface shader. The size is snapped to 16 pixels so small changes in
+    // frame time don't resize the pass every frame.
+    void setRTTViewportScale( osg::Camera* camera, const osg::Vec2s& texSize, float scale, osg::Uniform* uvScale, osg::Uniform* uvLimit )
+    {
+        int width  = osg::clampBetween( (int)osg::round( texSize.x() * scale / 16.f ) * 16, 16, (int)texSize.x() );
+        int height = osg::clampBetween( (int)osg::round( texSize.y() * scale / 16.f ) * 16, 16, (int)texSize.y() );
+
+        if( camera )
+        {
+            const osg::Viewport* viewport = camera->getViewport();
+            if( !viewport || (int)viewport->width() != width || (int)viewport->height() != height )
+            {
+                // The previous viewport may still be referenced by the draw 
+                // thread, so replace it rather than modifying it.
+                camera->setViewport( new osg::Viewport( 0, 0, width, height ) );
+            }
+        }
+
+        uvScale->set( osg::Vec2f( width / (float)texSize.x(), height / (float)texSize.y() ) );
+        uvLimit->set( osg::Vec2f( (width-0.5f) / (float)texSize.x(), (height-0.5f) / (float)texSize.y() ) );
+    }
+
+    // Replaces the near plane of the camera's projection with the given world
+    // space plane so everything on its negative side is clipped by the frustum
+    // itself (Lengyel, "Oblique View Frustum Depth Projection and Clipping").
+    // Falls back to the plain projection when the eye is too close to the 
+    // plane, as the frustum degenerates there.
+    void setObliqueNearPlane( osg::Camera* camera, const osg::Plane& worldPlane )
+    {
+        osg::Plane plane( worldPlane );
+        plane.transformProvidingInverse( osg::Matrixd::inverse( camera->getViewMatrix() ) );
+
+        const osg::Vec4d clipPlane( plane[0], plane[1], plane[2], plane[3] );
+
+        if( clipPlane.w() > -0.1 )
+            return;
+
+        osg::Matrixd projection = camera->getProjectionMatrix();
+
+        // Corner of the frustum opposite the plane, in eye space.
+        osg::Vec4d corner = osg::Vec4d( osg::sign( clipPlane.x() ), osg::sign( clipPlane.y() ), 1.0, 1.0 ) * osg::Matrixd::inverse( projection );
+        osg::Vec4d scaled = clipPlane * ( 2.0 / ( clipPlane * corner ) );
+
+        // OSG matrices are transposed, so the third row of the GL matrix is
+        // the third column here.
+        for( unsigned int i = 0; i < 4; ++i )
+            projection( i, 2 ) = scaled[i] - projection( i, 3 );
+
+        camera->setProjectionMatrix( projection );
+    }
+
+    // Copies the colour and depth of the current viewport into the refraction
+    // textures. Drawn in a bin between the opaque scene and the ocean surface.
+    // A multisampled framebuffer can't be copied, the copy is then skipped 
+    // and the caller falls back to the RTT passes.
+    class FramebufferCopy : public osg::Drawable
+    {
+    public:
+        FramebufferCopy( void )
+            : _multisampled( false )
+        {}
+
+        FramebufferCopy( osg::Texture2D* colorTexture, osg::Texture2D* depthTexture, osg::Uniform* inverseTransformation )
+            : _colorTexture( colorTexture )
+            , _depthTexture( depthTexture )
+            , _inverseTransformation( inverseTransformation )
+            , _multisampled( false )
+        {
+            setUseDisplayList( false );
+            setDataVariance( osg::Object::DYNAMIC );
+        }
+
+        FramebufferCopy( const FramebufferCopy& copy, const osg::CopyOp& copyop = osg::CopyOp::SHALLOW_COPY )
+            : osg::Drawable( copy, copyop )
+            , _colorTexture( copy._colorTexture )
+            , _depthTexture( copy._depthTexture )
+            , _inverseTransformation( copy._inverseTransformation )
+            , _multisampled( false )
+        {
+        }
+
+        META_Object( osgOcean, FramebufferCopy );
+
+        // Set once a draw found the framebuffer multisampled.
+        inline bool isMultisampled( void ) const{
+            return _multisampled;
+        }
+
+        virtual void drawImplementation( osg::RenderInfo& renderInfo ) const
+        {
+            osg::State& state = *renderInfo.getState();
+
+            const osg::Viewport* viewport = state.getCurrentViewport();
+            if( !viewport )
+                return;
+
+            if( _multisampled )
+                return;
+
+            // glCopyTexImage2D() fails with GL_INVALID_OPERATION when reading
+            // from a multisampled framebuffer.
+            GLint sampleBuffers = 0;
+            glGetIntegerv( GL_SAMPLE_BUFFERS, &sampleBuffers );
+            if( sampleBuffers > 0 )
+            {
+                osg::notify(osg::WARN) << "OceanScene: Framebuffer refraction requires a framebuffer without multisampling, using the refraction pass." << std::endl;
+                _multisampled = true;
+                return;
+            }
+
+            int x = (int)viewport->x(), y = (int)viewport->y();
+            int width = (int)viewport->width(), height = (int)viewport->height();
+
+            // copyTexImage2D() reallocates the textures when the viewport 
+            // size changes and uses copyTexSubImage2D() otherwise.
+            _colorTexture->copyTexImage2D( state, x, y, width, height );
+            _depthTexture->copyTexImage2D( state, x, y, width, height );
+
+            // The depth buffer was written with the projection clamped to the
+            // computed near/far planes, which is only known at draw time.
+            if( _inverseTransformation.valid() )
+                _inverseTransformation->set( osg::Matrixd::inverse( state.getModelViewMatrix() * state.getProjectionMatrix() ) );
+        }
+
+    private:
+        osg::ref_ptr<osg::Texture2D> _colorTexture;
+        osg::ref_ptr<osg::Texture2D> _depthTexture;
+        osg::ref_ptr<osg::Uniform>   _inverseTransformation;
+        mutable bool                 _multisampled;
+    };
+
+    // Unit quad on the water plane drawn inside a GL occlusion query. The 
+    // result is collected a frame or more later, once available, so the 
+    // draw never waits on the GPU. Without occlusion query support the
+    // surface is always reported visible.
+    class SurfaceOcclusionQuery : public osg::Geometry
+    {
+    public:
+        SurfaceOcclusionQuery( void )
+            : _samplesPassed( 0 )
+            , _resultFrame( 0 )
+            , _hasResult( false )
+        {
+            osg::Vec3Array* vertices = new osg::Vec3Array;
+            vertices->push_back( osg::Vec3f( -1.f, -1.f, 0.f ) );
+            vertices->push_back( osg::Vec3f(  1.f, -1.f, 0.f ) );
+            vertices->push_back( osg::Vec3f(  1.f,  1.f, 0.f ) );
+            vertices->push_back( osg::Vec3f( -1.f,  1.f, 0.f ) );
+
+            setVertexArray( vertices );
+            addPrimitiveSet( new osg::DrawArrays( GL_QUADS, 0, 4 ) );
+
+            setUseDisplayList( false );
+            setDataVariance( osg::Object::DYNAMIC );
+        }
+
+        SurfaceOcclusionQuery( const SurfaceOcclusionQuery& copy, const osg::CopyOp& copyop = osg::CopyOp::SHALLOW_COPY )
+            : osg::Geometry( copy, copyop )
+            , _samplesPassed( 0 )
+            , _resultFrame( 0 )
+            , _hasResult( false )
+        {
+        }
+
+        META_Object( osgOcean, SurfaceOcclusionQuery );
+
+        /// Samples that passed in the most recent available result, and the 
+        /// frame it was issued in. Returns false if there is no result yet.
+        bool getResult( unsigned int& samplesPassed, unsigned int& frame ) const
+        {
+            OpenThreads::ScopedLock<OpenThreads::Mutex> lock( _mutex );
+            samplesPassed = _samplesPassed;
+            frame = _resultFrame;
+            return _hasResult;
+        }
+
+        virtual void drawImplementation( osg::RenderInfo& renderInfo ) const
+        {
+            unsigned int contextID = renderInfo.getContextID();
+
+#if OPENSCENEGRAPH_MAJOR_VERSION > 3 || \
+    (OPENSCENEGRAPH_MAJOR_VERSION == 3 && OPENSCENEGRAPH_MINOR_VERSION >= 4)
+            const osg::GLExtensions* extensions = osg::GLExtensions::Get( contextID, true );
+            if( !extensions->isARBOcclusionQuerySupported )
+                return;
+#else
+            const osg::Drawable::Extensions* extensions = osg::Drawable::getExtensions( contextID, true );
+            if( !extensions->isARBOcclusionQuerySupported() )
+                return;
+#endif
+
+            Query& query = _queries[contextID];
+
+            if( query._id == 0 )
+            {
+                extensions->glGenQueries( 1, &query._id );
+            }
+            else if( query._pending )
+            {
+                GLint available = 0;
+                extensions->glGetQueryObjectiv( query._id, GL_QUERY_RESULT_AVAILABLE_ARB, &available );
+
+                // Keep the previous result until the GPU catches up.
+                if( !available )
+                    return;
+
+                GLuint samplesPassed = 0;
+                extensions->glGetQueryObjectuiv( query._id, GL_QUERY_RESULT_ARB, &samplesPassed );
+                query._pending = false;
+
+                OpenThreads::ScopedLock<OpenThreads::Mutex> lock( _mutex );
+                _samplesPassed = samplesPassed;
+                _resultFrame = query._frame;
+                _hasResult = true;
+            }
+
+            const osg::FrameStamp* frameStamp = renderInfo.getState()->getFrameStamp();
+            query._frame = frameStamp ? frameStamp->getFrameNumber() : 0;
+            query._pending = true;
+
+            extensions->glBeginQuery( GL_SAMPLES_PASSED_ARB, query._id );
+            osg::Geometry::drawImplementation( renderInfo );
+            extensions->glEndQuery( GL_SAMPLES_PASSED_ARB );
+        }
+
+        virtual void releaseGLObjects( osg::State* state = 0 ) const
+        {
+            osg::Geometry::releaseGLObjects( state );
+
+            // The query names go with the context, start again on the next one.
+            if( state )
+            {
+                unsigned int contextID = state->getContextID();
+                Query& query = _queries[contextID];
+
+                if( query._id != 0 )
+                {
+#if OPENSCENEGRAPH_MAJOR_VERSION > 3 || \
+    (OPENSCENEGRAPH_MAJOR_VERSION == 3 && OPENSCENEGRAPH_MINOR_VERSION >= 4)
+                    const osg::GLExtensions* extensions = osg::GLExtensions::Get( contextID, false );
+#else
+                    const osg::Drawable::Extensions* extensions = osg::Drawable::getExtensions( contextID, false );
+#endif
+                    if( extensions )
+                        extensions->glDeleteQueries( 1, &query._id );
+                }
+
+                query = Query();
+            }
+            else
+                _queries.clear();
+        }
+
+    private:
+        struct Query
+        {
+            Query( void ) : _id( 0 ), _frame( 0 ), _pending( false ) {}
+
+            GLuint _id;
+            unsigned int _frame;
+            bool _pending;
+        };
+
+        mutable osg::buffered_object<Query> _queries;
+
+        mutable OpenThreads::Mutex _mutex;
+        mutable unsigned int _samplesPassed;
+        mutable unsigned int _resultFrame;
+        mutable bool _hasResult;
+    };
+
 }
 
 OceanScene::OceanScene( void )
     :_oceanSurface               ( 0 )
     ,_isDirty                    ( true )
+    ,_isPostProcessDirty         ( true )
     ,_enableReflections          ( false )
     ,_enableRefractions          ( false )
     ,_enableHeightmap            ( false )
+    ,_enableFramebufferRefraction( false )
+    ,_reflectionMode             ( PLANAR )
+    ,_heightmapMode              ( VIEW_HEIGHTMAP )
+    ,_enableObliqueReflectionClipping( false )
     ,_enableGodRays              ( false )
     ,_enableSilt                 ( false )
     ,_enableDOF                  ( false )
@@ -168,6 +466,8 @@ OceanScene::OceanScene( void )
     ,_refractionUnit             ( 2 )
     ,_refractionDepthUnit        ( 3 )
     ,_heightmapUnit              ( 7 )
+    ,_sceneColorUnit             ( 10 )
+    ,_sceneDepthUnit             ( 11 )
     ,_reflectionSceneMask        ( 0x1 )  // 1
     ,_refractionSceneMask        ( 0x2 )  // 2
     ,_normalSceneMask            ( 0x4 )  // 4
@@ -175,6 +475,8 @@ OceanScene::OceanScene( void )
     ,_siltMask                   ( 0x10 ) // 16
     ,_heightmapMask              ( 0x20 ) // 32
     ,_ARMask                     ( 0x40 ) // 64
+    ,_reflectionCullMask         ( _reflectionSceneMask | _ARMask )
+    ,_reflectionLODScale         ( 1.f )
     ,_lightID                    ( 0 )
     ,_dofNear                    ( 0.f )
     ,_dofFar                     ( 160.f )
@@ -182,12 +484,25 @@ OceanScene::OceanScene( void )
     ,_dofFarClamp                ( 1.f )
     ,_glareThreshold             ( 0.9f )
     ,_glareAttenuation           ( 0.75f )
+    ,_glareQuality               ( HIGH_QUALITY_GLARE )
     ,_underwaterFogColor         ( 0.2274509f, 0.4352941f, 0.7294117f, 1.f )
     ,_underwaterAttenuation      ( 0.015f, 0.0075f, 0.005f)
     ,_underwaterFogDensity       ( 0.01f )
     ,_aboveWaterFogDensity       ( 0.0012f )
     ,_eyeHeightReflectionCutoff  ( FLT_MAX )
     ,_eyeHeightRefractionCutoff  (-FLT_MAX )
+    ,_enableDynamicResolution    ( false )
+    ,_rttFrameTimeBudget         ( 16.6f )
+    ,_reflectionResolutionRange  ( 0.5f, 1.f )
+    ,_refractionResolutionRange  ( 0.5f, 1.f )
+    ,_heightmapResolutionRange   ( 0.5f, 1.f )
+    ,_rttInvalidation            ( 0 )
+    ,_worldHeightmapSize         ( 4096.f )
+    ,_worldHeightmapTiles        ( 4 )
+    ,_worldHeightmapTexSize      ( 1024,1024 )
+    ,_heightmapInvalidation      ( 0 )
+    ,_enableSurfaceOcclusionQuery( false )
+    ,_surfaceOcclusionThreshold  ( 64 )
     ,_surfaceHeight              ( 0.0f )
     ,_oceanTransform             ( new osg::MatrixTransform )
     ,_oceanCylinder              ( new Cylinder(1900.f, OCEAN_CYLINDER_HEIGHT, 16, false, true) )
@@ -226,9 +541,14 @@ OceanScene::OceanScene( void )
 OceanScene::OceanScene( OceanTechnique* technique )
     :_oceanSurface               ( technique )
     ,_isDirty                    ( true )
+    ,_isPostProcessDirty         ( true )
     ,_enableReflections          ( false )
     ,_enableRefractions          ( false )
     ,_enableHeightmap            ( false )
+    ,_enableFramebufferRefraction( false )
+    ,_reflectionMode             ( PLANAR )
+    ,_heightmapMode              ( VIEW_HEIGHTMAP )
+    ,_enableObliqueReflectionClipping( false )
     ,_enableGodRays              ( false )
     ,_enableSilt                 ( false )
     ,_enableDOF                  ( false )
@@ -244,6 +564,8 @@ OceanScene::OceanScene( OceanTechnique* technique )
     ,_refractionUnit             ( 2 )
     ,_refractionDepthUnit        ( 3 )
     ,_heightmapUnit              ( 7 )
+    ,_sceneColorUnit             ( 10 )
+    ,_sceneDepthUnit             ( 11 )
     ,_reflectionSceneMask        ( 0x1 )
     ,_refractionSceneMask        ( 0x2 )
     ,_normalSceneMask            ( 0x4 )
@@ -251,6 +573,8 @@ OceanScene::OceanScene( OceanTechnique* technique )
     ,_siltMask                   ( 0x10 )
     ,_heightmapMask              ( 0x20 ) 
     ,_ARMask                     ( 0x40 ) // 64
+    ,_reflectionCullMask         ( _reflectionSceneMask | _ARMask )
+    ,_reflectionLODScale         ( 1.f )
     ,_lightID                    ( 0 )
     ,_dofNear                    ( 0.f )
     ,_dofFar                     ( 160.f )
@@ -258,12 +582,25 @@ OceanScene::OceanScene( OceanTechnique* technique )
     ,_dofFarClamp                ( 1.f )
     ,_glareThreshold             ( 0.9f )
     ,_glareAttenuation           ( 0.75f )
+    ,_glareQuality               ( HIGH_QUALITY_GLARE )
     ,_underwaterFogColor         ( 0.2274509f, 0.4352941f, 0.7294117f, 1.f )
     ,_underwaterAttenuation      ( 0.015f, 0.0075f, 0.005f)
     ,_underwaterFogDensity       ( 0.01f )
     ,_aboveWaterFogDensity       ( 0.0012f )
     ,_eyeHeightReflectionCutoff  ( FLT_MAX)
     ,_eyeHeightRefractionCutoff  (-FLT_MAX)
+    ,_enableDynamicResolution    ( false )
+    ,_rttFrameTimeBudget         ( 16.6f )
+    ,_reflectionResolutionRange  ( 0.5f, 1.f )
+    ,_refractionResolutionRange  ( 0.5f, 1.f )
+    ,_heightmapResolutionRange   ( 0.5f, 1.f )
+    ,_rttInvalidation            ( 0 )
+    ,_worldHeightmapSize         ( 4096.f )
+    ,_worldHeightmapTiles        ( 4 )
+    ,_worldHeightmapTexSize      ( 1024,1024 )
+    ,_heightmapInvalidation      ( 0 )
+    ,_enableSurfaceOcclusionQuery( false )
+    ,_surfaceOcclusionThreshold  ( 64 )
     ,_surfaceHeight              ( 0.0f )
     ,_oceanTransform             ( new osg::MatrixTransform )
     ,_oceanCylinder              ( new Cylinder(1900.f, OCEAN_CYLINDER_HEIGHT, 16, false, true) )
@@ -306,8 +643,13 @@ OceanScene::OceanScene( const OceanScene& copy, const osg::CopyOp& copyop )
     :osg::Group                  ( copy, copyop )
     ,_oceanSurface               ( copy._oceanSurface )
     ,_isDirty                    ( copy._isDirty )
+    ,_isPostProcessDirty         ( copy._isPostProcessDirty )
     ,_enableReflections          ( copy._enableReflections )
     ,_enableRefractions          ( copy._enableRefractions )
+    ,_enableFramebufferRefraction( copy._enableFramebufferRefraction )
+    ,_reflectionMode             ( copy._reflectionMode )
+    ,_heightmapMode              ( copy._heightmapMode )
+    ,_enableObliqueReflectionClipping( copy._enableObliqueReflectionClipping )
     ,_enableGodRays              ( copy._enableGodRays )
     ,_enableSilt                 ( copy._enableSilt )
     ,_enableDOF                  ( copy._enableDOF )
@@ -322,6 +664,8 @@ OceanScene::OceanScene( const OceanScene& copy, const osg::CopyOp& copyop )
     ,_refractionUnit             ( copy._refractionUnit )
     ,_refractionDepthUnit        ( copy._refractionDepthUnit )
     ,_heightmapUnit              ( copy._heightmapUnit )
+    ,_sceneColorUnit             ( copy._sceneColorUnit )
+    ,_sceneDepthUnit             ( copy._sceneDepthUnit )
     ,_reflectionSceneMask        ( copy._reflectionSceneMask )
     ,_refractionSceneMask        ( copy._refractionSceneMask )
     ,_siltMask                   ( copy._siltMask )
@@ -329,6 +673,8 @@ OceanScene::OceanScene( const OceanScene& copy, const osg::CopyOp& copyop )
     ,_normalSceneMask            ( copy._normalSceneMask )
     ,_heightmapMask              ( copy._heightmapMask )
     ,_ARMask                     ( copy._ARMask )
+    ,_reflectionCullMask         ( copy._reflectionCullMask )
+    ,_reflectionLODScale         ( copy._reflectionLODScale )
     ,_godrayPreRender            ( copy._godrayPreRender )
     ,_godrayPostRender           ( copy._godrayPostRender )
     ,_godrays                    ( copy._godrays )
@@ -352,12 +698,28 @@ OceanScene::OceanScene( const OceanScene& copy, const osg::CopyOp& copyop )
     ,_dofStateSet                ( copy._dofStateSet )
     ,_glareThreshold             ( copy._glareThreshold )
     ,_glareAttenuation           ( copy._glareAttenuation )
+    ,_glareQuality               ( copy._glareQuality )
     ,_glareStateSet              ( copy._glareStateSet )
+    ,_postProcessGraph           ( copy._postProcessGraph )
     ,_distortionSurface          ( copy._distortionSurface)
     ,_globalStateSet             ( copy._globalStateSet )
     ,_defaultSceneShader         ( copy._defaultSceneShader )
     ,_eyeHeightReflectionCutoff  ( copy._eyeHeightReflectionCutoff )
     ,_eyeHeightRefractionCutoff  ( copy._eyeHeightRefractionCutoff )
+    ,_enableDynamicResolution    ( copy._enableDynamicResolution )
+    ,_rttFrameTimeBudget         ( copy._rttFrameTimeBudget )
+    ,_reflectionResolutionRange  ( copy._reflectionResolutionRange )
+    ,_refractionResolutionRange  ( copy._refractionResolutionRange )
+    ,_heightmapResolutionRange   ( copy._heightmapResolutionRange )
+    ,_rttUpdatePolicy            ( copy._rttUpdatePolicy )
+    ,_rttUpdatePolicies          ( copy._rttUpdatePolicies )
+    ,_rttInvalidation            ( copy._rttInvalidation )
+    ,_worldHeightmapSize         ( copy._worldHeightmapSize )
+    ,_worldHeightmapTiles        ( copy._worldHeightmapTiles )
+    ,_worldHeightmapTexSize      ( copy._worldHeightmapTexSize )
+    ,_heightmapInvalidation      ( copy._heightmapInvalidation )
+    ,_enableSurfaceOcclusionQuery( copy._enableSurfaceOcclusionQuery )
+    ,_surfaceOcclusionThreshold  ( copy._surfaceOcclusionThreshold )
     ,_surfaceHeight              ( copy._surfaceHeight )
     ,_oceanTransform             ( copy._oceanTransform )
     ,_oceanCylinder              ( copy._oceanCylinder )
@@ -382,14 +744,6 @@ void OceanScene::init( void )
         _reflectionClipNode = NULL;
     }
 
-    _dofPasses.clear();
-    _dofStateSet = NULL;
-
-    _glarePasses.clear();
-    _glareStateSet = NULL;
-    
-    _distortionSurface = NULL;
-
     if( _siltClipNode.valid() ){
         removeChild( _siltClipNode.get() );
         _siltClipNode = NULL;
@@ -424,7 +778,8 @@ void OceanScene::init( void )
             _globalStateSet->setAttributeAndModes( _defaultSceneShader.get(), osg::StateAttribute::ON );
         }
 
-        if( _enableReflections )
+        // The oblique reflection frustum clips at the water plane itself.
+        if( _enableReflections && !_enableObliqueReflectionClipping )
         {
             osg::ClipPlane* reflClipPlane = new osg::ClipPlane();
             reflClipPlane->setClipPlaneNum(0);
@@ -455,128 +810,205 @@ void OceanScene::init( void )
             _godrayPostRender->addChild( _godRayBlendSurface.get() );
         }
 
-        if( _enableDOF )
-        {
-            _dofPasses.clear();
-
-            osg::Vec2s lowResDims = _screenDims/4;
+        initPostProcessing();
 
-            _dofStateSet = new osg::StateSet;
-            _dofStateSet->addUniform( new osg::Uniform("osgOcean_DOF_Near",  _dofNear ) );
-            _dofStateSet->addUniform( new osg::Uniform("osgOcean_DOF_Far",   _dofFar ) );
-            _dofStateSet->addUniform( new osg::Uniform("osgOcean_DOF_Clamp", _dofFarClamp ) );
-            _dofStateSet->addUniform( new osg::Uniform("osgOcean_DOF_Focus", _dofFocus ) );
-
-            // First capture screen color buffer and a luminance buffer used for a custom depth map
-            osg::TextureRectangle* fullScreenTexture   = createTextureRectangle( _screenDims, GL_RGBA );
-            osg::TextureRectangle* fullScreenLuminance = createTextureRectangle( _screenDims, GL_LUMINANCE );
+        if( _enableSilt )
+        {
+            SiltEffect* silt = new SiltEffect;
+            // Clip silt above water level
+            silt->getOrCreateStateSet()->setMode( GL_CLIP_PLANE0+1, osg::StateAttribute::ON );
+            silt->setIntensity(0.07f);
+            silt->setParticleSpeed(0.025f);
+            silt->setNodeMask(_siltMask);
 
-            osg::Camera* fullPass = multipleRenderTargetPass( fullScreenTexture,   osg::Camera::COLOR_BUFFER0,
-                                                              fullScreenLuminance, osg::Camera::COLOR_BUFFER1 );
+            osg::ClipPlane* siltClipPlane = new osg::ClipPlane();
+            siltClipPlane->setClipPlaneNum(1);
+            siltClipPlane->setClipPlane( 0.0, 0.0, -1.0, -getOceanSurfaceHeight() );
 
-            fullPass->setCullCallback( new PrerenderCameraCullCallback(this) );
-            fullPass->setStateSet(_dofStateSet.get());
-            _dofPasses.push_back( fullPass );
+            _siltClipNode = new osg::ClipNode;
+            _siltClipNode->addClipPlane( siltClipPlane );
+            _siltClipNode->addChild( silt );
 
-            // Downsize image
-            osg::TextureRectangle* downsizedTexture = createTextureRectangle( lowResDims, GL_RGBA );
-            _dofPasses.push_back( downsamplePass( fullScreenTexture, NULL, downsizedTexture, false ) );
-            
-            // Gaussian blur 1
-            osg::TextureRectangle* gaussianTexture_1 = createTextureRectangle( lowResDims, GL_RGBA );
-            _dofPasses.push_back( gaussianPass(downsizedTexture, gaussianTexture_1, true ) );
+            addChild( _siltClipNode.get() );
+        }
+    }
+    
+    _isDirty = false;
+}
 
-            // Gaussian blur 2
-            osg::TextureRectangle* gaussianTexture_2 = createTextureRectangle( lowResDims, GL_RGBA );
-            _dofPasses.push_back( gaussianPass(gaussianTexture_1, gaussianTexture_2, false ) );
+namespace
+{
+    // Post processing branches, only one of them runs in a frame.
+    enum PostProcessBranch
+    {
+        DOF_BRANCH,     // Underwater depth of field
+        GLARE_BRANCH    // Above water glare
+    };
+}
 
-            // Combiner
-            osg::TextureRectangle* combinedTexture = createTextureRectangle( _screenDims, GL_RGBA );
-            _dofPasses.push_back( dofCombinerPass(fullScreenTexture, fullScreenLuminance, gaussianTexture_2, combinedTexture ) );
+void OceanScene::initPostProcessing( void )
+{
+    _dofPasses.clear();
+    _dofStateSet = NULL;
 
-            // Post render pass
-            _dofPasses.push_back( dofFinalPass( combinedTexture ) );
-        }
-    
-        if( _enableGlare )
-        {
-            _glarePasses.clear();
+    _glarePasses.clear();
+    _glareStateSet = NULL;
 
-            osg::Vec2s lowResDims = _screenDims/4;
+    _distortionSurface = NULL;
 
-            _glareStateSet = new osg::StateSet;
-            _glareStateSet->addUniform( new osg::Uniform("osgOcean_EnableGlare", _enableGlare ) );
+    _globalStateSet->getUniform("osgOcean_EnableDOF")->set(_enableDOF);
+    _globalStateSet->getUniform("osgOcean_EnableGlare")->set(_enableGlare);
 
-            // First capture screen
-            osg::TextureRectangle* fullScreenTexture = createTextureRectangle( _screenDims, GL_RGBA );
-            osg::TextureRectangle* luminanceTexture  = createTextureRectangle( _screenDims, GL_LUMINANCE );
-            
-            osg::Camera* fullPass = multipleRenderTargetPass( 
-                fullScreenTexture, osg::Camera::COLOR_BUFFER0,
-                luminanceTexture,  osg::Camera::COLOR_BUFFER1 );
+    osg::Vec2s lowResDims = _screenDims/4;
 
-            fullPass->setCullCallback( new PrerenderCameraCullCallback(this) );
-            fullPass->setStateSet(_glareStateSet.get());
-            _glarePasses.push_back( fullPass );
+    _postProcessGraph = new PostProcessGraph;
+    PostProcessGraph& graph = *_postProcessGraph;
+
+    // Depth of field: capture the scene colour and a luminance buffer used 
+    // as a custom depth map, blur a downsized copy and combine the two.
+    graph.addResource( "dof_colour",      _screenDims, GL_RGBA );
+    graph.addResource( "dof_luminance",   _screenDims, GL_LUMINANCE );
+    graph.addResource( "dof_downsampled", lowResDims,  GL_RGBA );
+    graph.addResource( "dof_blur_x",      lowResDims,  GL_RGBA );
+    graph.addResource( "dof_blur_xy",     lowResDims,  GL_RGBA );
+    graph.addResource( "dof_combined",    _screenDims, GL_RGBA );
+
+    graph.addPass( "dof_scene",      DOF_BRANCH ).writes( "dof_colour" ).writes( "dof_luminance" );
+    graph.addPass( "dof_downsample", DOF_BRANCH ).reads( "dof_colour" ).writes( "dof_downsampled" );
+    graph.addPass( "dof_gaussian_x", DOF_BRANCH ).reads( "dof_downsampled" ).writes( "dof_blur_x" );
+    graph.addPass( "dof_gaussian_y", DOF_BRANCH ).reads( "dof_blur_x" ).writes( "dof_blur_xy" );
+    graph.addPass( "dof_combiner",   DOF_BRANCH ).reads( "dof_colour" ).reads( "dof_luminance" ).reads( "dof_blur_xy" ).writes( "dof_combined" );
+    graph.addPass( "dof_final",      DOF_BRANCH ).reads( "dof_combined" );
+
+    // Glare: capture the scene, downsize the bright parts and streak them 
+    // in four directions, two iterations each, then blend into the scene.
+    // FAST_GLARE streaks in a single pass and adds a dual filter bloom.
+    static const char* streakNames[4][2] = { 
+        { "glare_streak_tr_1", "glare_streak_tr_2" },   // Top right
+        { "glare_streak_bl_1", "glare_streak_bl_2" },   // Bottom left
+        { "glare_streak_br_1", "glare_streak_br_2" },   // Bottom right
+        { "glare_streak_tl_1", "glare_streak_tl_2" } }; // Top left
+
+    static const osg::Vec2f streakDirections[4] = { 
+        osg::Vec2f( 0.5f, 0.5f), osg::Vec2f(-0.5f,-0.5f), osg::Vec2f( 0.5f,-0.5f), osg::Vec2f(-0.5f, 0.5f) };
+
+    graph.addResource( "glare_colour",      _screenDims, GL_RGBA );
+    graph.addResource( "glare_luminance",   _screenDims, GL_LUMINANCE );
+    graph.addResource( "glare_downsampled", lowResDims,  GL_RGBA );
+
+    graph.addPass( "glare_scene",      GLARE_BRANCH ).writes( "glare_colour" ).writes( "glare_luminance" );
+    graph.addPass( "glare_downsample", GLARE_BRANCH ).reads( "glare_colour" ).reads( "glare_luminance" ).writes( "glare_downsampled" );
+
+    for( unsigned int i = 0; i < 4; ++i )
+    {
+        graph.addResource( streakNames[i][0], lowResDims, GL_RGB );
+        graph.addResource( streakNames[i][1], lowResDims, GL_RGB );
+    }
 
-            // Downsize image
-            osg::TextureRectangle* downsizedTexture = createTextureRectangle( lowResDims, GL_RGBA );
-            _glarePasses.push_back( downsamplePass( fullScreenTexture, luminanceTexture, downsizedTexture, true ) );
+    if( _glareQuality == HIGH_QUALITY_GLARE )
+    {
+        for( unsigned int i = 0; i < 4; ++i )
+        {
+            graph.addPass( streakNames[i][0], GLARE_BRANCH ).reads( "glare_downsampled" ).writes( streakNames[i][0] );
+            graph.addPass( streakNames[i][1], GLARE_BRANCH ).reads( streakNames[i][0] ).writes( streakNames[i][1] );
+        }
+    }
+    else
+    {
+        PostProcessGraph::Pass& streaks = graph.addPass( "glare_streaks", GLARE_BRANCH ).reads( "glare_downsampled" );
+        for( unsigned int i = 0; i < 4; ++i )
+            streaks.writes( streakNames[i][1] );
+
+        graph.addResource( "glare_bloom_down_1", _screenDims/8,  GL_RGB );
+        graph.addResource( "glare_bloom_down_2", _screenDims/16, GL_RGB );
+        graph.addResource( "glare_bloom_up_1",   _screenDims/8,  GL_RGB );
+        graph.addResource( "glare_bloom",        lowResDims,     GL_RGB );
+
+        graph.addPass( "glare_bloom_down_1", GLARE_BRANCH ).reads( "glare_downsampled" ).writes( "glare_bloom_down_1" );
+        graph.addPass( "glare_bloom_down_2", GLARE_BRANCH ).reads( "glare_bloom_down_1" ).writes( "glare_bloom_down_2" );
+        graph.addPass( "glare_bloom_up_1",   GLARE_BRANCH ).reads( "glare_bloom_down_2" ).writes( "glare_bloom_up_1" );
+        graph.addPass( "glare_bloom_up_2",   GLARE_BRANCH ).reads( "glare_bloom_up_1" ).writes( "glare_bloom" );
+    }
 
-            // Streak filter top Right
-            osg::TextureRectangle* streakBuffer1 = createTextureRectangle( lowResDims, GL_RGB );
-            _glarePasses.push_back( glarePass(downsizedTexture,streakBuffer1, 1, osg::Vec2f(0.5f,0.5f) ) );
+    PostProcessGraph::Pass& glareCombiner = graph.addPass( "glare_combiner", GLARE_BRANCH ).reads( "glare_colour" );
+    for( unsigned int i = 0; i < 4; ++i )
+        glareCombiner.reads( streakNames[i][1] );
 
-            osg::TextureRectangle* streakBuffer2 = createTextureRectangle( lowResDims, GL_RGB );
-            _glarePasses.push_back( glarePass(streakBuffer1,streakBuffer2, 2, osg::Vec2f(0.5f,0.5f) ) );
+    if( _glareQuality == FAST_GLARE )
+        glareCombiner.reads( "glare_bloom" );
 
-            // Streak filter Bottom left
-            osg::TextureRectangle* streakBuffer3 = createTextureRectangle( lowResDims, GL_RGB );
-            _glarePasses.push_back( glarePass(downsizedTexture,streakBuffer3, 1, osg::Vec2f(-0.5f,-0.5f) ) );
+    graph.setBranchEnabled( DOF_BRANCH,   _enableDOF );
+    graph.setBranchEnabled( GLARE_BRANCH, _enableGlare );
+    graph.compile();
 
-            osg::TextureRectangle* streakBuffer4 = createTextureRectangle( lowResDims, GL_RGB );
-            _glarePasses.push_back( glarePass(streakBuffer3,streakBuffer4, 2, osg::Vec2f(-0.5f,-0.5f) ) );
+    if( _enableDOF )
+    {
+        _dofStateSet = new osg::StateSet;
+        _dofStateSet->addUniform( new osg::Uniform("osgOcean_DOF_Near",  _dofNear ) );
+        _dofStateSet->addUniform( new osg::Uniform("osgOcean_DOF_Far",   _dofFar ) );
+        _dofStateSet->addUniform( new osg::Uniform("osgOcean_DOF_Clamp", _dofFarClamp ) );
+        _dofStateSet->addUniform( new osg::Uniform("osgOcean_DOF_Focus", _dofFocus ) );
+
+        osg::Camera* fullPass = multipleRenderTargetPass( graph.getTexture("dof_colour"),    osg::Camera::COLOR_BUFFER0,
+                                                          graph.getTexture("dof_luminance"), osg::Camera::COLOR_BUFFER1 );
+
+        fullPass->setCullCallback( new PrerenderCameraCullCallback(this) );
+        fullPass->setStateSet(_dofStateSet.get());
+
+        graph.setCamera( "dof_scene",      fullPass );
+        graph.setCamera( "dof_downsample", downsamplePass( graph.getTexture("dof_colour"), NULL, graph.getTexture("dof_downsampled"), false ) );
+        graph.setCamera( "dof_gaussian_x", gaussianPass( graph.getTexture("dof_downsampled"), graph.getTexture("dof_blur_x"), true ) );
+        graph.setCamera( "dof_gaussian_y", gaussianPass( graph.getTexture("dof_blur_x"), graph.getTexture("dof_blur_xy"), false ) );
+        graph.setCamera( "dof_combiner",   dofCombinerPass( graph.getTexture("dof_colour"), graph.getTexture("dof_luminance"), 
+                                                            graph.getTexture("dof_blur_xy"), graph.getTexture("dof_combined") ) );
+        graph.setCamera( "dof_final",      dofFinalPass( graph.getTexture("dof_combined") ) );
+
+        graph.getCameras( DOF_BRANCH, _dofPasses );
+    }
 
-            // Streak filter Bottom right
-            osg::TextureRectangle* streakBuffer5 = createTextureRectangle( lowResDims, GL_RGB );
-            _glarePasses.push_back( glarePass(downsizedTexture,streakBuffer5, 1, osg::Vec2f(0.5f,-0.5f) ) );
+    if( _enableGlare )
+    {
+        _glareStateSet = new osg::StateSet;
+        _glareStateSet->addUniform( new osg::Uniform("osgOcean_EnableGlare", _enableGlare ) );
 
-            osg::TextureRectangle* streakBuffer6 = createTextureRectangle( lowResDims, GL_RGB );
-            _glarePasses.push_back( glarePass(streakBuffer5,streakBuffer6, 2, osg::Vec2f(0.5f,-0.5f) ) );
+        osg::Camera* fullPass = multipleRenderTargetPass( graph.getTexture("glare_colour"),    osg::Camera::COLOR_BUFFER0,
+                                                          graph.getTexture("glare_luminance"), osg::Camera::COLOR_BUFFER1 );
 
-            // Streak filter Top Left
-            osg::TextureRectangle* streakBuffer7 = createTextureRectangle( lowResDims, GL_RGB );
-            _glarePasses.push_back( glarePass(downsizedTexture,streakBuffer7,1, osg::Vec2f(-0.5f,0.5f) ) );
+        fullPass->setCullCallback( new PrerenderCameraCullCallback(this) );
+        fullPass->setStateSet(_glareStateSet.get());
 
-            osg::TextureRectangle* streakBuffer8 = createTextureRectangle( lowResDims, GL_RGB );
-            _glarePasses.push_back( glarePass(streakBuffer7,streakBuffer8, 2, osg::Vec2f(-0.5f,0.5f) ) );
+        graph.setCamera( "glare_scene",      fullPass );
+        graph.setCamera( "glare_downsample", downsamplePass( graph.getTexture("glare_colour"), graph.getTexture("glare_luminance"), graph.getTexture("glare_downsampled"), true ) );
 
-            // Final pass - combine glare and blend into scene.
-            _glarePasses.push_back( glareCombinerPass(fullScreenTexture, streakBuffer2, streakBuffer4, streakBuffer6, streakBuffer8 ) );
+        if( _glareQuality == HIGH_QUALITY_GLARE )
+        {
+            for( unsigned int i = 0; i < 4; ++i )
+            {
+                graph.setCamera( streakNames[i][0], glarePass( graph.getTexture("glare_downsampled"), graph.getTexture(streakNames[i][0]), 1, streakDirections[i] ) );
+                graph.setCamera( streakNames[i][1], glarePass( graph.getTexture(streakNames[i][0]),   graph.getTexture(streakNames[i][1]), 2, streakDirections[i] ) );
+            }
         }
-
-        if( _enableSilt )
+        else
         {
-            SiltEffect* silt = new SiltEffect;
-            // Clip silt above water level
-            silt->getOrCreateStateSet()->setMode( GL_CLIP_PLANE0+1, osg::StateAttribute::ON );
-            silt->setIntensity(0.07f);
-            silt->setParticleSpeed(0.025f);
-            silt->setNodeMask(_siltMask);
-
-            osg::ClipPlane* siltClipPlane = new osg::ClipPlane();
-            siltClipPlane->setClipPlaneNum(1);
-            siltClipPlane->setClipPlane( 0.0, 0.0, -1.0, -getOceanSurfaceHeight() );
+            graph.setCamera( "glare_streaks", glareStreakPass( graph.getTexture("glare_downsampled"), 
+                                                               graph.getTexture(streakNames[0][1]), graph.getTexture(streakNames[1][1]),
+                                                               graph.getTexture(streakNames[2][1]), graph.getTexture(streakNames[3][1]) ) );
+
+            graph.setCamera( "glare_bloom_down_1", kawasePass( graph.getTexture("glare_downsampled"),  graph.getTexture("glare_bloom_down_1"), true ) );
+            graph.setCamera( "glare_bloom_down_2", kawasePass( graph.getTexture("glare_bloom_down_1"), graph.getTexture("glare_bloom_down_2"), true ) );
+            graph.setCamera( "glare_bloom_up_1",   kawasePass( graph.getTexture("glare_bloom_down_2"), graph.getTexture("glare_bloom_up_1"),   false ) );
+            graph.setCamera( "glare_bloom_up_2",   kawasePass( graph.getTexture("glare_bloom_up_1"),   graph.getTexture("glare_bloom"),        false ) );
+        }
 
-            _siltClipNode = new osg::ClipNode;
-            _siltClipNode->addClipPlane( siltClipPlane );
-            _siltClipNode->addChild( silt );
+        graph.setCamera( "glare_combiner", glareCombinerPass( graph.getTexture("glare_colour"), 
+                                                              graph.getTexture(streakNames[0][1]), graph.getTexture(streakNames[1][1]),
+                                                              graph.getTexture(streakNames[2][1]), graph.getTexture(streakNames[3][1]),
+                                                              graph.getTexture("glare_bloom") ) );
 
-            addChild( _siltClipNode.get() );
-        }
+        graph.getCameras( GLARE_BRANCH, _glarePasses );
     }
-    
-    _isDirty = false;
+
+    _isPostProcessDirty = false;
 }
 
 OceanScene::ViewData* OceanScene::getViewDependentData( osgUtil::CullVisitor * cv )
@@ -606,6 +1038,7 @@ void OceanScene::ViewData::dirty( bool flag )
 }
 
 #include <osgOcean/shaders/osgOcean_heightmap_vert.inl>
+#include <osgOcean/shaders/osgOcean_heightmap_world_vert.inl>
 #include <osgOcean/shaders/osgOcean_heightmap_frag.inl>
 
 void OceanScene::ViewData::init( OceanScene *oceanScene, osgUtil::CullVisitor * cv )
@@ -622,6 +1055,10 @@ void OceanScene::ViewData::init( OceanScene *oceanScene, osgUtil::CullVisitor *
     _surfaceStateSet->addUniform( new osg::Uniform("osgOcean_EnableReflections",  _oceanScene->_enableReflections ) );
     _surfaceStateSet->addUniform( new osg::Uniform("osgOcean_ReflectionMap",      _oceanScene->_reflectionUnit ) );
 
+    _surfaceStateSet->addUniform( new osg::Uniform("osgOcean_EnableScreenSpaceReflections", false ) );
+    _surfaceStateSet->addUniform( new osg::Uniform("osgOcean_SceneColorMap",      _oceanScene->_sceneColorUnit ) );
+    _surfaceStateSet->addUniform( new osg::Uniform("osgOcean_SceneDepthMap",      _oceanScene->_sceneDepthUnit ) );
+
     _surfaceStateSet->addUniform( new osg::Uniform("osgOcean_EnableRefractions",  _oceanScene->_enableRefractions ) );
     _surfaceStateSet->addUniform( new osg::Uniform("osgOcean_RefractionMap",      _oceanScene->_refractionUnit ) );
     _surfaceStateSet->addUniform( new osg::Uniform("osgOcean_RefractionDepthMap", _oceanScene->_refractionDepthUnit ) );
@@ -630,15 +1067,26 @@ void OceanScene::ViewData::init( OceanScene *oceanScene, osgUtil::CullVisitor *
     _surfaceStateSet->addUniform( new osg::Uniform("osgOcean_Heightmap",          _oceanScene->_heightmapUnit ) );
 
     _surfaceStateSet->addUniform( new osg::Uniform(osg::Uniform::FLOAT_MAT4, "osgOcean_RefractionInverseTransformation") );
+    _surfaceStateSet->addUniform( new osg::Uniform(osg::Uniform::FLOAT_MAT4, "osgOcean_ReflectionViewProjection") );
+    _surfaceStateSet->addUniform( new osg::Uniform(osg::Uniform::FLOAT_MAT4, "osgOcean_RefractionViewProjection") );
     _surfaceStateSet->addUniform( new osg::Uniform("osgOcean_ViewportDimensions", osg::Vec2(_oceanScene->_screenDims.x(), _oceanScene->_screenDims.y()) ) );
 
+    _surfaceStateSet->addUniform( new osg::Uniform("osgOcean_ReflectionUVScale", osg::Vec2f(1.f, 1.f) ) );
+    _surfaceStateSet->addUniform( new osg::Uniform("osgOcean_RefractionUVScale", osg::Vec2f(1.f, 1.f) ) );
+    _surfaceStateSet->addUniform( new osg::Uniform("osgOcean_HeightmapUVScale",  osg::Vec2f(1.f, 1.f) ) );
+    _surfaceStateSet->addUniform( new osg::Uniform("osgOcean_ReflectionUVLimit", osg::Vec2f(1.f, 1.f) ) );
+    _surfaceStateSet->addUniform( new osg::Uniform("osgOcean_RefractionUVLimit", osg::Vec2f(1.f, 1.f) ) );
+    _surfaceStateSet->addUniform( new osg::Uniform("osgOcean_HeightmapUVLimit",  osg::Vec2f(1.f, 1.f) ) );
+
     _fog = new osg::Fog;
     _fog->setMode(osg::Fog::EXP2);
     _fog->setDensity(_oceanScene->_aboveWaterFogDensity);
     _fog->setColor(_oceanScene->_aboveWaterFogColor);
     _globalStateSet->setAttributeAndModes(_fog.get(), osg::StateAttribute::ON);
 
-    if( _oceanScene->_enableReflections )
+    _reflectionCamera = NULL;
+
+    if( _oceanScene->_enableReflections && _oceanScene->_reflectionMode != SCREEN_SPACE )
     {
         // Update the reflection matrix's translation to take into account
         // the ocean surface height. The translation we need is 2*h.
@@ -648,31 +1096,42 @@ void OceanScene::ViewData::init( OceanScene *oceanScene, osgUtil::CullVisitor *
                                            0,  0, -1,  0,    
                                            0,  0,  2 * _oceanScene->getOceanSurfaceHeight(),  1 );
 
-        osg::ref_ptr<osg::Texture2D> reflectionTexture = _oceanScene->createTexture2D( _oceanScene->_reflectionTexSize, GL_RGBA );
+        osg::ref_ptr<osg::Texture2D> reflectionTexture = _oceanScene->createTexture2D( _oceanScene->getReflectionPassSize(), GL_RGBA );
         
         // clip everything below water line
         _reflectionCamera = _oceanScene->renderToTexturePass( reflectionTexture.get() );
         _reflectionCamera->setClearColor( osg::Vec4( 0.0, 0.0, 0.0, 0.0 ) );
         _reflectionCamera->setComputeNearFarMode( osg::Camera::DO_NOT_COMPUTE_NEAR_FAR );
-        _reflectionCamera->setCullMask( _oceanScene->_reflectionSceneMask | _oceanScene->_ARMask);
+        _reflectionCamera->setCullMask( _oceanScene->_reflectionCullMask );
+        _reflectionCamera->setLODScale( _oceanScene->_reflectionLODScale );
         _reflectionCamera->setCullCallback( new CameraCullCallback(_oceanScene.get()) );
-        _reflectionCamera->getOrCreateStateSet()->setMode( GL_CLIP_PLANE0+0, osg::StateAttribute::ON );
-        _reflectionCamera->getOrCreateStateSet()->setMode( GL_CULL_FACE, osg::StateAttribute::OFF | osg::StateAttribute::OVERRIDE );
+
+        if( _oceanScene->_enableObliqueReflectionClipping )
+        {
+            // The mirror flips the winding, so swap the front face rather 
+            // than disabling back face culling.
+            _reflectionCamera->getOrCreateStateSet()->setAttributeAndModes( new osg::FrontFace(osg::FrontFace::CLOCKWISE), osg::StateAttribute::ON | osg::StateAttribute::OVERRIDE );
+        }
+        else
+        {
+            _reflectionCamera->getOrCreateStateSet()->setMode( GL_CLIP_PLANE0+0, osg::StateAttribute::ON );
+            _reflectionCamera->getOrCreateStateSet()->setMode( GL_CULL_FACE, osg::StateAttribute::OFF | osg::StateAttribute::OVERRIDE );
+        }
 
         _surfaceStateSet->setTextureAttributeAndModes( _oceanScene->_reflectionUnit, reflectionTexture.get(), osg::StateAttribute::ON );
     }
 
     if( _oceanScene->_enableRefractions )
     {
-        osg::Texture2D* refractionTexture = _oceanScene->createTexture2D( _oceanScene->_refractionTexSize, GL_RGBA );
-        osg::Texture2D* refractionDepthTexture = _oceanScene->createTexture2D( _oceanScene->_refractionTexSize, GL_DEPTH_COMPONENT );
+        _refractionTexture = _oceanScene->createTexture2D( _oceanScene->_refractionTexSize, GL_RGBA );
+        _refractionDepthTexture = _oceanScene->createTexture2D( _oceanScene->_refractionTexSize, GL_DEPTH_COMPONENT );
 
-        refractionTexture->setFilter(osg::Texture2D::MIN_FILTER, osg::Texture2D::NEAREST );
-        refractionTexture->setFilter(osg::Texture2D::MAG_FILTER, osg::Texture2D::NEAREST );
+        _refractionTexture->setFilter(osg::Texture2D::MIN_FILTER, osg::Texture2D::NEAREST );
+        _refractionTexture->setFilter(osg::Texture2D::MAG_FILTER, osg::Texture2D::NEAREST );
 
         _refractionCamera = _oceanScene->multipleRenderTargetPass( 
-            refractionTexture, osg::Camera::COLOR_BUFFER, 
-            refractionDepthTexture, osg::Camera::DEPTH_BUFFER );
+            _refractionTexture.get(), osg::Camera::COLOR_BUFFER, 
+            _refractionDepthTexture.get(), osg::Camera::DEPTH_BUFFER );
 
         _refractionCamera->setClearDepth( 1.0 );
         _refractionCamera->setClearColor( osg::Vec4( 0.0, 0.0, 0.0, 0.0 ) );
@@ -680,11 +1139,138 @@ void OceanScene::ViewData::init( OceanScene *oceanScene, osgUtil::CullVisitor *
         _refractionCamera->setCullMask( _oceanScene->_refractionSceneMask | _oceanScene->_ARMask );
         _refractionCamera->setCullCallback( new CameraCullCallback(_oceanScene.get()) );
 
-        _surfaceStateSet->setTextureAttributeAndModes( _oceanScene->_refractionUnit, refractionTexture, osg::StateAttribute::ON );
-        _surfaceStateSet->setTextureAttributeAndModes( _oceanScene->_refractionDepthUnit, refractionDepthTexture, osg::StateAttribute::ON );
+        _surfaceStateSet->setTextureAttributeAndModes( _oceanScene->_refractionUnit, _refractionTexture.get(), osg::StateAttribute::ON );
+        _surfaceStateSet->setTextureAttributeAndModes( _oceanScene->_refractionDepthUnit, _refractionDepthTexture.get(), osg::StateAttribute::ON );
     }
 
-    if ( _oceanScene->_enableHeightmap ) 
+    _reflectionHistory = RTTHistory();
+    _refractionHistory = RTTHistory();
+
+    _framebufferCopy = NULL;
+    _framebufferCopyStateSet = NULL;
+    _framebufferColorTexture = NULL;
+    _framebufferDepthTexture = NULL;
+    _refractionFromFramebuffer = false;
+    _copyFramebuffer = false;
+
+    bool framebufferRefraction  = _oceanScene->_enableRefractions && _oceanScene->_enableFramebufferRefraction;
+    bool screenSpaceReflections = _oceanScene->_enableReflections && _oceanScene->_reflectionMode != PLANAR;
+
+    if( framebufferRefraction || screenSpaceReflections )
+    {
+        // Separate textures as the copy resizes them to the viewport, 
+        // which would invalidate the refraction camera's attachments.
+        _framebufferColorTexture = _oceanScene->createTexture2D( _oceanScene->_screenDims, GL_RGBA );
+        _framebufferDepthTexture = _oceanScene->createTexture2D( _oceanScene->_screenDims, GL_DEPTH_COMPONENT );
+
+        _framebufferColorTexture->setFilter(osg::Texture2D::MIN_FILTER, osg::Texture2D::NEAREST );
+        _framebufferColorTexture->setFilter(osg::Texture2D::MAG_FILTER, osg::Texture2D::NEAREST );
+        _framebufferColorTexture->setResizeNonPowerOfTwoHint( false );
+        _framebufferDepthTexture->setResizeNonPowerOfTwoHint( false );
+
+        // Only replace the refraction transformation when the copy is 
+        // used for refractions, the refraction pass sets its own otherwise.
+        osg::Uniform* inverseTransformation = framebufferRefraction ? _surfaceStateSet->getUniform("osgOcean_RefractionInverseTransformation") : NULL;
+
+        _framebufferCopy = new FramebufferCopy( _framebufferColorTexture.get(), _framebufferDepthTexture.get(), inverseTransformation );
+
+        // After the opaque bin (0), before transparent geometry (10).
+        _framebufferCopyStateSet = new osg::StateSet;
+        _framebufferCopyStateSet->setRenderBinDetails( 8, "RenderBin" );
+
+        _surfaceStateSet->setTextureAttributeAndModes( _oceanScene->_sceneColorUnit, _framebufferColorTexture.get(), osg::StateAttribute::ON );
+        _surfaceStateSet->setTextureAttributeAndModes( _oceanScene->_sceneDepthUnit, _framebufferDepthTexture.get(), osg::StateAttribute::ON );
+    }
+
+    _surfaceQuery = NULL;
+    _surfaceQueryStateSet = NULL;
+
+    if( _oceanScene->_enableSurfaceOcclusionQuery && 
+        ( _oceanScene->_enableReflections || _oceanScene->_enableRefractions || _oceanScene->_enableHeightmap ) )
+    {
+        _surfaceQuery = new SurfaceOcclusionQuery;
+
+        // Depth tested against the opaque scene without writing anything.
+        _surfaceQueryStateSet = new osg::StateSet;
+        _surfaceQueryStateSet->setRenderBinDetails( 8, "RenderBin" );
+        _surfaceQueryStateSet->setAttributeAndModes( new osg::ColorMask( false, false, false, false ), osg::StateAttribute::ON );
+        _surfaceQueryStateSet->setAttributeAndModes( new osg::Depth( osg::Depth::LEQUAL, 0.0, 1.0, false ), osg::StateAttribute::ON );
+        _surfaceQueryStateSet->setAttributeAndModes( new osg::Program, osg::StateAttribute::ON );
+        _surfaceQueryStateSet->setMode( GL_CULL_FACE, osg::StateAttribute::OFF );
+        _surfaceQueryStateSet->setMode( GL_LIGHTING, osg::StateAttribute::OFF );
+    }
+
+    _heightmapCamera = NULL;
+    _heightmapTiles.clear();
+
+    // The refraction pass already renders the ocean floor with the same 
+    // view, the surface shaders reconstruct the water depth from it.
+    bool refractionHeightmap = _oceanScene->_enableHeightmap && _oceanScene->_heightmapMode == REFRACTION_HEIGHTMAP;
+    if ( refractionHeightmap && !_oceanScene->_enableRefractions )
+    {
+        osg::notify(osg::WARN) << "OceanScene: REFRACTION_HEIGHTMAP requires refractions, using VIEW_HEIGHTMAP." << std::endl;
+        refractionHeightmap = false;
+    }
+
+    _surfaceStateSet->addUniform( new osg::Uniform("osgOcean_EnableWorldHeightmap", _oceanScene->_heightmapMode == WORLD_HEIGHTMAP ) );
+    _surfaceStateSet->addUniform( new osg::Uniform("osgOcean_EnableRefractionHeightmap", refractionHeightmap ) );
+    _surfaceStateSet->addUniform( new osg::Uniform("osgOcean_WorldHeightmapSize",   _oceanScene->_worldHeightmapSize ) );
+    _surfaceStateSet->addUniform( new osg::Uniform("osgOcean_WorldHeightmapCentre", osg::Vec2f() ) );
+
+    if ( _oceanScene->_enableHeightmap && _oceanScene->_heightmapMode == WORLD_HEIGHTMAP )
+    {
+        unsigned int numTiles = _oceanScene->_worldHeightmapTiles;
+        int tileWidth  = osg::maximum( _oceanScene->_worldHeightmapTexSize.x() / (int)numTiles, 1 );
+        int tileHeight = osg::maximum( _oceanScene->_worldHeightmapTexSize.y() / (int)numTiles, 1 );
+
+        osg::Texture2D* heightmapTexture = _oceanScene->createTexture2D( osg::Vec2s( tileWidth * numTiles, tileHeight * numTiles ), GL_DEPTH_COMPONENT );
+        heightmapTexture->setWrap( osg::Texture::WRAP_S, osg::Texture::REPEAT );
+        heightmapTexture->setWrap( osg::Texture::WRAP_T, osg::Texture::REPEAT );
+
+        static const char osgOcean_heightmap_world_vert_file[] = "osgOcean_heightmap_world.vert";
+        static const char osgOcean_heightmap_frag_file[]       = "osgOcean_heightmap.frag";
+
+        osg::ref_ptr<osg::Program> program = ShaderManager::instance().createProgram( "heightmap_world", 
+                                                                                      osgOcean_heightmap_world_vert_file, osgOcean_heightmap_frag_file, 
+                                                                                      osgOcean_heightmap_world_vert,      osgOcean_heightmap_frag );
+
+        osg::ref_ptr<osg::StateSet> tileStateSet = new osg::StateSet;
+        tileStateSet->setAttributeAndModes( new osg::Depth(osg::Depth::LESS, 0.0f, 1.0f, true) );
+
+        if(program.valid())
+            tileStateSet->setAttributeAndModes( program.get(), osg::StateAttribute::ON | osg::StateAttribute::OVERRIDE );
+
+        // One camera per texture slot, each clears and renders its own part
+        // of the shared texture.
+        _heightmapTiles.resize( numTiles * numTiles );
+
+        for( unsigned int y = 0; y < numTiles; ++y )
+        {
+            for( unsigned int x = 0; x < numTiles; ++x )
+            {
+                osg::Camera* camera = new osg::Camera;
+
+                camera->setClearMask( GL_DEPTH_BUFFER_BIT );
+                camera->setClearDepth( 1.0 );
+                camera->setComputeNearFarMode( osg::Camera::DO_NOT_COMPUTE_NEAR_FAR );
+                camera->setStateSet( tileStateSet.get() );
+
+                camera->setReferenceFrame( osg::Transform::ABSOLUTE_RF );
+                camera->setViewport( x * tileWidth, y * tileHeight, tileWidth, tileHeight );
+                camera->setRenderOrder( osg::Camera::PRE_RENDER );
+                camera->setRenderTargetImplementation( osg::Camera::FRAME_BUFFER_OBJECT );
+                camera->attach( osg::Camera::DEPTH_BUFFER, heightmapTexture );
+
+                camera->setCullMask( _oceanScene->_heightmapMask );
+                camera->setCullCallback( new CameraCullCallback(_oceanScene.get()) );
+
+                _heightmapTiles[y * numTiles + x]._camera = camera;
+            }
+        }
+
+        _surfaceStateSet->setTextureAttributeAndModes( _oceanScene->_heightmapUnit, heightmapTexture, osg::StateAttribute::ON );
+    }
+    else if ( _oceanScene->_enableHeightmap && !refractionHeightmap ) 
     {
         osg::Texture2D* heightmapTexture = _oceanScene->createTexture2D( _oceanScene->_refractionTexSize, GL_DEPTH_COMPONENT );
 
@@ -745,9 +1331,15 @@ void OceanScene::ViewData::updateStateSet( bool eyeAboveWater )
 
     bool reflectionEnabled = _oceanScene->_enableReflections && eyeAboveWater && enabled && 
                              ( _cv->getEyePoint().z() < _oceanScene->_eyeHeightReflectionCutoff - _oceanScene->getOceanSurfaceHeight() );
-    _surfaceStateSet->getUniform("osgOcean_EnableReflections")->set(reflectionEnabled);
 
-    if (reflectionEnabled)
+    // osgOcean_EnableReflections refers to the planar pass only.
+    bool planarReflection = reflectionEnabled && _reflectionCamera.valid();
+    bool framebufferCopy = _framebufferCopy.valid() && !static_cast<FramebufferCopy*>(_framebufferCopy.get())->isMultisampled();
+    bool screenSpaceReflection = reflectionEnabled && framebufferCopy && _oceanScene->_reflectionMode != PLANAR;
+    _surfaceStateSet->getUniform("osgOcean_EnableReflections")->set(planarReflection);
+    _surfaceStateSet->getUniform("osgOcean_EnableScreenSpaceReflections")->set(screenSpaceReflection);
+
+    if (planarReflection)
     {
         // Update the reflection matrix's translation to take into account
         // the ocean surface height. The translation we need is 2*h.
@@ -763,8 +1355,171 @@ void OceanScene::ViewData::updateStateSet( bool eyeAboveWater )
     bool refractionEnabled = _oceanScene->_enableRefractions && enabled;
     _surfaceStateSet->getUniform("osgOcean_EnableRefractions")->set(refractionEnabled);
 
+    // Above water the refractions can be copied from the framebuffer. 
+    // Underwater the refraction pass is kept, as the surface shader relies
+    // on its cleared alpha to find the sky.
+    bool refractionFromFramebuffer = refractionEnabled && eyeAboveWater && _oceanScene->_enableFramebufferRefraction && framebufferCopy;
+    if (refractionFromFramebuffer != _refractionFromFramebuffer)
+    {
+        osg::Texture2D* colorTexture = refractionFromFramebuffer ? _framebufferColorTexture.get() : _refractionTexture.get();
+        osg::Texture2D* depthTexture = refractionFromFramebuffer ? _framebufferDepthTexture.get() : _refractionDepthTexture.get();
+
+        _surfaceStateSet->setTextureAttributeAndModes( _oceanScene->_refractionUnit, colorTexture, osg::StateAttribute::ON );
+        _surfaceStateSet->setTextureAttributeAndModes( _oceanScene->_refractionDepthUnit, depthTexture, osg::StateAttribute::ON );
+
+        _refractionFromFramebuffer = refractionFromFramebuffer;
+    }
+
+    bool copyFramebuffer = refractionFromFramebuffer || screenSpaceReflection;
+    if (copyFramebuffer != _copyFramebuffer)
+    {
+        // The surface has to be drawn after the copy.
+        if (copyFramebuffer)
+            _surfaceStateSet->setRenderBinDetails( 9, "RenderBin" );
+        else
+            _surfaceStateSet->setRenderBinToInherit();
+
+        _copyFramebuffer = copyFramebuffer;
+    }
+
     bool heightmapEnabled = _oceanScene->_enableHeightmap && eyeAboveWater && enabled;
     _surfaceStateSet->getUniform("osgOcean_EnableHeightmap")->set(heightmapEnabled);
+
+    // Decide which RTT passes are rendered again this frame, the others
+    // reproject their previous texture. A pass that was skipped for a
+    // while has nothing worth reprojecting.
+    _updateReflection = planarReflection && isRTTUpdateDue( _reflectionHistory, currentCamera );
+    if (!planarReflection)
+        _reflectionHistory._valid = false;
+
+    bool refractionPass = refractionEnabled && !refractionFromFramebuffer && _refractionCamera.valid();
+    _updateRefraction = refractionPass && isRTTUpdateDue( _refractionHistory, currentCamera );
+    if (!refractionPass)
+        _refractionHistory._valid = false;
+
+    // The framebuffer copy is made with the current view every frame.
+    if (refractionFromFramebuffer)
+        _surfaceStateSet->getUniform("osgOcean_RefractionViewProjection")->set( currentCamera->getViewMatrix() * currentCamera->getProjectionMatrix() );
+
+    updateResolution( currentCamera );
+}
+
+bool OceanScene::ViewData::isRTTUpdateDue( const RTTHistory& history, osg::Camera* currentCamera ) const
+{
+    if( !history._valid || history._invalidation != _oceanScene->_rttInvalidation )
+        return true;
+
+    if( history._projectionMatrix != currentCamera->getProjectionMatrix() )
+        return true;
+
+    const RTTUpdatePolicy& policy = _oceanScene->getRTTUpdatePolicy( currentCamera->getView() );
+
+    const osg::FrameStamp* frameStamp = _cv->getFrameStamp();
+    if( !frameStamp || (policy.frameInterval > 0 && 
+        frameStamp->getFrameNumber() - history._frameNumber >= policy.frameInterval) )
+        return true;
+
+    if( history._viewMatrix == currentCamera->getViewMatrix() )
+        return false;
+
+    osg::Matrixd previousInverse = osg::Matrixd::inverse( history._viewMatrix );
+    osg::Matrixd currentInverse  = osg::Matrixd::inverse( currentCamera->getViewMatrix() );
+
+    if( (currentInverse.getTrans() - previousInverse.getTrans()).length() > policy.distanceThreshold )
+        return true;
+
+    // Compare the view and up directions so rolling the camera counts too.
+    double cosThreshold = cos( osg::DegreesToRadians( policy.angleThreshold ) );
+
+    osg::Vec3d previousDir = osg::Matrixd::transform3x3( osg::Vec3d(0,0,-1), previousInverse );
+    osg::Vec3d currentDir  = osg::Matrixd::transform3x3( osg::Vec3d(0,0,-1), currentInverse );
+    osg::Vec3d previousUp  = osg::Matrixd::transform3x3( osg::Vec3d(0,1,0), previousInverse );
+    osg::Vec3d currentUp   = osg::Matrixd::transform3x3( osg::Vec3d(0,1,0), currentInverse );
+
+    return previousDir * currentDir < cosThreshold || previousUp * currentUp < cosThreshold;
+}
+
+void OceanScene::ViewData::recordRTTUpdate( RTTHistory& history, osg::Camera* currentCamera )
+{
+    const osg::FrameStamp* frameStamp = _cv->getFrameStamp();
+
+    history._viewMatrix       = currentCamera->getViewMatrix();
+    history._projectionMatrix = currentCamera->getProjectionMatrix();
+    history._frameNumber      = frameStamp ? frameStamp->getFrameNumber() : 0;
+    history._invalidation     = _oceanScene->_rttInvalidation;
+    history._valid            = true;
+}
+
+void OceanScene::ViewData::updateResolution( osg::Camera* currentCamera )
+{
+    if( !_oceanScene->_enableDynamicResolution )
+    {
+        _resolutionLevel = 1.f;
+        _frameTime = 0.0;
+    }
+    else
+    {
+        // Prefer the GPU draw time of the view's camera, only collected 
+        // when GPU stats are on. Otherwise fall back to the time between frames.
+        double frameTime = 0.0;
+        osg::Stats* stats = currentCamera->getStats();
+        if( !stats || !stats->getAveragedAttribute("GPU draw time taken", frameTime) )
+            frameTime = 0.0;
+
+        const osg::FrameStamp* frameStamp = _cv->getFrameStamp();
+        if( frameStamp )
+        {
+            double referenceTime = frameStamp->getReferenceTime();
+            if( frameTime <= 0.0 && _previousReferenceTime >= 0.0 )
+                frameTime = referenceTime - _previousReferenceTime;
+            _previousReferenceTime = referenceTime;
+        }
+
+        if( frameTime > 0.0 )
+        {
+            _frameTime = _frameTime > 0.0 ? _frameTime * 0.9 + frameTime * 0.1 : frameTime;
+
+            // Step towards the budget, ignoring errors under 5% so the 
+            // resolution settles instead of oscillating around the target.
+            double budget = _oceanScene->_rttFrameTimeBudget / 1000.0;
+            double error = (budget - _frameTime) / budget;
+            if( fabs(error) > 0.05 )
+            {
+                float step = osg::clampBetween( (float)error * 0.1f, -0.05f, 0.02f );
+                _resolutionLevel = osg::clampBetween( _resolutionLevel + step, 0.f, 1.f );
+            }
+        }
+    }
+
+    const osg::Vec2f& reflectionRange = _oceanScene->_reflectionResolutionRange;
+    const osg::Vec2f& refractionRange = _oceanScene->_refractionResolutionRange;
+    const osg::Vec2f& heightmapRange  = _oceanScene->_heightmapResolutionRange;
+
+    float reflectionScale = 1.f, refractionScale = 1.f, heightmapScale = 1.f;
+
+    if( _oceanScene->_enableDynamicResolution )
+    {
+        reflectionScale = reflectionRange.x() + (reflectionRange.y() - reflectionRange.x()) * _resolutionLevel;
+        refractionScale = refractionRange.x() + (refractionRange.y() - refractionRange.x()) * _resolutionLevel;
+        heightmapScale  = heightmapRange.x()  + (heightmapRange.y()  - heightmapRange.x())  * _resolutionLevel;
+    }
+
+    // Passes reusing their previous texture keep the scale it was rendered at.
+    if( _updateReflection )
+        setRTTViewportScale( _reflectionCamera.get(), _oceanScene->getReflectionPassSize(), reflectionScale, 
+                             _surfaceStateSet->getUniform("osgOcean_ReflectionUVScale"), _surfaceStateSet->getUniform("osgOcean_ReflectionUVLimit") );
+    // The framebuffer copy always covers the whole of its textures, which are sized to the viewport.
+    if( _refractionFromFramebuffer )
+    {
+        const osg::Vec2s& screenDims = _oceanScene->_screenDims;
+        _surfaceStateSet->getUniform("osgOcean_RefractionUVScale")->set( osg::Vec2f(1.f, 1.f) );
+        _surfaceStateSet->getUniform("osgOcean_RefractionUVLimit")->set( osg::Vec2f( 1.f-0.5f/screenDims.x(), 1.f-0.5f/screenDims.y() ) );
+    }
+    else if( _updateRefraction )
+        setRTTViewportScale( _refractionCamera.get(), _oceanScene->_refractionTexSize, refractionScale, 
+                             _surfaceStateSet->getUniform("osgOcean_RefractionUVScale"), _surfaceStateSet->getUniform("osgOcean_RefractionUVLimit") );
+    setRTTViewportScale( _heightmapCamera.get(),  _oceanScene->_refractionTexSize, heightmapScale,  
+                         _surfaceStateSet->getUniform("osgOcean_HeightmapUVScale"), _surfaceStateSet->getUniform("osgOcean_HeightmapUVLimit") );
 }
 
 void OceanScene::ViewData::cull( bool eyeAboveWater, bool surfaceVisible )
@@ -780,10 +1535,14 @@ void OceanScene::ViewData::cull( bool eyeAboveWater, bool surfaceVisible )
     bool heightmapEnabled;
     _surfaceStateSet->getUniform("osgOcean_EnableHeightmap")->get(heightmapEnabled);
 
+    // Skip every pass while the surface is hidden behind the scene.
+    surfaceVisible = surfaceVisible && !isSurfaceOccluded();
+
     _cv->pushStateSet(_oceanScene->_globalStateSet.get());
 
-    // Render refraction if ocean surface is visible.
-    if( surfaceVisible && refractionEnabled && _refractionCamera )
+    // Render refraction if ocean surface is visible and it isn't copied 
+    // from the framebuffer.
+    if( surfaceVisible && refractionEnabled && _updateRefraction && _refractionCamera )
     {
         // update refraction camera and render refracted scene
         _refractionCamera->setViewMatrix( currentCamera->getViewMatrix() );
@@ -796,20 +1555,39 @@ void OceanScene::ViewData::cull( bool eyeAboveWater, bool surfaceVisible )
         osg::Matrixd projectionMatrix = _refractionCamera->getProjectionMatrix();
         osg::Matrixd inverseViewProjectionMatrix = osg::Matrixd::inverse(viewMatrix * projectionMatrix);
         _surfaceStateSet->getUniform("osgOcean_RefractionInverseTransformation")->set(inverseViewProjectionMatrix);
+        _surfaceStateSet->getUniform("osgOcean_RefractionViewProjection")->set(viewMatrix * projectionMatrix);
+
+        recordRTTUpdate( _refractionHistory, currentCamera );
     }
 
     // Render reflection if ocean surface is visible.
-    if( surfaceVisible && reflectionEnabled && _reflectionCamera )
+    if( surfaceVisible && reflectionEnabled && _updateReflection && _reflectionCamera )
     {
         // update reflection camera and render reflected scene
         _reflectionCamera->setViewMatrix( _reflectionMatrix * currentCamera->getViewMatrix() );
         _reflectionCamera->setProjectionMatrix( currentCamera->getProjectionMatrix() );
+        _reflectionCamera->setCullMask( _oceanScene->_reflectionCullMask );
+        _reflectionCamera->setLODScale( _oceanScene->_reflectionLODScale );
+
+        if( _oceanScene->_enableObliqueReflectionClipping )
+        {
+            setObliqueNearPlane( _reflectionCamera.get(), osg::Plane( 0.0, 0.0, 1.0, -_oceanScene->getOceanSurfaceHeight() ) );
+        }
         
         _reflectionCamera->accept( *_cv );
+
+        // The surface looks the reflection up through the unmirrored view.
+        _surfaceStateSet->getUniform("osgOcean_ReflectionViewProjection")->set( currentCamera->getViewMatrix() * currentCamera->getProjectionMatrix() );
+
+        recordRTTUpdate( _reflectionHistory, currentCamera );
     }
 
     // Render height map if ocean surface is visible.
-    if ( surfaceVisible && heightmapEnabled && _heightmapCamera ) 
+    if ( surfaceVisible && heightmapEnabled && !_heightmapTiles.empty() )
+    {
+        cullWorldHeightmap();
+    }
+    else if ( surfaceVisible && heightmapEnabled && _heightmapCamera ) 
     {
         // update refraction camera and render refracted scene
         _heightmapCamera->setViewMatrix( currentCamera->getViewMatrix() );
@@ -822,6 +1600,80 @@ void OceanScene::ViewData::cull( bool eyeAboveWater, bool surfaceVisible )
 }
 
 
+void OceanScene::setRTTUpdatePolicy(osg::View* view, const RTTUpdatePolicy& policy)
+{
+    _rttUpdatePolicies[view] = policy;
+}
+
+const OceanScene::RTTUpdatePolicy& OceanScene::getRTTUpdatePolicy(osg::View* view) const
+{
+    RTTUpdatePolicyMap::const_iterator it = _rttUpdatePolicies.find(view);
+    if (it != _rttUpdatePolicies.end())
+        return it->second;
+
+    return _rttUpdatePolicy;
+}
+
+bool OceanScene::ViewData::isSurfaceOccluded( void ) const
+{
+    if( !_surfaceQuery.valid() || !_cv.valid() || !_cv->getFrameStamp() )
+        return false;
+
+    unsigned int samplesPassed, frame;
+    if( !static_cast<const SurfaceOcclusionQuery*>( _surfaceQuery.get() )->getResult( samplesPassed, frame ) )
+        return false;
+
+    // A result from before the surface was last culled says nothing about 
+    // the current view.
+    unsigned int frameNumber = _cv->getFrameStamp()->getFrameNumber();
+    if( frameNumber - frame > MAX_OCCLUSION_QUERY_AGE )
+        return false;
+
+    return samplesPassed < _oceanScene->_surfaceOcclusionThreshold;
+}
+
+void OceanScene::ViewData::cullWorldHeightmap( void )
+{
+    int numTiles = (int)_oceanScene->_worldHeightmapTiles;
+    double tileSize = _oceanScene->_worldHeightmapSize / numTiles;
+
+    // Keep the eye's tile in the middle of the cached area.
+    osg::Vec3d eye = _cv->getEyePoint();
+    int minX = (int)floor( eye.x() / tileSize ) - numTiles / 2;
+    int minY = (int)floor( eye.y() / tileSize ) - numTiles / 2;
+
+    // Centre of the cached area, not of the eye's tile, for odd tile counts too.
+    osg::Vec2f centre( (minX + numTiles * 0.5) * tileSize, (minY + numTiles * 0.5) * tileSize );
+    _surfaceStateSet->getUniform("osgOcean_WorldHeightmapCentre")->set( centre );
+
+    for( int y = minY; y < minY + numTiles; ++y )
+    {
+        for( int x = minX; x < minX + numTiles; ++x )
+        {
+            int slotX = ((x % numTiles) + numTiles) % numTiles;
+            int slotY = ((y % numTiles) + numTiles) % numTiles;
+
+            HeightmapTile& tile = _heightmapTiles[slotY * numTiles + slotX];
+
+            if( tile._valid && tile._x == x && tile._y == y && 
+                tile._invalidation == _oceanScene->_heightmapInvalidation )
+                continue;
+
+            // Look straight down at the tile's centre, see osgOcean_heightmap_world.vert.
+            double halfSize = tileSize * 0.5;
+            tile._camera->setViewMatrix( osg::Matrixd::translate( -(x * tileSize + halfSize), -(y * tileSize + halfSize), 0.0 ) );
+            tile._camera->setProjectionMatrixAsOrtho( -halfSize, halfSize, -halfSize, halfSize, -1e5, 1e5 );
+
+            tile._camera->accept( *_cv );
+
+            tile._x = x;
+            tile._y = y;
+            tile._invalidation = _oceanScene->_heightmapInvalidation;
+            tile._valid = true;
+        }
+    }
+}
+
 void OceanScene::enableRTTEffectsForView(osg::View* view, bool enable)
 {
     ViewSet::iterator it = _viewsWithRTTEffectsDisabled.find(view);
@@ -845,6 +1697,8 @@ void OceanScene::traverse( osg::NodeVisitor& nv )
     {
         if( _isDirty )
             init();
+        else if( _isPostProcessDirty && _globalStateSet.valid() )
+            initPostProcessing();
 
         update(nv);
 
@@ -1042,6 +1896,34 @@ void OceanScene::cull(osgUtil::CullVisitor& cv, bool eyeAboveWater, bool surface
         if (vd)
         {
             cv.popStateSet();
+
+            // Copy the opaque scene for the refractions and screen space 
+            // reflections, the surface stateset places the surface in a later bin.
+            if (vd->_copyFramebuffer)
+            {
+                cv.pushStateSet( vd->_framebufferCopyStateSet.get() );
+                cv.addDrawable( vd->_framebufferCopy.get(), cv.getModelViewMatrix() );
+                cv.popStateSet();
+            }
+
+            // Query the water plane over the surface's bound. It is placed at 
+            // the wave crests (troughs underwater) so the surface itself 
+            // doesn't hide it.
+            const osg::BoundingSphere& bound = _oceanTransform->getBound();
+            if (vd->_surfaceQuery.valid() && bound.valid())
+            {
+                float waveHeight = osg::maximum( _oceanSurface->getMaximumHeight(), 0.f );
+                float height = getOceanSurfaceHeight() + ( eyeAboveWater ? waveHeight : -waveHeight );
+
+                osg::ref_ptr<osg::RefMatrix> matrix = new osg::RefMatrix( 
+                    osg::Matrix::scale( bound.radius(), bound.radius(), 1.0 ) * 
+                    osg::Matrix::translate( bound.center().x(), bound.center().y(), height ) *
+                    *cv.getModelViewMatrix() );
+
+                cv.pushStateSet( vd->_surfaceQueryStateSet.get() );
+                cv.addDrawable( vd->_surfaceQuery.get(), matrix.get() );
+                cv.popStateSet();
+            }
         }
     }
 
@@ -1312,14 +2194,99 @@ osg::Camera* OceanScene::glarePass(osg::TextureRectangle* streakInput,
     return glarePass;
 }
 
+#include <osgOcean/shaders/osgOcean_streak_mrt_frag.inl>
+
+osg::Camera* OceanScene::glareStreakPass(osg::TextureRectangle* streakInput, 
+                                         osg::TextureRectangle* streakOutput1,
+                                         osg::TextureRectangle* streakOutput2,
+                                         osg::TextureRectangle* streakOutput3,
+                                         osg::TextureRectangle* streakOutput4 )
+{
+    static const char osgOcean_streak_vert_file[]     = "osgOcean_streak.vert";
+    static const char osgOcean_streak_mrt_frag_file[] = "osgOcean_streak_mrt.frag";
+
+    osg::Vec2s lowResDims = _screenDims / 4;
+
+    osg::Camera* streakPass = multipleRenderTargetPass( streakOutput1, osg::Camera::COLOR_BUFFER0,
+                                                        streakOutput2, osg::Camera::COLOR_BUFFER1 );
+    streakPass->attach( osg::Camera::COLOR_BUFFER2, streakOutput3 );
+    streakPass->attach( osg::Camera::COLOR_BUFFER3, streakOutput4 );
+    streakPass->setClearColor( osg::Vec4f( 0.f, 0.f, 0.f, 0.f) );
+    streakPass->setProjectionMatrixAsOrtho( 0, lowResDims.x(), 0.f, lowResDims.y(), 1.0, 500.f );
+    {
+        osg::Program* program = 
+            ShaderManager::instance().createProgram( "streak_mrt_shader", 
+                                                     osgOcean_streak_vert_file, osgOcean_streak_mrt_frag_file, 
+                                                     osgOcean_streak_vert,      osgOcean_streak_mrt_frag );
+
+        osg::Geode* screenQuad = createScreenQuad(lowResDims, lowResDims);
+        screenQuad->getOrCreateStateSet()->setMode(GL_LIGHTING, osg::StateAttribute::OFF);
+        screenQuad->getOrCreateStateSet()->setAttributeAndModes(program, osg::StateAttribute::ON );
+        screenQuad->getStateSet()->addUniform( new osg::Uniform("osgOcean_Buffer", 0) );
+        screenQuad->getStateSet()->addUniform( new osg::Uniform("osgOcean_Attenuation", _glareAttenuation ) );
+        screenQuad->getOrCreateStateSet()->setTextureAttributeAndModes(0,streakInput,osg::StateAttribute::ON);
+        streakPass->addChild( screenQuad ); 
+    }
+
+    return streakPass;
+}
+
+#include <osgOcean/shaders/osgOcean_kawase_down_frag.inl>
+#include <osgOcean/shaders/osgOcean_kawase_up_frag.inl>
+
+osg::Camera* OceanScene::kawasePass( osg::TextureRectangle* inputTexture, osg::TextureRectangle* outputTexture, bool isDownsample )
+{
+    static const char osgOcean_downsample_vert_file[]  = "osgOcean_downsample.vert";
+    static const char osgOcean_kawase_down_frag_file[] = "osgOcean_kawase_down.frag";
+    static const char osgOcean_kawase_up_frag_file[]   = "osgOcean_kawase_up.frag";
+
+    osg::Vec2s inputDims ( inputTexture->getTextureWidth(),  inputTexture->getTextureHeight() );
+    osg::Vec2s outputDims( outputTexture->getTextureWidth(), outputTexture->getTextureHeight() );
+
+    osg::StateSet* ss = new osg::StateSet;
+
+    if (isDownsample)
+    {
+        ss->setAttributeAndModes( 
+            ShaderManager::instance().createProgram("kawase_down", 
+                                                    osgOcean_downsample_vert_file, osgOcean_kawase_down_frag_file,
+                                                    osgOcean_downsample_vert,      osgOcean_kawase_down_frag), 
+                                                    osg::StateAttribute::ON );
+    }
+    else
+    {
+        ss->setAttributeAndModes( 
+            ShaderManager::instance().createProgram("kawase_up", 
+                                                    osgOcean_downsample_vert_file, osgOcean_kawase_up_frag_file,
+                                                    osgOcean_downsample_vert,      osgOcean_kawase_up_frag), 
+                                                    osg::StateAttribute::ON );
+    }
+
+    ss->setTextureAttributeAndModes( 0, inputTexture, osg::StateAttribute::ON );
+    ss->addUniform( new osg::Uniform( "osgOcean_KawaseTexture", 0 ) );
+
+    // Texture coordinates span the input, in texels.
+    osg::Geode* kawaseQuad = createScreenQuad( outputDims, inputDims );
+    kawaseQuad->setStateSet(ss);
+
+    osg::Camera* kawaseCamera = renderToTexturePass( outputTexture );
+    kawaseCamera->setProjectionMatrixAsOrtho( 0, outputDims.x(), 0, outputDims.y(), 1, 10 );
+    kawaseCamera->setViewMatrix(osg::Matrix::identity());
+    kawaseCamera->addChild( kawaseQuad );
+
+    return kawaseCamera;
+}
+
 #include <osgOcean/shaders/osgOcean_glare_composite_vert.inl>
 #include <osgOcean/shaders/osgOcean_glare_composite_frag.inl>
+#include <osgOcean/shaders/osgOcean_glare_bloom_composite_frag.inl>
 
 osg::Camera* OceanScene::glareCombinerPass( osg::TextureRectangle* fullscreenTexture,
                                             osg::TextureRectangle* glareTexture1,
                                             osg::TextureRectangle* glareTexture2,
                                             osg::TextureRectangle* glareTexture3,
-                                            osg::TextureRectangle* glareTexture4 )
+                                            osg::TextureRectangle* glareTexture4,
+                                            osg::TextureRectangle* bloomTexture )
 {
     osg::Camera* camera = new osg::Camera;
 
@@ -1332,13 +2299,24 @@ osg::Camera* OceanScene::glareCombinerPass( osg::TextureRectangle* fullscreenTex
 
     osg::Geode* quad = createScreenQuad( _screenDims, _screenDims );
 
-    static const char osgOcean_glare_composite_vert_file[] = "osgOcean_glare_composite.vert";
-    static const char osgOcean_glare_composite_frag_file[] = "osgOcean_glare_composite.frag";
+    static const char osgOcean_glare_composite_vert_file[]       = "osgOcean_glare_composite.vert";
+    static const char osgOcean_glare_composite_frag_file[]       = "osgOcean_glare_composite.frag";
+    static const char osgOcean_glare_bloom_composite_frag_file[] = "osgOcean_glare_bloom_composite.frag";
 
-    osg::Program* program = 
-        ShaderManager::instance().createProgram( "glare_composite", 
-                                                 osgOcean_glare_composite_vert_file, osgOcean_glare_composite_frag_file, 
-                                                 osgOcean_glare_composite_vert,      osgOcean_glare_composite_frag );
+    osg::Program* program = NULL;
+
+    if( bloomTexture )
+    {
+        program = ShaderManager::instance().createProgram( "glare_bloom_composite", 
+                                                           osgOcean_glare_composite_vert_file, osgOcean_glare_bloom_composite_frag_file, 
+                                                           osgOcean_glare_composite_vert,      osgOcean_glare_bloom_composite_frag );
+    }
+    else
+    {
+        program = ShaderManager::instance().createProgram( "glare_composite", 
+                                                           osgOcean_glare_composite_vert_file, osgOcean_glare_composite_frag_file, 
+                                                           osgOcean_glare_composite_vert,      osgOcean_glare_composite_frag );
+    }
 
     osg::StateSet* ss = quad->getOrCreateStateSet();
     ss->setAttributeAndModes(program, osg::StateAttribute::ON);
@@ -1353,6 +2331,12 @@ osg::Camera* OceanScene::glareCombinerPass( osg::TextureRectangle* fullscreenTex
     ss->addUniform( new osg::Uniform("osgOcean_StreakBuffer3", 3 ) );
     ss->addUniform( new osg::Uniform("osgOcean_StreakBuffer4", 4 ) );
 
+    if( bloomTexture )
+    {
+        ss->setTextureAttributeAndModes(5, bloomTexture, osg::StateAttribute::ON );
+        ss->addUniform( new osg::Uniform("osgOcean_BloomBuffer", 5 ) );
+    }
+
     camera->addChild( quad );
 
     return camera;
@@ -1371,6 +2355,14 @@ osg::Texture2D* OceanScene::createTexture2D( const osg::Vec2s& size, GLint forma
     return texture;
 }
 
+osg::Vec2s OceanScene::getReflectionPassSize( void ) const
+{
+    if( _reflectionMode == HYBRID )
+        return osg::Vec2s( osg::maximum( _reflectionTexSize.x() / 4, 16 ), osg::maximum( _reflectionTexSize.y() / 4, 16 ) );
+
+    return _reflectionTexSize;
+}
+
 osg::TextureRectangle* OceanScene::createTextureRectangle( const osg::Vec2s& size, GLint format )
 {
     osg::TextureRectangle* texture = new osg::TextureRectangle();
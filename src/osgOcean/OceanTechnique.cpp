@@ -65,7 +65,10 @@ bool OceanTechnique::isVisible( osgUtil::CullVisitor& cv, bool eyeAboveWater )
         double fovy, ratio, zNear, zFar;
         currentCamera->getProjectionMatrixAsPerspective(fovy, ratio, zNear, zFar);
 
-        static const float cutoff = fovy / 2.0;
+        // Sine of the angle from the look vector to the frustum's corners,
+        // computed per call as each camera has its own projection.
+        double halfFov = atan( tan( osg::DegreesToRadians( fovy / 2.0 ) ) * sqrt( 1.0 + ratio * ratio ) );
+        float cutoff = sin( halfFov );
         osg::Vec3 lookVector = cv.getLookVectorLocal();
         float dotProduct = lookVector * osg::Vec3(0,0,1);
         return ( eyeAboveWater && dotProduct <  cutoff) ||
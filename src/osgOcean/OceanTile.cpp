@@ -114,7 +114,6 @@ OceanTile::OceanTile( osg::FloatArray* heights,
     _maxHeight = maxHeight;
 
     computeNormals();
-    //computeMaxDelta();
 }
 
 OceanTile::OceanTile( const OceanTile& tile, 
@@ -296,34 +295,32 @@ void OceanTile::computeNormals( void )
     }
 }
 
-void OceanTile::computeMaxDelta( void )
+float OceanTile::computeMaxDelta( unsigned int step ) const
 {
     float deltaMax = 0;
 
-    int step = 2;
-    int numLevels = 6;
+    if( step < 2 || step > _resolution )
+        return deltaMax;
 
-    for (int level=1; level < numLevels; ++level)
+    for( unsigned int i=0; i < _resolution; ++i) 
     {
-        for( unsigned int i=0; i < _resolution; ++i) 
+        int posY = i/step * step;
+        
+        for( unsigned int j=0; j < _resolution; ++j) 
         {
-            int posY = i/step * step;
-            
-            for( unsigned int j=0; j < _resolution; ++j) 
+            if (i%step != 0 || j%step != 0) 
             {
-                if (i%step != 0 || j%step != 0) 
-                {
-                    int posX = j/step * step;
-
-                    float delta = biLinearInterp(posX, posX+step, posY, posY+step, j, i);
-                    delta -= getVertex(j, i).z();
-                    delta = fabs(delta);
-                    deltaMax = std::max(deltaMax, delta);
-                }
+                int posX = j/step * step;
+
+                float delta = biLinearInterp(posX, posX+step, posY, posY+step, j, i);
+                delta -= getVertex(j, i).z();
+                delta = fabs(delta);
+                deltaMax = std::max(deltaMax, delta);
             }
         }
-        step *= 2;
     }
+
+    return deltaMax;
 }
 
 float OceanTile::biLinearInterp(int lx, int hx, int ly, int hy, int tx, int ty ) const
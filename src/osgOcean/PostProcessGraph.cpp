@@ -0,0 +1,246 @@
+/*
+* This source file is part of the osgOcean library
+* 
+* Copyright (C) 2009 Kim Bale
+* Copyright (C) 2009 The University of Hull, UK
+* 
+* This program is free software; you can redistribute it and/or modify it under
+* the terms of the GNU Lesser General Public License as published by the Free Software
+* Foundation; either version 3 of the License, or (at your option) any later
+* version.
+
+* This program is distributed in the hope that it will be useful, but WITHOUT
+* ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+* FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+* http://www.gnu.org/copyleft/lesser.txt.
+*/
+
+#include <osgOcean/PostProcessGraph>
+#include <osg/Notify>
+
+#include <algorithm>
+
+using namespace osgOcean;
+
+namespace
+{
+    struct FirstUseLess
+    {
+        bool operator()( const std::pair<int, std::string>& lhs, const std::pair<int, std::string>& rhs ) const
+        {
+            return lhs.first < rhs.first;
+        }
+    };
+}
+
+PostProcessGraph::Pass::Pass( const std::string& name, unsigned int branch )
+    :_name  ( name )
+    ,_branch( branch )
+{
+}
+
+PostProcessGraph::Pass& PostProcessGraph::Pass::reads( const std::string& resource )
+{
+    _inputs.push_back( resource );
+    return *this;
+}
+
+PostProcessGraph::Pass& PostProcessGraph::Pass::writes( const std::string& resource )
+{
+    _outputs.push_back( resource );
+    return *this;
+}
+
+PostProcessGraph::PostProcessGraph( void )
+{
+}
+
+void PostProcessGraph::addResource( const std::string& name, const osg::Vec2s& size, GLint format )
+{
+    Resource& resource = _resources[name];
+    resource._size = size;
+    resource._format = format;
+}
+
+PostProcessGraph::Pass& PostProcessGraph::addPass( const std::string& name, unsigned int branch )
+{
+    _passes.push_back( Pass( name, branch ) );
+    return _passes.back();
+}
+
+void PostProcessGraph::setBranchEnabled( unsigned int branch, bool enable )
+{
+    _enabledBranches[branch] = enable;
+}
+
+bool PostProcessGraph::isBranchEnabled( unsigned int branch ) const
+{
+    std::map<unsigned int, bool>::const_iterator itr = _enabledBranches.find( branch );
+    return itr != _enabledBranches.end() && itr->second;
+}
+
+void PostProcessGraph::use( const std::string& name, int pass, unsigned int branch, bool isWrite )
+{
+    ResourceMap::iterator itr = _resources.find( name );
+    if( itr == _resources.end() )
+    {
+        osg::notify(osg::WARN) << "PostProcessGraph: pass " << _passes[pass]._name << " uses undeclared target " << name << std::endl;
+        return;
+    }
+
+    Resource& resource = itr->second;
+
+    if( resource._first == -1 )
+    {
+        if( !isWrite )
+            osg::notify(osg::WARN) << "PostProcessGraph: target " << name << " is read by " << _passes[pass]._name << " before it is written" << std::endl;
+
+        resource._first = pass;
+        resource._branch = branch;
+    }
+    else if( resource._branch != branch )
+    {
+        osg::notify(osg::WARN) << "PostProcessGraph: target " << name << " is used by more than one branch" << std::endl;
+    }
+
+    resource._last = osg::maximum( resource._last, pass );
+}
+
+void PostProcessGraph::compile( void )
+{
+    _targets.clear();
+
+    for( ResourceMap::iterator itr = _resources.begin(); itr != _resources.end(); ++itr )
+    {
+        itr->second._first = -1;
+        itr->second._last = -1;
+        itr->second._texture = NULL;
+    }
+
+    // Lifetimes of the targets used by enabled branches.
+    for( unsigned int i = 0; i < _passes.size(); ++i )
+    {
+        const Pass& pass = _passes[i];
+
+        if( !isBranchEnabled( pass._branch ) )
+            continue;
+
+        for( unsigned int j = 0; j < pass._inputs.size(); ++j )
+            use( pass._inputs[j], (int)i, pass._branch, false );
+
+        for( unsigned int j = 0; j < pass._outputs.size(); ++j )
+            use( pass._outputs[j], (int)i, pass._branch, true );
+    }
+
+    // Give each target, in order of first use, a texture of the same size
+    // and format that is no longer used by an earlier target of its branch.
+    std::vector< std::pair<int, std::string> > order;
+
+    for( ResourceMap::iterator itr = _resources.begin(); itr != _resources.end(); ++itr )
+    {
+        if( itr->second._first != -1 )
+            order.push_back( std::make_pair( itr->second._first, itr->first ) );
+    }
+
+    std::stable_sort( order.begin(), order.end(), FirstUseLess() );
+
+    for( unsigned int i = 0; i < order.size(); ++i )
+    {
+        Resource& resource = _resources[ order[i].second ];
+
+        Target* target = NULL;
+
+        for( std::vector<Target>::iterator itr = _targets.begin(); itr != _targets.end() && !target; ++itr )
+        {
+            if( itr->_size != resource._size || itr->_format != resource._format )
+                continue;
+
+            std::map<unsigned int, int>::const_iterator lastUse = itr->_lastUse.find( resource._branch );
+
+            if( lastUse == itr->_lastUse.end() || lastUse->second < resource._first )
+                target = &(*itr);
+        }
+
+        if( !target )
+        {
+            _targets.push_back( Target() );
+            target = &_targets.back();
+            target->_texture = createTexture( resource._size, resource._format );
+            target->_size = resource._size;
+            target->_format = resource._format;
+        }
+
+        target->_lastUse[resource._branch] = resource._last;
+        resource._texture = target->_texture;
+    }
+
+    osg::notify(osg::INFO) << "PostProcessGraph: " << getNumUsedResources() << " render targets in " << getNumTextures() << " textures" << std::endl;
+}
+
+osg::TextureRectangle* PostProcessGraph::getTexture( const std::string& name ) const
+{
+    ResourceMap::const_iterator itr = _resources.find( name );
+    return itr != _resources.end() ? itr->second._texture.get() : NULL;
+}
+
+void PostProcessGraph::setCamera( const std::string& name, osg::Camera* camera )
+{
+    for( std::vector<Pass>::iterator itr = _passes.begin(); itr != _passes.end(); ++itr )
+    {
+        if( itr->_name == name )
+        {
+            itr->_camera = camera;
+            return;
+        }
+    }
+
+    osg::notify(osg::WARN) << "PostProcessGraph: no pass named " << name << std::endl;
+}
+
+void PostProcessGraph::getCameras( unsigned int branch, std::vector< osg::ref_ptr<osg::Camera> >& cameras ) const
+{
+    if( !isBranchEnabled( branch ) )
+        return;
+
+    for( std::vector<Pass>::const_iterator itr = _passes.begin(); itr != _passes.end(); ++itr )
+    {
+        if( itr->_branch != branch )
+            continue;
+
+        if( itr->_camera.valid() )
+            cameras.push_back( itr->_camera );
+        else
+            osg::notify(osg::WARN) << "PostProcessGraph: pass " << itr->_name << " has no camera" << std::endl;
+    }
+}
+
+unsigned int PostProcessGraph::getNumUsedResources( void ) const
+{
+    unsigned int count = 0;
+
+    for( ResourceMap::const_iterator itr = _resources.begin(); itr != _resources.end(); ++itr )
+    {
+        if( itr->second._first != -1 )
+            ++count;
+    }
+
+    return count;
+}
+
+unsigned int PostProcessGraph::getNumTextures( void ) const
+{
+    return _targets.size();
+}
+
+osg::TextureRectangle* PostProcessGraph::createTexture( const osg::Vec2s& size, GLint format ) const
+{
+    osg::TextureRectangle* texture = new osg::TextureRectangle();
+    texture->setTextureSize(size.x(), size.y());
+    texture->setInternalFormat(format);
+    texture->setFilter(osg::Texture::MIN_FILTER, osg::Texture::LINEAR);
+    texture->setFilter(osg::Texture::MAG_FILTER, osg::Texture::LINEAR);
+    texture->setWrap(osg::Texture::WRAP_S, osg::Texture::CLAMP_TO_EDGE );
+    texture->setWrap(osg::Texture::WRAP_T, osg::Texture::CLAMP_TO_EDGE );
+    texture->setDataVariance(osg::Object::DYNAMIC);
+    return texture;
+}
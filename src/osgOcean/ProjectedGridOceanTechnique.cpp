@@ -0,0 +1,267 @@
+/*
+* This source file is part of the osgOcean library
+* 
+* Copyright (C) 2009 Kim Bale
+* Copyright (C) 2009 The University of Hull, UK
+* 
+* This program is free software; you can redistribute it and/or modify it under
+* the terms of the GNU Lesser General Public License as published by the Free Software
+* Foundation; either version 3 of the License, or (at your option) any later
+* version.
+
+* This program is distributed in the hope that it will be useful, but WITHOUT
+* ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+* FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+* http://www.gnu.org/copyleft/lesser.txt.
+*/
+
+#include <osgOcean/ProjectedGridOceanTechnique>
+#include <osgOcean/ShaderManager>
+#include <osgOcean/IndexUtils>
+#include <osg/io_utils>
+#include <osg/Math>
+
+using namespace osgOcean;
+
+namespace
+{
+    // The grid is built in screen space and covers whatever water each
+    // camera sees, so it has no bound and is never culled. cullView()
+    // extends each camera's near/far planes around its own eye instead.
+    class ProjectedGridBoundCallback : public osg::Drawable::ComputeBoundingBoxCallback
+    {
+    public:
+        virtual osg::BoundingBox computeBound( const osg::Drawable& ) const
+        {
+            return osg::BoundingBox();
+        }
+    };
+}
+
+ProjectedGridOceanTechnique::ProjectedGridOceanTechnique( unsigned int FFTGridSize,
+                                                          unsigned int resolution,
+                                                          unsigned int gridWidth,
+                                                          unsigned int gridHeight,
+                                                          float farDistance,
+                                                          const osg::Vec2f& windDirection,
+                                                          float windSpeed,
+                                                          float depth,
+                                                          float reflectionDamping,
+                                                          float waveScale,
+                                                          bool isChoppy,
+                                                          float choppyFactor,
+                                                          float animLoopTime,
+                                                          unsigned int numFrames)
+    :FFTOceanTechnique( FFTGridSize,
+                        resolution,
+                        1,
+                        windDirection,
+                        windSpeed,
+                        depth,
+                        reflectionDamping,
+                        waveScale,
+                        isChoppy,
+                        choppyFactor,
+                        animLoopTime,
+                        numFrames)
+    ,_gridWidth     ( osg::maximum( gridWidth,  2u ) )
+    ,_gridHeight    ( osg::maximum( gridHeight, 2u ) )
+    ,_farDistance   ( farDistance )
+    ,_gridMargin    ( 0.1f )
+{
+    setUserData( new OceanDataType(*this, _NUMFRAMES, 25) );
+    setCullCallback( new OceanAnimationCallback );
+    setUpdateCallback( new OceanAnimationCallback );
+}
+
+ProjectedGridOceanTechnique::ProjectedGridOceanTechnique( const ProjectedGridOceanTechnique& copy, const osg::CopyOp& copyop )
+    :FFTOceanTechnique   ( copy, copyop )
+    ,_gridWidth          ( copy._gridWidth )
+    ,_gridHeight         ( copy._gridHeight )
+    ,_farDistance        ( copy._farDistance )
+    ,_gridMargin         ( copy._gridMargin )
+    ,_mipmapData         ( copy._mipmapData )
+    ,_grid               ( copy._grid )
+    ,_displacementMap    ( copy._displacementMap )
+    ,_displacementNormals( copy._displacementNormals )
+{}
+
+ProjectedGridOceanTechnique::~ProjectedGridOceanTechnique(void)
+{
+}
+
+void ProjectedGridOceanTechnique::build( void )
+{
+    osg::notify(osg::INFO) << "ProjectedGridOceanTechnique::build()" << std::endl;
+
+    if( !ShaderManager::instance().areShadersEnabled() )
+        osg::notify(osg::WARN) << "ProjectedGridOceanTechnique: Shaders are disabled, the surface will not be drawn." << std::endl;
+
+    computeFrames( _NUMFRAMES, true, _mipmapData );
+    createDisplacementMaps( _mipmapData, osg::Texture::LINEAR, _displacementMap, _displacementNormals );
+    createGrid();
+
+    initStateSet();
+
+    _isDirty =  false;
+    _isStateDirty = false;
+
+    osg::notify(osg::INFO) << "ProjectedGridOceanTechnique::build() Complete." << std::endl;
+}
+
+void ProjectedGridOceanTechnique::initStateSet( void )
+{
+    osg::notify(osg::INFO) << "ProjectedGridOceanTechnique::initStateSet()" << std::endl;
+
+    osg::ref_ptr<osg::Program> program = createShader();
+
+    initSurfaceStateSet( program.get() );
+
+    // Heightfield
+    _stateset->addUniform( new osg::Uniform("osgOcean_DisplacementMap",       DISPLACEMENT_MAP ) );
+    _stateset->addUniform( new osg::Uniform("osgOcean_DisplacementNormalMap", DISPLACEMENT_NORMAL_MAP ) );
+    _stateset->addUniform( new osg::Uniform("osgOcean_DisplacementCoords",    osg::Vec2f( _tileResInv, 0.5f/float(_tileSize) ) ) );
+
+    // Set every frame, so it must not be shared with a draw still in flight.
+    osg::Uniform* displacementFrame = new osg::Uniform("osgOcean_DisplacementFrame", float(_oldFrame) );
+    displacementFrame->setDataVariance( osg::Object::DYNAMIC );
+    _stateset->addUniform( displacementFrame );
+
+    _stateset->addUniform( new osg::Uniform("osgOcean_TileOrigin",            _startPos ) );
+    _stateset->addUniform( new osg::Uniform("osgOcean_ProjectedGridFar",      _farDistance ) );
+
+    // Only read by the vertex shader so no modes need enabling.
+    _stateset->setTextureAttribute( DISPLACEMENT_MAP,        _displacementMap.get(),     osg::StateAttribute::ON | osg::StateAttribute::PROTECTED );
+    _stateset->setTextureAttribute( DISPLACEMENT_NORMAL_MAP, _displacementNormals.get(), osg::StateAttribute::ON | osg::StateAttribute::PROTECTED );
+
+    _isStateDirty = false;
+
+    osg::notify(osg::INFO) << "ProjectedGridOceanTechnique::initStateSet() Complete." << std::endl;
+}
+
+void ProjectedGridOceanTechnique::createGrid( void )
+{
+    osg::notify(osg::INFO) << "ProjectedGridOceanTechnique::createGrid()" << std::endl;
+    osg::notify(osg::INFO) << "Grid: " << _gridWidth << "x" << _gridHeight << std::endl;
+
+    removeDrawables(0, getNumDrawables());
+
+    if( !ShaderManager::instance().areShadersEnabled() )
+        return;
+
+    osg::Vec3Array* vertices = new osg::Vec3Array;
+    vertices->reserve( _gridWidth*_gridHeight );
+
+    // Normalised device coordinates, extended slightly past the screen edges.
+    float extent = 1.f + _gridMargin;
+
+    for( unsigned int r = 0; r < _gridHeight; ++r )
+    {
+        float y = -extent + 2.f*extent * float(r) / float(_gridHeight-1);
+
+        for( unsigned int c = 0; c < _gridWidth; ++c )
+        {
+            float x = -extent + 2.f*extent * float(c) / float(_gridWidth-1);
+            vertices->push_back( osg::Vec3f( x, y, 0.f ) );
+        }
+    }
+
+    std::vector<GLuint> triangles;
+    triangles.reserve( (_gridWidth-1)*(_gridHeight-1)*6 );
+
+    for( unsigned int r = 0; r < _gridHeight-1; ++r )
+    {
+        for( unsigned int c = 0; c < _gridWidth-1; ++c )
+        {
+            unsigned int i0 = c   +  r   *_gridWidth;
+            unsigned int i1 = c+1 +  r   *_gridWidth;
+            unsigned int i2 = c   + (r+1)*_gridWidth;
+            unsigned int i3 = c+1 + (r+1)*_gridWidth;
+
+            triangles.push_back(i0); triangles.push_back(i1); triangles.push_back(i2);
+            triangles.push_back(i1); triangles.push_back(i3); triangles.push_back(i2);
+        }
+    }
+
+    IndexUtils::optimizeTriangleOrder( triangles );
+
+    _grid = new osg::Geometry;
+    _grid->setUseDisplayList( false );
+    _grid->setUseVertexBufferObjects( true );
+    _grid->setVertexArray( vertices );
+    _grid->addPrimitiveSet( IndexUtils::createDrawElements( osg::PrimitiveSet::TRIANGLES, triangles ) );
+    _grid->setComputeBoundingBoxCallback( new ProjectedGridBoundCallback );
+
+    addDrawable( _grid.get() );
+}
+
+void ProjectedGridOceanTechnique::update( unsigned int frame, const double& dt, const osg::Vec3f& eye )
+{
+    if(_isDirty)
+        build();
+    else if(_isStateDirty)
+        initStateSet();
+
+    if (_isAnimating)
+    {
+        static double time = 0.0;
+        time += (dt * 0.001);      // dt is in milliseconds (see FFTOceanTechnique::OceanDataType::updateOcean() )
+
+        getStateSet()->getUniform("osgOcean_FrameTime")->set( float(time) );
+        getStateSet()->getUniform("osgOcean_NoiseCoords0")->set( computeNoiseCoords( 32.f, osg::Vec2f( 2.f, 4.f), 2.f, time ) );
+        getStateSet()->getUniform("osgOcean_NoiseCoords1")->set( computeNoiseCoords( 8.f,  osg::Vec2f(-4.f, 2.f), 1.f, time ) );
+        getStateSet()->getUniform("osgOcean_DisplacementFrame")->set( float(frame) );
+    }
+
+    _oldFrame = frame;
+}
+
+void ProjectedGridOceanTechnique::cullView( osgUtil::CullVisitor& cv, bool lodEye, float projectionScale, bool drawing )
+{
+    if( !drawing || !_grid.valid() || cv.getComputeNearFarMode() == osg::CullSettings::DO_NOT_COMPUTE_NEAR_FAR )
+        return;
+
+    // The surface reaches out to the far distance around this view's eye,
+    // which the near/far planes must cover.
+    const osg::Vec3f& eye = cv.getEyeLocal();
+    float maxHeight = osg::maximum( _maxHeight, 1.f );
+
+    osg::BoundingBox bound( eye.x()-_farDistance, eye.y()-_farDistance, -maxHeight,
+                            eye.x()+_farDistance, eye.y()+_farDistance,  maxHeight );
+
+    cv.updateCalculatedNearFar( *cv.getModelViewMatrix(), bound );
+}
+
+float ProjectedGridOceanTechnique::getSurfaceHeightAt(float x, float y, osg::Vec3f* normal)
+{
+    if(_isDirty)
+        build();
+
+    return getTileHeightAt( _mipmapData[_oldFrame], x, y, normal );
+}
+
+#include <osgOcean/shaders/osgOcean_ocean_surface_projected_vert.inl>
+#include <osgOcean/shaders/osgOcean_ocean_surface_frag.inl>
+
+osg::Program* ProjectedGridOceanTechnique::createShader(void)
+{
+    static const char osgOcean_ocean_surface_vert_file[] = "osgOcean_ocean_surface_projected.vert";
+    static const char osgOcean_ocean_surface_frag_file[] = "osgOcean_ocean_surface.frag";
+
+    osg::Program* program =
+        ShaderManager::instance().createProgram("ocean_surface",
+        osgOcean_ocean_surface_vert_file, osgOcean_ocean_surface_frag_file,
+        osgOcean_ocean_surface_projected_vert, osgOcean_ocean_surface_frag);
+
+    return program;
+}
+
+// register the read and write functions with the osgDB::Registry.
+REGISTER_DOTOSGWRAPPER(ProjectedGridOceanTechnique)
+(
+    new osgOcean::ProjectedGridOceanTechnique,
+    "ProjectedGridOceanTechnique",
+    "Object Node OceanTechnique FFTOceanTechnique ProjectedGridOceanTechnique Geode",
+    NULL,
+    NULL
+);